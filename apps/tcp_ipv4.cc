@@ -10,6 +10,7 @@
 #include <random>
 #include <span>
 #include <string>
+#include <string_view>
 #include <tuple>
 
 using namespace std;
@@ -31,10 +32,20 @@ void show_usage( const char* argv0, const char* msg )
        << "   -s <port>       Set source port (client mode only)              (random)\n\n"
 
        << "   -w <winsz>      Use a window of <winsz> bytes                   " << TCPConfig::MAX_PAYLOAD_SIZE
-       << "\n\n"
+       << "\n"
+       << "   -A              Autotune the window, growing it up to <winsz>   (fixed window)\n\n"
 
        << "   -t <tmout>      Set rt_timeout to tmout                         " << TCPConfig::TIMEOUT_DFLT << "\n\n"
 
+       << "   -m <mss>        Send and accept payloads of up to <mss> bytes   " << TCPConfig::MAX_PAYLOAD_SIZE
+       << "\n"
+       << "   -P              Probe the path for the largest payload <= mss   (no probing)\n"
+       << "   -N              Coalesce small writes (Nagle's algorithm)       (send at once)\n"
+       << "   -D              Delay ACKs, to ACK every second segment         (ACK every segment)\n"
+       << "   -p              Pace segments over the round trip               (send in bursts)\n\n"
+
+       << "   -c <algo>       Congestion control: none, reno, newreno, cubic  none\n\n"
+
        << "   -d <tundev>     Connect to tun <tundev>                         " << TUN_DFLT << "\n\n"
 
        << "   -Lu <loss>      Set uplink loss to <rate> (float in 0..1)       (no loss)\n"
@@ -91,11 +102,53 @@ tuple<TCPConfig, FdAdapterConfig, bool, const char*> get_config( const span<char
       c_fsm.recv_capacity = strtol( args[curr + 1], nullptr, 0 );
       curr += 2;
 
+    } else if ( strncmp( "-A", args[curr], 3 ) == 0 ) {
+      c_fsm.recv_autotune = true;
+      curr += 1;
+
     } else if ( strncmp( "-t", args[curr], 3 ) == 0 ) {
       check_argc( args, curr, "ERROR: -t requires one argument." );
       c_fsm.rt_timeout = strtol( args[curr + 1], nullptr, 0 );
       curr += 2;
 
+    } else if ( strncmp( "-m", args[curr], 3 ) == 0 ) {
+      check_argc( args, curr, "ERROR: -m requires one argument." );
+      c_fsm.mss = strtol( args[curr + 1], nullptr, 0 );
+      curr += 2;
+
+    } else if ( strncmp( "-P", args[curr], 3 ) == 0 ) {
+      c_fsm.path_mtu_discovery = true;
+      curr += 1;
+
+    } else if ( strncmp( "-N", args[curr], 3 ) == 0 ) {
+      c_fsm.nagle = true;
+      curr += 1;
+
+    } else if ( strncmp( "-D", args[curr], 3 ) == 0 ) {
+      c_fsm.delayed_ack = true;
+      curr += 1;
+
+    } else if ( strncmp( "-p", args[curr], 3 ) == 0 ) {
+      c_fsm.pacing = true;
+      curr += 1;
+
+    } else if ( strncmp( "-c", args[curr], 3 ) == 0 ) {
+      check_argc( args, curr, "ERROR: -c requires one argument." );
+      const string_view algorithm = args[curr + 1];
+      if ( algorithm == "none" ) {
+        c_fsm.congestion_control = CongestionControl::Algorithm::None;
+      } else if ( algorithm == "reno" ) {
+        c_fsm.congestion_control = CongestionControl::Algorithm::Reno;
+      } else if ( algorithm == "newreno" ) {
+        c_fsm.congestion_control = CongestionControl::Algorithm::NewReno;
+      } else if ( algorithm == "cubic" ) {
+        c_fsm.congestion_control = CongestionControl::Algorithm::Cubic;
+      } else {
+        show_usage( args[0], "ERROR: unknown congestion control algorithm." );
+        exit( 1 );
+      }
+      curr += 2;
+
     } else if ( strncmp( "-d", args[curr], 3 ) == 0 ) {
       check_argc( args, curr, "ERROR: -t requires one argument." );
       tundev = args[curr + 1];
@@ -127,6 +180,12 @@ tuple<TCPConfig, FdAdapterConfig, bool, const char*> get_config( const span<char
     }
   }
 
+  // offer window scaling (RFC 7323) if the whole receive window can't be advertised in 16 bits
+  while ( c_fsm.window_scale < TCPReceiverMessage::MAX_WINDOW_SCALE
+          and ( size_t { UINT16_MAX } << c_fsm.window_scale ) < c_fsm.recv_capacity ) {
+    c_fsm.window_scale++;
+  }
+
   // parse positional command-line arguments
   if ( listen ) {
     c_filt.source = { "0", args[curr + 1] };
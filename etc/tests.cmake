@@ -23,6 +23,10 @@ ttest(byte_stream_one_write)
 ttest(byte_stream_two_writes)
 ttest(byte_stream_many_writes)
 ttest(byte_stream_stress_test)
+ttest(byte_stream_ring)
+ttest(byte_stream_spsc)
+ttest(byte_stream_resize)
+ttest(byte_stream_reserve)
 
 ttest(reassembler_single)
 ttest(reassembler_cap)
@@ -31,6 +35,7 @@ ttest(reassembler_dup)
 ttest(reassembler_holes)
 ttest(reassembler_overlapping)
 ttest(reassembler_win)
+ttest(reassembler_bitmap)
 
 ttest(wrapping_integers_cmp)
 ttest(wrapping_integers_wrap)
@@ -45,6 +50,10 @@ ttest(recv_reorder)
 ttest(recv_reorder_more)
 ttest(recv_close)
 ttest(recv_special)
+ttest(recv_sack)
+ttest(recv_window_scale)
+ttest(recv_autotune)
+ttest(recv_batch)
 
 ttest(send_connect)
 ttest(send_transmit)
@@ -53,11 +62,23 @@ ttest(send_window)
 ttest(send_ack)
 ttest(send_close)
 ttest(send_extra)
+ttest(send_congestion)
+ttest(send_rtt)
+ttest(send_fast_retx)
+ttest(send_sack)
+ttest(send_repacketize)
+ttest(send_mss)
+ttest(send_coalesce)
+ttest(send_pacing)
 
 ttest(net_interface)
 
 ttest(router)
 
+ttest(eventloop)
+ttest(tcp_shared_streams)
+ttest(timer_wheel)
+
 add_custom_target (check0 COMMAND ${CMAKE_CTEST_COMMAND} --output-on-failure --stop-on-failure --timeout 12 -R 'webget|^byte_stream_')
 
 add_custom_target (check_webget COMMAND ${CMAKE_CTEST_COMMAND} --output-on-failure --timeout 12 -R 'webget')
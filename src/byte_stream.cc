@@ -1,8 +1,53 @@
 #include "byte_stream.hh"
 
+#include <algorithm>
+#include <stdexcept>
+
 using namespace std;
 
-ByteStream::ByteStream( uint64_t capacity ) : capacity_( capacity ) {}
+ByteStream::ByteStream( uint64_t capacity, Storage storage )
+  : capacity_( capacity ), storage_( storage ), ring_( storage == Storage::Ring ? capacity : 0, '\0' )
+{}
+
+void ByteStream::set_capacity( uint64_t capacity )
+{
+  if ( reserved_len_ != 0 ) {
+    throw runtime_error( "ByteStream::set_capacity() called between Writer::reserve() and commit()" );
+  }
+  capacity = max( capacity, buffered_sum_ );
+
+  if ( storage_ == Storage::Ring && capacity != capacity_ ) {
+    // Lay the buffered bytes out again, each at its stream index modulo the new capacity
+    string ring( capacity, '\0' );
+    uint64_t index = popped_sum_;
+    for ( const auto view : reader().peek_all() ) {
+      for ( uint64_t done = 0; done < view.size(); ) {
+        const uint64_t slot = index % capacity;
+        const uint64_t len = min( view.size() - done, capacity - slot );
+        view.copy( ring.data() + slot, len, done );
+        done += len;
+        index += len;
+      }
+    }
+    ring_ = move( ring );
+  }
+  capacity_ = capacity;
+}
+
+void ByteStream::ring_push( string_view data )
+{
+  if ( closed_ || data.empty() || capacity_ == buffered_sum_ ) {
+    return;
+  }
+  data = data.substr( 0, capacity_ - buffered_sum_ );
+
+  const uint64_t tail = pushed_sum_ % capacity_;
+  const uint64_t first_len = min( data.size(), capacity_ - tail );
+  data.copy( ring_.data() + tail, first_len );
+  data.copy( ring_.data(), data.size() - first_len, first_len );
+  pushed_sum_ += data.size();
+  buffered_sum_ += data.size();
+}
 
 bool Writer::is_closed() const
 {
@@ -13,14 +58,75 @@ bool Writer::is_closed() const
 void Writer::push( string data )
 {
   // Your code here.
+  if ( storage_ == Storage::Ring ) {
+    ring_push( data );
+  } else {
+    push( Buffer { move( data ) } );
+  }
+}
+
+void Writer::push( Buffer data )
+{
+  if ( storage_ == Storage::Ring ) {
+    ring_push( data );
+    return;
+  }
   if ( data.empty() || available_capacity() == 0 || is_closed() )
     return;
   if ( data.size() > available_capacity() ) {
-    data.resize( available_capacity() );
+    data.remove_suffix( data.size() - available_capacity() );
   }
   pushed_sum_ = pushed_sum_ + data.size();
   buffered_sum_ = buffered_sum_ + data.size();
-  stream_q.emplace( move( data ) );
+  stream_q.emplace_back( move( data ) );
+}
+
+vector<span<char>> Writer::reserve( uint64_t max_len )
+{
+  vector<span<char>> regions;
+  reserved_len_ = is_closed() ? 0 : min( max_len, available_capacity() );
+  if ( reserved_len_ == 0 ) {
+    return regions;
+  }
+
+  if ( storage_ == Storage::Ring ) {
+    const uint64_t tail = pushed_sum_ % capacity_;
+    const uint64_t first_len = min( reserved_len_, capacity_ - tail );
+    regions.emplace_back( ring_.data() + tail, first_len );
+    if ( first_len < reserved_len_ ) {
+      regions.emplace_back( ring_.data(), reserved_len_ - first_len );
+    }
+    return regions;
+  }
+
+  reserved_buf_.resize( reserved_len_ );
+  regions.emplace_back( reserved_buf_ );
+  return regions;
+}
+
+void Writer::commit( uint64_t len )
+{
+  if ( len > reserved_len_ ) {
+    throw runtime_error( "Writer::commit() called with more bytes than were reserved" );
+  }
+  reserved_len_ = 0;
+  if ( len == 0 ) {
+    return;
+  }
+
+  pushed_sum_ += len;
+  buffered_sum_ += len;
+  if ( storage_ == Storage::Chunked ) {
+    // A short write is copied out, rather than have its chunk keep the whole reservation alive (e.g. until the
+    // sender's retransmissions are acknowledged); the reservation is kept for the next reserve()
+    if ( len < reserved_buf_.size() / 2 ) {
+      stream_q.emplace_back( reserved_buf_.substr( 0, len ) );
+      return;
+    }
+    reserved_buf_.resize( len );
+    stream_q.emplace_back( move( reserved_buf_ ) );
+    reserved_buf_ = {};
+  }
 }
 
 void Writer::close()
@@ -56,7 +162,41 @@ uint64_t Reader::bytes_popped() const
 string_view Reader::peek() const
 {
   // Your code here.
-  return stream_q.empty() ? string_view {} : string_view { stream_q.front() }.substr( prefix_len_ );
+  if ( storage_ == Storage::Ring ) {
+    if ( buffered_sum_ == 0 ) {
+      return {};
+    }
+    const uint64_t head = popped_sum_ % capacity_;
+    return string_view { ring_ }.substr( head, min( buffered_sum_, capacity_ - head ) );
+  }
+  return stream_q.empty() ? string_view {} : stream_q.front().view();
+}
+
+vector<string_view> Reader::peek_all( uint64_t max_len ) const
+{
+  vector<string_view> views;
+  uint64_t remaining = min( max_len, buffered_sum_ );
+  if ( remaining == 0 ) {
+    return views;
+  }
+
+  if ( storage_ == Storage::Ring ) {
+    views.push_back( peek().substr( 0, remaining ) );
+    remaining -= views.back().size();
+    if ( remaining != 0 ) {
+      views.push_back( string_view { ring_ }.substr( 0, remaining ) );
+    }
+    return views;
+  }
+
+  for ( const auto& chunk : stream_q ) {
+    if ( remaining == 0 ) {
+      break;
+    }
+    views.push_back( chunk.view().substr( 0, remaining ) );
+    remaining -= views.back().size();
+  }
+  return views;
 }
 
 void Reader::pop( uint64_t len )
@@ -64,18 +204,42 @@ void Reader::pop( uint64_t len )
   // Your code here.
   buffered_sum_ -= len;
   popped_sum_ += len;
+  if ( storage_ == Storage::Ring ) {
+    return;
+  }
   while ( len != 0 ) {
-    uint64_t size = stream_q.front().size() - prefix_len_;
-    if ( len < size ) {
-      prefix_len_ += len;
+    auto& front = stream_q.front();
+    if ( len < front.size() ) {
+      front.remove_prefix( len );
       break;
     }
-    stream_q.pop();
-    prefix_len_ = 0;
-    len -= size;
+    len -= front.size();
+    stream_q.pop_front();
   }
 }
 
+Buffer Reader::pop_buffer( uint64_t max_len )
+{
+  const uint64_t len = min( max_len, buffered_sum_ );
+  if ( len == 0 ) {
+    return {};
+  }
+
+  if ( storage_ == Storage::Ring ) {
+    string bytes;
+    bytes.reserve( len );
+    for ( const auto view : peek_all( len ) ) {
+      bytes += view;
+    }
+    pop( len );
+    return bytes;
+  }
+
+  Buffer front = stream_q.front().substr( 0, len );
+  pop( front.size() );
+  return front;
+}
+
 uint64_t Reader::bytes_buffered() const
 {
   // Your code here.
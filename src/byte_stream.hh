@@ -1,9 +1,13 @@
 #pragma once
 
+#include "buffer.hh"
+
 #include <cstdint>
-#include <queue>
+#include <deque>
+#include <span>
 #include <string>
 #include <string_view>
+#include <vector>
 
 class Reader;
 class Writer;
@@ -11,7 +15,14 @@ class Writer;
 class ByteStream
 {
 public:
-  explicit ByteStream( uint64_t capacity );
+  // How the buffered bytes are stored: one string per push, or a single preallocated ring of `capacity` bytes
+  enum class Storage
+  {
+    Chunked,
+    Ring
+  };
+
+  explicit ByteStream( uint64_t capacity, Storage storage = Storage::Chunked );
 
   // Helper functions (provided) to access the ByteStream's Reader and Writer interfaces
   Reader& reader();
@@ -22,25 +33,41 @@ public:
   void set_error() { error_ = true; };       // Signal that the stream suffered an error.
   bool has_error() const { return error_; }; // Has the stream had an error?
 
+  // Grow or shrink the buffer, though never below the bytes it holds (not between reserve() and commit())
+  void set_capacity( uint64_t capacity );
+  uint64_t capacity() const { return capacity_; }
+
 protected:
   // Please add any additional state to the ByteStream here, and not to the Writer and Reader interfaces.
   uint64_t capacity_;
   uint64_t pushed_sum_ {};
   uint64_t popped_sum_ {};
   uint64_t buffered_sum_ {};
-  uint64_t prefix_len_ {};
   bool error_ {};
   bool closed_ {};
+  Storage storage_ {};
 
-  std::queue<std::string> stream_q {};
+  std::deque<Buffer> stream_q {}; // Storage::Chunked: pushed slices, shared with the writer (not copied)
+  std::string ring_ {};           // only allocated for Storage::Ring
+
+  uint64_t reserved_len_ {};   // size of the region handed out by the last Writer::reserve()
+  std::string reserved_buf_ {}; // Storage::Chunked: becomes the next chunk on commit() (if mostly filled)
+
+  void ring_push( std::string_view data ); // Storage::Ring: copy as much of `data` as fits into the ring
 };
 
 class Writer : public ByteStream
 {
 public:
   void push( std::string data ); // Push data to stream, but only as much as available capacity allows.
+  void push( Buffer data );      // Same, but Storage::Chunked keeps a reference instead of a copy.
   void close();                  // Signal that the stream has reached its ending. Nothing more will be written.
 
+  // Borrow writable storage for up to `max_len` bytes (Ring storage: up to two regions, no allocation).
+  // Fill a prefix of it, then call commit() with the number of bytes written to make them readable.
+  std::vector<std::span<char>> reserve( uint64_t max_len = UINT64_MAX );
+  void commit( uint64_t len );
+
   bool is_closed() const;              // Has the stream been closed?
   uint64_t available_capacity() const; // How many bytes can be pushed to the stream right now?
   uint64_t bytes_pushed() const;       // Total number of bytes cumulatively pushed to the stream
@@ -49,8 +76,13 @@ public:
 class Reader : public ByteStream
 {
 public:
-  std::string_view peek() const; // Peek at the next bytes in the buffer
+  std::string_view peek() const; // Peek at the next bytes in the buffer (Ring: up to the wrap point)
+  // Peek at up to `max_len` buffered bytes as views in stream order (Ring storage: at most two views)
+  std::vector<std::string_view> peek_all( uint64_t max_len = UINT64_MAX ) const;
   void pop( uint64_t len );      // Remove `len` bytes from the buffer
+  // Remove and return up to `max_len` of the next bytes. Storage::Chunked hands over (a slice of) the front
+  // chunk without copying, so it may return fewer; Storage::Ring copies them out.
+  Buffer pop_buffer( uint64_t max_len = UINT64_MAX );
 
   bool is_finished() const;        // Is the stream finished (closed and fully popped)?
   uint64_t bytes_buffered() const; // Number of bytes currently buffered (pushed and not popped)
@@ -0,0 +1,138 @@
+#include "congestion_control.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+unique_ptr<CongestionControl> CongestionControl::make( Algorithm algorithm, uint64_t mss )
+{
+  switch ( algorithm ) {
+    case Algorithm::None:
+      return make_unique<UnlimitedCongestionControl>( mss );
+    case Algorithm::Reno:
+      return make_unique<RenoCongestionControl>( mss );
+    case Algorithm::NewReno:
+      return make_unique<NewRenoCongestionControl>( mss );
+    case Algorithm::Cubic:
+      return make_unique<CubicCongestionControl>( mss );
+  }
+  throw runtime_error( "unknown congestion control algorithm" );
+}
+
+uint64_t CongestionControl::pacing_rate( uint64_t srtt_ms ) const
+{
+  if ( srtt_ms == 0 ) {
+    return 0;
+  }
+
+  // Like Linux, pace ahead of the window: twice as fast in slow start (so the window can double),
+  // and a quarter faster in congestion avoidance
+  const double gain = in_slow_start() ? 2.0 : 1.25;
+  return static_cast<uint64_t>( gain * static_cast<double>( cwnd() ) * 1000.0 / static_cast<double>( srtt_ms ) );
+}
+
+// The initial window of RFC 6928
+static uint64_t initial_window( uint64_t mss )
+{
+  return min( 10 * mss, max<uint64_t>( 2 * mss, 14600 ) );
+}
+
+RenoCongestionControl::RenoCongestionControl( uint64_t mss )
+  : CongestionControl( mss ), cwnd_( initial_window( mss ) )
+{}
+
+void RenoCongestionControl::on_ack( uint64_t acked_bytes, uint64_t /* now_ms */ )
+{
+  if ( in_slow_start() ) {
+    cwnd_ += acked_bytes;
+    return;
+  }
+
+  // Congestion avoidance: one more MSS for each window's worth of acknowledged bytes
+  bytes_acked_ += acked_bytes;
+  if ( bytes_acked_ >= cwnd_ ) {
+    bytes_acked_ -= cwnd_;
+    cwnd_ += mss_;
+  }
+}
+
+void RenoCongestionControl::on_loss( uint64_t bytes_in_flight, uint64_t /* now_ms */ )
+{
+  ssthresh_ = max( bytes_in_flight / 2, 2 * mss_ );
+  cwnd_ = ssthresh_;
+  bytes_acked_ = 0;
+}
+
+void RenoCongestionControl::on_timeout( uint64_t bytes_in_flight, uint64_t /* now_ms */ )
+{
+  ssthresh_ = max( bytes_in_flight / 2, 2 * mss_ );
+  cwnd_ = mss_;
+  bytes_acked_ = 0;
+}
+
+CubicCongestionControl::CubicCongestionControl( uint64_t mss )
+  : CongestionControl( mss ), cwnd_( initial_window( mss ) )
+{}
+
+void CubicCongestionControl::on_ack( uint64_t acked_bytes, uint64_t now_ms )
+{
+  if ( in_slow_start() ) {
+    cwnd_ += acked_bytes;
+    return;
+  }
+
+  const double window = static_cast<double>( cwnd_ ) / static_cast<double>( mss_ );
+  if ( not epoch_started_ ) {
+    epoch_started_ = true;
+    epoch_start_ms_ = now_ms;
+    if ( window < w_max_ ) {
+      k_ = cbrt( ( w_max_ - window ) / C );
+    } else {
+      k_ = 0;
+      w_max_ = window;
+    }
+    w_est_ = window;
+  }
+
+  // The cubic target, but no less than Reno would reach and no more than 1.5x the current window
+  const double t = static_cast<double>( now_ms - epoch_start_ms_ ) / 1000.0;
+  w_est_ += 3 * ( 1 - BETA ) / ( 1 + BETA ) * static_cast<double>( acked_bytes ) / static_cast<double>( cwnd_ );
+  const double target = min( max( C * pow( t - k_, 3 ) + w_max_, w_est_ ), 1.5 * window );
+
+  // Grow by (target - window) / window MSS per MSS acknowledged; when at or above the target, grow very slowly
+  if ( target > window ) {
+    growth_ += ( target - window ) / window * static_cast<double>( acked_bytes );
+  } else {
+    growth_ += static_cast<double>( acked_bytes ) / ( 100 * window );
+  }
+  const double whole_bytes = floor( growth_ );
+  cwnd_ += static_cast<uint64_t>( whole_bytes );
+  growth_ -= whole_bytes;
+}
+
+void CubicCongestionControl::reduce( uint64_t /* now_ms */ )
+{
+  const double window = static_cast<double>( cwnd_ ) / static_cast<double>( mss_ );
+
+  // Fast convergence: if the window didn't regrow to the last maximum, release bandwidth to newer flows
+  w_max_ = window < w_last_max_ ? window * ( 1 + BETA ) / 2 : window;
+  w_last_max_ = window;
+
+  ssthresh_ = max( static_cast<uint64_t>( static_cast<double>( cwnd_ ) * BETA ), 2 * mss_ );
+  epoch_started_ = false;
+  growth_ = 0;
+}
+
+void CubicCongestionControl::on_loss( uint64_t /* bytes_in_flight */, uint64_t now_ms )
+{
+  reduce( now_ms );
+  cwnd_ = ssthresh_;
+}
+
+void CubicCongestionControl::on_timeout( uint64_t /* bytes_in_flight */, uint64_t now_ms )
+{
+  reduce( now_ms );
+  cwnd_ = mss_;
+}
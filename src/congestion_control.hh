@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+// A congestion-control algorithm for the TCPSender. The sender reports what happens to the bytes
+// it sends (acknowledged, lost, or timed out), and the algorithm decides how many bytes may be
+// in flight (the congestion window) and how fast they should go out.
+// All sizes are in sequence numbers (bytes), and all times are in milliseconds of the sender's clock.
+class CongestionControl
+{
+public:
+  enum class Algorithm
+  {
+    None,    // no congestion window: only the receiver's window limits the sender
+    Reno,    // RFC 5681 slow start and congestion avoidance
+    NewReno, // Reno, staying in fast recovery until all the data outstanding at the loss is acknowledged
+    Cubic,   // RFC 9438 cubic window growth
+  };
+
+  static std::unique_ptr<CongestionControl> make( Algorithm algorithm, uint64_t mss );
+
+  explicit CongestionControl( uint64_t mss ) : mss_( mss ) {}
+  virtual ~CongestionControl() = default;
+
+  // New bytes were cumulatively acknowledged
+  virtual void on_ack( uint64_t acked_bytes, uint64_t now_ms ) = 0;
+
+  // A loss was detected without a timeout (e.g. by duplicate ACKs), with `bytes_in_flight` outstanding
+  virtual void on_loss( uint64_t bytes_in_flight, uint64_t now_ms ) = 0;
+
+  // The retransmission timer expired, with `bytes_in_flight` outstanding
+  virtual void on_timeout( uint64_t bytes_in_flight, uint64_t now_ms ) = 0;
+
+  virtual uint64_t cwnd() const = 0;         // How many bytes may be in flight?
+  virtual uint64_t ssthresh() const = 0;     // The slow start threshold
+  virtual std::string_view name() const = 0; // e.g. "reno"
+
+  // Should three duplicate ACKs trigger a fast retransmit and fast recovery?
+  virtual bool fast_retransmit() const { return true; }
+
+  // Does fast recovery last until everything outstanding at the loss is acknowledged (retransmitting at
+  // each partial ACK, as NewReno does), rather than ending at the first ACK of new data (as Reno does)?
+  virtual bool recovers_partial_acks() const { return true; }
+
+  // The rate (in bytes per second) to spread a window over one round trip of `srtt_ms`,
+  // or 0 if sending should not be paced
+  virtual uint64_t pacing_rate( uint64_t srtt_ms ) const;
+
+  bool in_slow_start() const { return cwnd() < ssthresh(); }
+  uint64_t mss() const { return mss_; }
+  void set_mss( uint64_t mss ) { mss_ = mss; }
+
+protected:
+  uint64_t mss_;
+};
+
+// Only the receiver's window limits the sender
+class UnlimitedCongestionControl : public CongestionControl
+{
+public:
+  using CongestionControl::CongestionControl;
+
+  void on_ack( uint64_t /* acked_bytes */, uint64_t /* now_ms */ ) override {}
+  void on_loss( uint64_t /* bytes_in_flight */, uint64_t /* now_ms */ ) override {}
+  void on_timeout( uint64_t /* bytes_in_flight */, uint64_t /* now_ms */ ) override {}
+
+  uint64_t cwnd() const override { return UINT64_MAX; }
+  uint64_t ssthresh() const override { return UINT64_MAX; }
+  std::string_view name() const override { return "none"; }
+  uint64_t pacing_rate( uint64_t /* srtt_ms */ ) const override { return 0; }
+  bool fast_retransmit() const override { return false; } // only the retransmission timer repairs losses
+};
+
+// Slow start, additive increase, and multiplicative decrease (RFC 5681)
+class RenoCongestionControl : public CongestionControl
+{
+public:
+  explicit RenoCongestionControl( uint64_t mss );
+
+  void on_ack( uint64_t acked_bytes, uint64_t now_ms ) override;
+  void on_loss( uint64_t bytes_in_flight, uint64_t now_ms ) override;
+  void on_timeout( uint64_t bytes_in_flight, uint64_t now_ms ) override;
+
+  uint64_t cwnd() const override { return cwnd_; }
+  uint64_t ssthresh() const override { return ssthresh_; }
+  std::string_view name() const override { return "reno"; }
+  bool recovers_partial_acks() const override { return false; }
+
+protected:
+  uint64_t cwnd_;
+  uint64_t ssthresh_ { UINT64_MAX };
+  uint64_t bytes_acked_ {}; // acknowledged since the window last grew in congestion avoidance
+};
+
+class NewRenoCongestionControl : public RenoCongestionControl
+{
+public:
+  using RenoCongestionControl::RenoCongestionControl;
+
+  std::string_view name() const override { return "newreno"; }
+  bool recovers_partial_acks() const override { return true; }
+};
+
+// Window growth as a cubic function of the time since the last loss (RFC 9438)
+class CubicCongestionControl : public CongestionControl
+{
+public:
+  explicit CubicCongestionControl( uint64_t mss );
+
+  void on_ack( uint64_t acked_bytes, uint64_t now_ms ) override;
+  void on_loss( uint64_t bytes_in_flight, uint64_t now_ms ) override;
+  void on_timeout( uint64_t bytes_in_flight, uint64_t now_ms ) override;
+
+  uint64_t cwnd() const override { return cwnd_; }
+  uint64_t ssthresh() const override { return ssthresh_; }
+  std::string_view name() const override { return "cubic"; }
+
+private:
+  static constexpr double C = 0.4;    // scaling constant, in MSS per second cubed
+  static constexpr double BETA = 0.7; // multiplicative decrease factor
+
+  uint64_t cwnd_;
+  uint64_t ssthresh_ { UINT64_MAX };
+
+  // The current congestion-avoidance epoch (all windows in MSS)
+  bool epoch_started_ {};
+  uint64_t epoch_start_ms_ {};
+  double w_max_ {};      // window just before the last reduction
+  double w_last_max_ {}; // w_max_ before that, for fast convergence
+  double k_ {};          // seconds from the epoch start until the window regrows to w_max_
+  double w_est_ {};      // what Reno would have reached by now, as a floor on the cubic window
+  double growth_ {};     // fractional bytes of window growth not yet applied
+
+  void reduce( uint64_t now_ms );
+};
@@ -1,10 +1,130 @@
 #include "reassembler.hh"
 
 #include <algorithm>
+#include <bit>
 #include <ranges>
 
 using namespace std;
 
+// Mask selecting bits [lo, hi) of a 64-bit word
+static uint64_t word_mask( uint64_t lo, uint64_t hi )
+{
+  const uint64_t below_hi = hi == 64 ? ~uint64_t {} : ( uint64_t { 1 } << hi ) - 1;
+  return below_hi & ~( ( uint64_t { 1 } << lo ) - 1 );
+}
+
+Reassembler::Reassembler( ByteStream&& output, Engine engine ) : output_( std::move( output ) ), engine_( engine )
+{
+  if ( engine_ == Engine::Bitmap ) {
+    window_capacity_ = writer().available_capacity() + reader().bytes_buffered();
+    window_.resize( window_capacity_ );
+    present_.resize( ( window_capacity_ + 63 ) / 64 );
+  }
+}
+
+void Reassembler::set_capacity( uint64_t capacity )
+{
+  const auto intervals = pending_intervals();
+  const uint64_t pending_reach = intervals.empty() ? 0 : intervals.back().second - writer().bytes_pushed();
+  capacity = max( capacity, reader().bytes_buffered() + pending_reach );
+
+  if ( engine_ == Engine::Bitmap && capacity != window_capacity_ ) {
+    // Lay the pending bytes out again, each at its stream index modulo the new capacity
+    vector<pair<uint64_t, string>> held;
+    for ( const auto& [begin, end] : intervals ) {
+      string bytes;
+      bytes.reserve( end - begin );
+      for ( uint64_t index = begin; index < end; ) {
+        const uint64_t slot = index % window_capacity_;
+        const uint64_t len = min( end - index, window_capacity_ - slot );
+        bytes.append( window_, slot, len );
+        index += len;
+      }
+      held.emplace_back( begin, move( bytes ) );
+    }
+
+    window_capacity_ = capacity;
+    window_.assign( capacity, '\0' );
+    present_.assign( ( capacity + 63 ) / 64, 0 );
+    pending_num = 0;
+    for ( const auto& [begin, bytes] : held ) {
+      window_insert( begin, bytes );
+    }
+  }
+  output_.set_capacity( capacity );
+}
+
+uint64_t Reassembler::set_present( uint64_t begin, uint64_t end, bool present )
+{
+  uint64_t changed = 0;
+  while ( begin < end ) {
+    const uint64_t lo = begin % 64;
+    const uint64_t hi = min<uint64_t>( 64, lo + end - begin );
+    const uint64_t mask = word_mask( lo, hi );
+    auto& word = present_[begin / 64];
+    changed += popcount( present ? mask & ~word : mask & word );
+    word = present ? word | mask : word & ~mask;
+    begin += hi - lo;
+  }
+  return changed;
+}
+
+uint64_t Reassembler::count_present( uint64_t begin, uint64_t end, bool present ) const
+{
+  uint64_t run = 0;
+  while ( begin < end ) {
+    const uint64_t lo = begin % 64;
+    const uint64_t span = min( 64 - lo, end - begin );
+    const uint64_t word = present ? present_[begin / 64] : ~present_[begin / 64];
+    const uint64_t ones = countr_one( word >> lo );
+    if ( ones < span ) {
+      return run + ones;
+    }
+    run += span;
+    begin += span;
+  }
+  return run;
+}
+
+void Reassembler::window_insert( uint64_t first_index, string_view data )
+{
+  const uint64_t start = first_index % window_capacity_;
+  const uint64_t first_len = min( data.size(), window_capacity_ - start );
+  data.copy( window_.data() + start, first_len );
+  data.copy( window_.data(), data.size() - first_len, first_len );
+  pending_num += set_present( start, start + first_len, true );
+  pending_num += set_present( 0, data.size() - first_len, true );
+}
+
+void Reassembler::window_flush()
+{
+  const uint64_t start = writer().bytes_pushed() % window_capacity_;
+  uint64_t ready = count_present( start, window_capacity_ );
+  if ( ready == window_capacity_ - start ) {
+    ready += count_present( 0, start );
+  }
+  if ( ready == 0 ) {
+    return;
+  }
+
+  const uint64_t first_len = min( ready, window_capacity_ - start );
+  set_present( start, start + first_len, false );
+  set_present( 0, ready - first_len, false );
+  pending_num -= ready;
+
+  Writer& out = output_.writer();
+  uint64_t source = start;
+  for ( const auto region : out.reserve( ready ) ) {
+    for ( uint64_t done = 0; done < region.size(); ) {
+      const uint64_t len = min( region.size() - done, window_capacity_ - source );
+      copy_n( window_.data() + source, len, region.data() + done );
+      done += len;
+      source = ( source + len ) % window_capacity_;
+    }
+  }
+  out.commit( ready );
+}
+
 auto Reassembler::split( uint64_t position )
 {
   auto lowerBoundIt = databuf.lower_bound( position );
@@ -18,47 +138,70 @@ auto Reassembler::split( uint64_t position )
   if ( previousIt->first + previousIt->second.size() > position ) {
     auto newEntry
       = databuf.emplace_hint( lowerBoundIt, position, previousIt->second.substr( position - previousIt->first ) );
-    previousIt->second.resize( position - previousIt->first );
+    previousIt->second.remove_suffix( previousIt->first + previousIt->second.size() - position );
     return newEntry;
   }
   return lowerBoundIt;
 }
 
-void Reassembler::insert( uint64_t first_index, string data, bool is_last_substring )
+void Reassembler::insert( uint64_t first_index, Buffer data, bool is_last_substring )
+{
+  store( first_index, move( data ), is_last_substring );
+  flush();
+}
+
+void Reassembler::insert_batch( span<Segment> segments )
+{
+  for ( auto& [first_index, data, is_last_substring] : segments ) {
+    store( first_index, move( data ), is_last_substring );
+  }
+  flush();
+}
+
+void Reassembler::store( uint64_t first_index, Buffer data, bool is_last_substring )
 {
   if ( data.empty() ) {
     if ( !end_pos.has_value() && is_last_substring ) {
       end_pos.emplace( first_index );
     }
-    if ( end_pos.has_value() && end_pos.value() == writer().bytes_pushed() ) {
-      output_.writer().close();
-    }
     return;
   }
 
-  if ( writer().is_closed() || writer().available_capacity() == 0U ) {
+  if ( writer().is_closed() ) {
     return;
   }
 
   uint64_t pushedBytes = writer().bytes_pushed();
   uint64_t capacityLimit = pushedBytes + writer().available_capacity();
 
-  if ( first_index + data.size() <= pushedBytes || first_index >= capacityLimit ) {
+  // The end is known once the last substring fits, even if all of its bytes have arrived before
+  if ( !end_pos.has_value() && is_last_substring && first_index + data.size() <= capacityLimit ) {
+    end_pos.emplace( first_index + data.size() );
+  }
+
+  if ( writer().available_capacity() == 0U || first_index + data.size() <= pushedBytes
+       || first_index >= capacityLimit ) {
     return;
   }
 
   if ( first_index + data.size() > capacityLimit ) {
-    data.resize( capacityLimit - first_index );
-    is_last_substring = false;
+    data.remove_suffix( first_index + data.size() - capacityLimit );
   }
 
   if ( first_index < pushedBytes ) {
-    data.erase( 0, pushedBytes - first_index );
+    data.remove_prefix( pushedBytes - first_index );
     first_index = pushedBytes;
   }
 
-  if ( !end_pos.has_value() && is_last_substring ) {
-    end_pos.emplace( first_index + data.size() );
+  // Fast path: the next expected bytes, with nothing else pending, go straight to the stream
+  if ( first_index == pushedBytes && pending_num == 0 ) {
+    output_.writer().push( move( data ) );
+    return;
+  }
+
+  if ( engine_ == Engine::Bitmap ) {
+    window_insert( first_index, data );
+    return;
   }
 
   auto upperBound = split( first_index + data.size() );
@@ -68,6 +211,13 @@ void Reassembler::insert( uint64_t first_index, string data, bool is_last_substr
   }
   pending_num += data.size();
   databuf.emplace_hint( databuf.erase( lowerBound, upperBound ), first_index, move( data ) );
+}
+
+void Reassembler::flush()
+{
+  if ( engine_ == Engine::Bitmap && pending_num != 0 ) {
+    window_flush();
+  }
 
   while ( !databuf.empty() ) {
     auto& [index, payload] = *databuf.begin();
@@ -88,4 +238,37 @@ void Reassembler::insert( uint64_t first_index, string data, bool is_last_substr
 uint64_t Reassembler::bytes_pending() const
 {
   return pending_num;
+}
+
+vector<pair<uint64_t, uint64_t>> Reassembler::pending_intervals() const
+{
+  vector<pair<uint64_t, uint64_t>> intervals;
+  const auto add = [&]( uint64_t begin, uint64_t end ) {
+    if ( !intervals.empty() && intervals.back().second == begin ) {
+      intervals.back().second = end;
+    } else {
+      intervals.emplace_back( begin, end );
+    }
+  };
+
+  if ( engine_ == Engine::Map ) {
+    for ( const auto& [index, data] : databuf ) {
+      add( index, index + data.size() );
+    }
+    return intervals;
+  }
+
+  // Walk the window from the next expected byte, a run of held or missing bytes at a time,
+  // until every pending byte has been found
+  uint64_t unfound = pending_num;
+  for ( uint64_t index = writer().bytes_pushed(); unfound != 0; ) {
+    const uint64_t slot = index % window_capacity_;
+    const uint64_t held = count_present( slot, window_capacity_ );
+    if ( held != 0 ) {
+      add( index, index + held );
+      unfound -= held;
+    }
+    index += held + count_present( slot + held, window_capacity_, false );
+  }
+  return intervals;
 }
\ No newline at end of file
@@ -1,16 +1,30 @@
 #pragma once
 
+#include "buffer.hh"
 #include "byte_stream.hh"
 
 #include <cstdint>
 #include <map>
 #include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 class Reassembler
 {
 public:
+  // How pending bytes are stored: as a map of (possibly split) segments, or in a preallocated ring the size
+  // of the stream's capacity with a bitmap of which bytes are present (each byte is copied in exactly once).
+  enum class Engine
+  {
+    Map,
+    Bitmap
+  };
+
   // Construct Reassembler to write into given ByteStream.
-  explicit Reassembler( ByteStream&& output ) : output_( std::move( output ) ) {}
+  explicit Reassembler( ByteStream&& output, Engine engine = Engine::Map );
 
   /*
    * Insert a new substring to be reassembled into a ByteStream.
@@ -31,12 +45,34 @@ public:
    * (i.e., bytes that couldn't be written even if earlier gaps get filled in).
    *
    * The Reassembler should close the stream after writing the last byte.
+   *
+   * `data` is a refcounted slice: trimming and splitting it only adjusts offsets, and the stored
+   * pieces are handed to the ByteStream without copying their bytes.
    */
-  void insert( uint64_t first_index, std::string data, bool is_last_substring );
+  void insert( uint64_t first_index, Buffer data, bool is_last_substring );
+
+  // One substring for insert_batch()
+  struct Segment
+  {
+    uint64_t first_index {};
+    Buffer data {};
+    bool is_last_substring {};
+  };
+
+  // Insert a burst of substrings (moving from their data), writing to the ByteStream once at the end
+  void insert_batch( std::span<Segment> segments );
+
+  // Grow or shrink the output stream's capacity (and so the window), though never so far as to drop
+  // any bytes that are buffered in the stream or pending here
+  void set_capacity( uint64_t capacity );
 
   // How many bytes are stored in the Reassembler itself?
   uint64_t bytes_pending() const;
 
+  // The ranges [begin, end) of stream indices stored in the Reassembler, in ascending order and merged
+  // where they touch (the gaps between them are what the stream is still missing)
+  std::vector<std::pair<uint64_t, uint64_t>> pending_intervals() const;
+
   // Access output stream reader
   Reader& reader() { return output_.reader(); }
   const Reader& reader() const { return output_.reader(); }
@@ -47,8 +83,20 @@ public:
 private:
   ByteStream output_; // the Reassembler writes to this ByteStream
 
-  std::map<uint64_t, std::string> databuf {}; // 存储还没有写入的数据段
-  std::optional<uint64_t> end_pos {};         // 存储流的结束位置
-  uint64_t pending_num {};                    // 缓冲中尚未写入的字节数
+  std::map<uint64_t, Buffer> databuf {}; // 存储还没有写入的数据段
+  std::optional<uint64_t> end_pos {};    // 存储流的结束位置
+  uint64_t pending_num {};               // 缓冲中尚未写入的字节数
   auto split( uint64_t pos );
-};
\ No newline at end of file
+  void store( uint64_t first_index, Buffer data, bool is_last_substring ); // trim to the window and hold
+  void flush(); // write any bytes that are now contiguous with the stream, and close it at the end
+
+  Engine engine_;
+  uint64_t window_capacity_ {};      // Engine::Bitmap: the output stream's capacity
+  std::string window_ {};            // Engine::Bitmap: pending byte with stream index i is at i % window_capacity_
+  std::vector<uint64_t> present_ {}; // Engine::Bitmap: one bit per window_ byte, set if that byte is pending
+
+  void window_insert( uint64_t first_index, std::string_view data );
+  void window_flush();
+  uint64_t set_present( uint64_t begin, uint64_t end, bool present );                // how many bits changed
+  uint64_t count_present( uint64_t begin, uint64_t end, bool present = true ) const; // run of such bits at `begin`
+};
@@ -1,7 +1,9 @@
 #include "tcp_receiver.hh"
 #include "wrapping_integers.hh"
 
+#include <algorithm>
 #include <cstdint>
+#include <utility>
 
 using namespace std;
 
@@ -13,31 +15,168 @@ void TCPReceiver::receive( TCPSenderMessage message )
     reader().set_error();
     return;
   }
+  const auto index_in_stream = stream_index( message );
+  if ( !index_in_stream.has_value() ) {
+    return;
+  }
+
+  latest_stream_index_ = *index_in_stream;
+  reassembler_.insert( *index_in_stream, move( message.payload ), message.FIN );
+}
+
+void TCPReceiver::receive_batch( span<TCPSenderMessage> messages )
+{
+  if ( writer().has_error() )
+    return;
+
+  batch_.clear();
+  bool reset = false;
+  for ( auto& message : messages ) {
+    if ( message.RST ) {
+      reset = true;
+      break;
+    }
+    const auto index_in_stream = stream_index( message );
+    if ( index_in_stream.has_value() ) {
+      latest_stream_index_ = *index_in_stream;
+      batch_.push_back( { *index_in_stream, move( message.payload ), message.FIN } );
+    }
+  }
+
+  reassembler_.insert_batch( batch_ );
+  batch_.clear();
+  if ( reset ) {
+    reader().set_error();
+  }
+}
+
+optional<uint64_t> TCPReceiver::stream_index( const TCPSenderMessage& message )
+{
   if ( !base_seqno_.has_value() ) {
     if ( !message.SYN ) {
-      return;
+      return nullopt;
     }
     base_seqno_ = message.seqno;
+    sack_permitted_ = message.SACK_permitted;
+    window_scaled_ = message.window_scale.has_value();
   }
   uint64_t expected_seq = writer().bytes_pushed() + 1;
   uint64_t absolute_seq = message.seqno.unwrap( *base_seqno_, expected_seq );
-  uint64_t index_in_stream = absolute_seq + ( message.SYN ? 1 : 0 ) - 1;
-
-  reassembler_.insert( index_in_stream, move( message.payload ), message.FIN );
+  return absolute_seq + ( message.SYN ? 1 : 0 ) - 1;
 }
 
 TCPReceiverMessage TCPReceiver::send() const
 {
-  uint16_t window;
-  if ( writer().available_capacity() > UINT16_MAX )
-    window = UINT16_MAX;
-  else
-    window = static_cast<uint16_t>( writer().available_capacity() );
+  // With window scaling, the window is sent in units of 2^shift bytes: round it down to one
+  const uint8_t shift = window_scaled_ ? window_scale_ : 0;
+  const uint64_t max_window = uint64_t { UINT16_MAX } << shift;
+  const auto window = static_cast<uint32_t>( min( writer().available_capacity(), max_window ) >> shift << shift );
 
   if ( base_seqno_.has_value() ) {
     const uint64_t ack_seq = writer().bytes_pushed() + 1 + ( writer().is_closed() ? 1 : 0 );
-    return { Wrap32::wrap( ack_seq, *base_seqno_ ), window, writer().has_error() };
+    return { Wrap32::wrap( ack_seq, *base_seqno_ ), window, writer().has_error(), sack_blocks() };
+  }
+
+  return { nullopt, window, writer().has_error(), {} };
+}
+
+vector<TCPReceiverMessage::SACKBlock> TCPReceiver::sack_blocks() const
+{
+  if ( !sack_permitted_ || reassembler_.bytes_pending() == 0 ) {
+    return {};
   }
 
-  return { nullopt, window, writer().has_error() };
+  // Stream index i is absolute sequence number i + 1 (after the SYN)
+  const auto to_block = [&]( const pair<uint64_t, uint64_t>& interval ) {
+    return TCPReceiverMessage::SACKBlock { Wrap32::wrap( interval.first + 1, *base_seqno_ ),
+                                           Wrap32::wrap( interval.second + 1, *base_seqno_ ) };
+  };
+
+  // RFC 2018: the first block reports the most recent arrival, so the sender learns of every new one
+  // even when there are more holes than blocks. The rest follow in order from the ackno.
+  const auto intervals = reassembler_.pending_intervals();
+  const auto latest = find_if( intervals.begin(), intervals.end(), [&]( const auto& interval ) {
+    return interval.first <= latest_stream_index_ && latest_stream_index_ < interval.second;
+  } );
+
+  vector<TCPReceiverMessage::SACKBlock> blocks;
+  if ( latest != intervals.end() ) {
+    blocks.push_back( to_block( *latest ) );
+  }
+  for ( auto it = intervals.begin(); it != intervals.end(); ++it ) {
+    if ( blocks.size() == TCPReceiverMessage::MAX_SACK_BLOCKS ) {
+      break;
+    }
+    if ( it != latest ) {
+      blocks.push_back( to_block( *it ) );
+    }
+  }
+  return blocks;
+}
+
+void ReceiveBufferTuner::update( TCPReceiver& receiver,
+                                 uint64_t now_ms,
+                                 bool data_arrived,
+                                 uint64_t advertised_edge )
+{
+  const uint64_t received = receiver.writer().bytes_pushed();
+  if ( data_arrived ) {
+    last_data_ms_ = now_ms;
+  }
+  held_edge_ = max( held_edge_, advertised_edge );
+
+  // Time how long it takes for a window's worth of data to arrive
+  if ( rtt_probe_edge_.has_value() && received >= rtt_probe_edge_.value() ) {
+    const uint64_t sample = max<uint64_t>( now_ms - rtt_probe_start_ms_, 1 );
+    if ( !rtt_ms_.has_value() ) {
+      round_start_ms_ = now_ms; // start measuring the reader
+      round_start_popped_ = receiver.reader().bytes_popped();
+    }
+    if ( !rtt_ms_.has_value() || sample < rtt_ms_.value() ) {
+      rtt_ms_ = sample;
+    } else {
+      rtt_ms_ = rtt_ms_.value() + ( sample - rtt_ms_.value() ) / 8;
+    }
+    rtt_probe_edge_.reset();
+  }
+  // Once a round trip, make room for twice what the application read during it
+  if ( rtt_ms_.has_value() && now_ms - round_start_ms_ >= rtt_ms_.value() ) {
+    const uint64_t popped = receiver.reader().bytes_popped();
+    const uint64_t wanted = min( 2 * ( popped - round_start_popped_ ), max_capacity_ );
+    if ( wanted > receiver.capacity() ) {
+      receiver.set_capacity( wanted );
+      shrinking_ = false;
+    }
+    round_start_ms_ = now_ms;
+    round_start_popped_ = popped;
+  }
+
+  // Give the memory back once the connection has gone idle. The peer may still send up to the edge it was
+  // offered, so stop extending the window, and shrink the buffer only as that edge is used up (as Linux's
+  // tcp_select_window() does): its capacity must reach from the bytes read so far to the edge.
+  const bool idle = now_ms - last_data_ms_ >= idle_ms_ && receiver.reader().bytes_buffered() == 0
+                    && receiver.reassembler().bytes_pending() == 0;
+  if ( idle && receiver.capacity() > initial_capacity_ ) {
+    shrinking_ = true;
+    rtt_probe_edge_.reset();
+  }
+  if ( shrinking_ ) {
+    const uint64_t popped = receiver.reader().bytes_popped();
+    const uint64_t needed = max( initial_capacity_, held_edge_ - min( held_edge_, popped ) );
+    if ( needed < receiver.capacity() ) {
+      receiver.set_capacity( needed );
+    }
+    shrinking_ = receiver.capacity() > initial_capacity_;
+  }
+
+  // Start timing once the window reaches past anything offered before: the sender can't have sent those
+  // bytes until it hears about them
+  const uint64_t edge = received + receiver.writer().available_capacity();
+  if ( edge > offered_edge_ ) {
+    if ( !rtt_probe_edge_.has_value() ) {
+      rtt_probe_edge_ = edge;
+      rtt_probe_start_ms_ = now_ms;
+    }
+    offered_edge_ = edge;
+  }
 }
@@ -5,13 +5,20 @@
 #include "tcp_sender_message.hh"
 #include "wrapping_integers.hh"
 
+#include <algorithm>
+#include <cstdint>
 #include <optional>
+#include <span>
+#include <vector>
 
 class TCPReceiver
 {
 public:
-  // Construct with given Reassembler
-  explicit TCPReceiver( Reassembler&& reassembler ) : reassembler_( std::move( reassembler ) ) {}
+  // Construct with given Reassembler, and the window-scale shift count to use if the peer's SYN offers scaling
+  explicit TCPReceiver( Reassembler&& reassembler, uint8_t window_scale = 0 )
+    : reassembler_( std::move( reassembler ) )
+    , window_scale_( std::min( window_scale, TCPReceiverMessage::MAX_WINDOW_SCALE ) )
+  {}
 
   /*
    * The TCPReceiver receives TCPSenderMessages, inserting their payload into the Reassembler
@@ -19,9 +26,16 @@ public:
    */
   void receive( TCPSenderMessage message );
 
+  // Receive a burst of TCPSenderMessages (moving from their payloads) with one Reassembler insert_batch()
+  void receive_batch( std::span<TCPSenderMessage> messages );
+
   // The TCPReceiver sends TCPReceiverMessages to the peer's TCPSender.
   TCPReceiverMessage send() const;
 
+  // Grow or shrink the receive buffer (and so the window), though never below what it holds
+  void set_capacity( uint64_t capacity ) { reassembler_.set_capacity( capacity ); }
+  uint64_t capacity() const { return writer().capacity(); }
+
   // Access the output (only Reader is accessible non-const)
   const Reassembler& reassembler() const { return reassembler_; }
   Reader& reader() { return reassembler_.reader(); }
@@ -31,4 +45,53 @@ public:
 private:
   Reassembler reassembler_;
   std::optional<Wrap32> base_seqno_ {};
-};
\ No newline at end of file
+  std::vector<Reassembler::Segment> batch_ {};
+  uint8_t window_scale_;
+  bool window_scaled_ {};           // did the peer's SYN offer window scaling, so ours takes effect?
+  bool sack_permitted_ {};          // did the peer's SYN offer to accept SACK blocks?
+  uint64_t latest_stream_index_ {}; // where the most recently received payload began
+
+  // SACK blocks for the bytes held out of order, most recently received first
+  std::vector<TCPReceiverMessage::SACKBlock> sack_blocks() const;
+
+  // The stream index of the message's payload (learning the ISN from a SYN), or nothing if it has none yet
+  std::optional<uint64_t> stream_index( const TCPSenderMessage& message );
+};
+
+// Receive-buffer autotuning, in the spirit of Linux's tcp_rmem. Once a round trip, the buffer grows to twice
+// what the application read during it (so the window doesn't limit a sender that the reader keeps up with),
+// up to a ceiling. After a while without data, an empty buffer shrinks back to its initial size, but only as the
+// peer uses up the window it was last offered: the window's right edge never moves left (RFC 9293 3.8.6.2.2).
+class ReceiveBufferTuner
+{
+public:
+  ReceiveBufferTuner( uint64_t initial_capacity, uint64_t max_capacity, uint64_t idle_ms )
+    : initial_capacity_( initial_capacity ), max_capacity_( max_capacity ), idle_ms_( idle_ms )
+  {}
+
+  // After a segment arrives (`data_arrived`) or time passes, adjust the receiver's capacity. `advertised_edge` is
+  // the stream index just past the window last offered to the peer.
+  void update( TCPReceiver& receiver, uint64_t now_ms, bool data_arrived, uint64_t advertised_edge );
+
+  // The receiver's estimate of the round-trip time, if it has one yet
+  std::optional<uint64_t> rtt_ms() const { return rtt_ms_; }
+
+private:
+  uint64_t initial_capacity_;
+  uint64_t max_capacity_;
+  uint64_t idle_ms_;
+
+  // Without timestamps, the receiver can only bound the round-trip time from above: by how long the sender
+  // takes to fill a window it was offered. The estimate follows lower samples at once, and higher ones slowly.
+  std::optional<uint64_t> rtt_ms_ {};
+  std::optional<uint64_t> rtt_probe_edge_ {}; // stream index at the right edge of the window being timed
+  uint64_t rtt_probe_start_ms_ {};
+  uint64_t offered_edge_ {}; // the farthest right edge of the window so far
+
+  uint64_t round_start_ms_ {};     // when the current round trip of measuring the reader began
+  uint64_t round_start_popped_ {}; // bytes the application had read by then
+  uint64_t last_data_ms_ {};
+
+  uint64_t held_edge_ {}; // the farthest right edge offered to the peer, which the buffer must still reach
+  bool shrinking_ {};     // gone idle: the window is no longer extended, and the buffer shrinks as it is used up
+};
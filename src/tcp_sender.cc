@@ -3,13 +3,113 @@
 #include "wrapping_integers.hh"
 
 #include <algorithm>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
-#include <string_view>
+#include <iterator>
+#include <optional>
+#include <string>
 #include <utility>
 
 using namespace std;
 
+void RTTEstimator::add_sample( uint64_t rtt_ms )
+{
+  const auto rtt = static_cast<double>( rtt_ms );
+  if ( not has_samples_ ) {
+    srtt_ms_ = rtt;
+    rttvar_ms_ = rtt / 2;
+    has_samples_ = true;
+  } else {
+    rttvar_ms_ = 0.75 * rttvar_ms_ + 0.25 * abs( srtt_ms_ - rtt );
+    srtt_ms_ = 0.875 * srtt_ms_ + 0.125 * rtt;
+  }
+  latest_rtt_ms_ = rtt_ms;
+  min_rtt_ms_ = min( min_rtt_ms_, rtt_ms );
+}
+
+uint64_t RTTEstimator::RTO_ms() const
+{
+  if ( not has_samples_ ) {
+    return initial_RTO_ms_;
+  }
+  const double rto = srtt_ms_ + max( CLOCK_GRANULARITY_MS, 4 * rttvar_ms_ );
+  return clamp( static_cast<uint64_t>( ceil( rto ) ), min_RTO_ms_, max_RTO_ms_ );
+}
+
+uint64_t PathMTUSearch::probe_size() const
+{
+  if ( high_ <= mss_ ) {
+    return 0;
+  }
+  if ( not tried_max_ ) {
+    return high_;
+  }
+  return high_ - mss_ < SEARCH_GRANULARITY ? 0 : mss_ + ( high_ - mss_ + 1 ) / 2;
+}
+
+void PathMTUSearch::limit( uint64_t max_mss )
+{
+  base_mss_ = min( base_mss_, max_mss );
+  mss_ = min( mss_, max_mss );
+  high_ = min( high_, max_mss );
+}
+
+void PathMTUSearch::probe_succeeded( uint64_t probe_size )
+{
+  mss_ = clamp( probe_size, mss_, high_ );
+  tried_max_ = true;
+}
+
+void PathMTUSearch::probe_failed( uint64_t probe_size )
+{
+  high_ = clamp( probe_size - 1, mss_, high_ );
+  tried_max_ = true;
+}
+
+bool PathMTUSearch::fall_back()
+{
+  if ( mss_ <= base_mss_ ) {
+    return false;
+  }
+  mss_ = base_mss_;
+  return true;
+}
+
+TCPSender::TCPSender( ByteStream&& input, Wrap32 isn, uint64_t initial_RTO_ms )
+  : TCPSender(
+    std::move( input ),
+    [&] {
+      TCPConfig config;
+      config.isn = isn;
+      return config;
+    }(),
+    initial_RTO_ms )
+{}
+
+TCPSender::TCPSender( ByteStream&& input, const TCPConfig& config )
+  : TCPSender( std::move( input ), config, config.rt_timeout )
+{}
+
+TCPSender::TCPSender( ByteStream&& input, const TCPConfig& config, uint64_t initial_RTO_ms )
+  : input_( std::move( input ) )
+  , isn_( config.isn )
+  , initial_RTO_ms_( initial_RTO_ms )
+  , adaptive_RTO_( config.adaptive_RTO )
+  , max_RTO_ms_( config.adaptive_RTO ? config.max_RTO_ms : UINT64_MAX )
+  , sack_( config.sack )
+  , window_scale_( min( config.window_scale, TCPReceiverMessage::MAX_WINDOW_SCALE ) )
+  , advertised_mss_( config.mss )
+  , repacketize_( config.congestion_control != CongestionControl::Algorithm::None )
+  , retrans_timer_( initial_RTO_ms )
+  , rtt_( initial_RTO_ms, config.min_RTO_ms, config.max_RTO_ms )
+  , mtu_( config.path_mtu_discovery ? TCPConfig::MAX_PAYLOAD_SIZE : config.mss, config.mss )
+  , congestion_control_( CongestionControl::make( config.congestion_control, mtu_.mss() ) )
+  , nagle_( config.nagle )
+  , flush_deadline_ms_( config.flush_deadline_ms )
+  , pacing_( config.pacing )
+{}
+
 uint64_t TCPSender::sequence_numbers_in_flight() const
 {
   return total_outgoing_seq_;
@@ -20,49 +120,261 @@ uint64_t TCPSender::consecutive_retransmissions() const
   return retrans_count_;
 }
 
+uint64_t TCPSender::congestion_window() const
+{
+  const uint64_t cwnd = congestion_control_->cwnd();
+  return cwnd > UINT64_MAX - recovery_inflation_ ? UINT64_MAX : cwnd + recovery_inflation_;
+}
+
+void TCPSender::limit_mss( uint64_t peer_mss )
+{
+  mtu_.limit( peer_mss );
+  update_mss();
+}
+
 void TCPSender::push( const TransmitFunction& transmit )
 {
-  while ( ( window_capacity_ == 0 ? 1 : window_capacity_ ) > total_outgoing_seq_ ) {
+  resend_lost_probe( transmit );
+  if ( fast_retransmit_pending_ ) {
+    fast_retransmit_pending_ = false;
+    if ( auto* hole = next_hole() ) {
+      retransmit( *hole, transmit );
+    }
+  }
+
+  const uint64_t rate = pacing_rate();
+  refill_pacing_tokens( rate );
+  paced_until_ms_.reset();
+
+  // Send against the smaller of the receiver's window (treating zero as one, to probe it) and the congestion window
+  const uint64_t receive_window = window_capacity_ == 0 ? 1 : window_capacity_;
+  const uint64_t send_window = min( receive_window, congestion_window() );
+  const bool congestion_limited = congestion_window() < receive_window;
+  while ( send_window > total_outgoing_seq_ ) {
     if ( FIN_sent_flag_ )
       break;
-    auto msg = make_empty_message();
+
+    // Don't let a congestion window that grows a few bytes at a time dribble out runt segments
+    const uint64_t room = send_window - total_outgoing_seq_;
+    if ( congestion_limited && total_outgoing_seq_ > 0 && room < congestion_control_->mss()
+         && reader().bytes_buffered() > room ) {
+      break;
+    }
+
+    OutstandingSegment segment { next_seq_number_, 0, false, false, time_ms_, false, false, false };
     if ( not SYN_sent_flag_ ) {
-      msg.SYN = true;
+      segment.SYN = true;
       SYN_sent_flag_ = true;
     }
 
-    uint64_t remaining_capacity = ( window_capacity_ == 0 ? 1 : window_capacity_ ) - total_outgoing_seq_;
-    size_t payload_len = min( TCPConfig::MAX_PAYLOAD_SIZE, remaining_capacity - msg.sequence_length() );
-    auto&& payload_data = msg.payload;
+    // Move the payload from the input stream to the retransmission buffer
+    uint64_t remaining_capacity = send_window - total_outgoing_seq_;
+    uint64_t payload_len = min( mtu_.mss(), remaining_capacity - segment.sequence_length() );
+
+    // Now and then (once connected, and while nothing is being repaired), send a full-sized path MTU probe
+    const uint64_t probe_size = mtu_.probe_size();
+    const bool probing = probe_size != 0 && probe_size_ == 0 && ack_sequence_number_ != 0 && !in_recovery_
+                         && !timeout_recovery_ && reader().bytes_buffered() >= probe_size
+                         && remaining_capacity >= probe_size;
+    if ( probing ) {
+      payload_len = probe_size;
+    }
 
-    while ( reader().bytes_buffered() != 0 and payload_data.size() < payload_len ) {
-      string_view data_view = reader().peek();
-      data_view = data_view.substr( 0, payload_len - payload_data.size() );
-      payload_data += data_view;
-      input_.reader().pop( data_view.size() );
+    if ( !segment.SYN && hold_small_segment( payload_len ) ) {
+      break;
+    }
+    if ( wait_for_pacing( min( payload_len, reader().bytes_buffered() ), rate ) ) {
+      break;
+    }
+    while ( reader().bytes_buffered() != 0 and segment.payload_size < payload_len ) {
+      Buffer chunk = input_.reader().pop_buffer( payload_len - segment.payload_size );
+      segment.payload_size += chunk.size();
+      unacked_size_ += chunk.size();
+      if ( unacked_bytes_.empty() || !unacked_bytes_.back().extend( chunk ) ) {
+        unacked_bytes_.push_back( move( chunk ) );
+      }
     }
 
-    if ( !FIN_sent_flag_ && remaining_capacity > msg.sequence_length() && reader().is_finished() ) {
-      msg.FIN = true;
+    if ( !FIN_sent_flag_ && remaining_capacity > segment.sequence_length() && reader().is_finished() ) {
+      segment.FIN = true;
       FIN_sent_flag_ = true;
     }
 
-    if ( msg.sequence_length() == 0 )
+    if ( segment.sequence_length() == 0 )
       break;
 
-    transmit( msg );
+    // Only a probe that is really sent is waited on (one held back by Nagle or pacing is tried again next time)
+    if ( probing ) {
+      segment.probe = true;
+      probe_size_ = probe_size;
+    }
+    transmit( make_message( segment ) );
     if ( !retrans_timer_.is_timer_active() ) {
       retrans_timer_.activate_timer();
     }
-    next_seq_number_ += msg.sequence_length();
-    total_outgoing_seq_ += msg.sequence_length();
-    pending_messages_.emplace( move( msg ) );
+    if ( rate != 0 ) {
+      pacing_tokens_ -= static_cast<double>( segment.sequence_length() );
+    }
+    next_seq_number_ += segment.sequence_length();
+    total_outgoing_seq_ += segment.sequence_length();
+    pending_messages_.push_back( segment );
+  }
+}
+
+// Would the next segment be small, for lack of data? If so, it may be worth waiting for more.
+bool TCPSender::hold_small_segment( uint64_t max_payload )
+{
+  const uint64_t buffered = reader().bytes_buffered();
+  const bool small = buffered != 0 && buffered < max_payload && !writer().is_closed();
+  const bool hold = small && ( corked_ || ( nagle_ && total_outgoing_seq_ != 0 ) );
+  if ( !hold ) {
+    held_since_ms_.reset();
+    return false;
+  }
+
+  if ( !held_since_ms_.has_value() ) {
+    held_since_ms_ = time_ms_;
+  }
+  if ( time_ms_ - held_since_ms_.value() >= flush_deadline_ms_ ) {
+    held_since_ms_.reset(); // waited long enough
+    return false;
+  }
+  return true;
+}
+
+uint64_t TCPSender::pacing_rate() const
+{
+  if ( !pacing_ || !rtt_.has_samples() ) {
+    return 0;
+  }
+  return congestion_control_->pacing_rate( max<uint64_t>( llround( rtt_.srtt_ms() ), 1 ) );
+}
+
+// Enough for a couple of segments, or for a millisecond at the pacing rate, whichever is more
+double TCPSender::pacing_burst( uint64_t rate ) const
+{
+  return static_cast<double>( max( PACING_BURST_SEGMENTS * mtu_.mss(), rate * PACING_BURST_MS / 1000 ) );
+}
+
+void TCPSender::refill_pacing_tokens( uint64_t rate )
+{
+  const double refill = static_cast<double>( rate * ( time_ms_ - pacing_refilled_ms_ ) ) / 1000.0;
+  pacing_tokens_ = min( pacing_tokens_ + refill, pacing_burst( rate ) );
+  pacing_refilled_ms_ = time_ms_;
+}
+
+// Must a segment of `bytes` wait for more tokens? If so, note when it can go.
+bool TCPSender::wait_for_pacing( uint64_t bytes, uint64_t rate )
+{
+  if ( rate == 0 ) {
+    return false;
+  }
+
+  // A segment bigger than the bucket (a path MTU probe, say) goes once the bucket is full
+  const double needed = min( static_cast<double>( bytes ), pacing_burst( rate ) );
+  if ( pacing_tokens_ >= needed ) {
+    return false;
+  }
+  paced_until_ms_ = time_ms_ + static_cast<uint64_t>( ceil( ( needed - pacing_tokens_ ) * 1000.0 / rate ) );
+  return true;
+}
+
+optional<uint64_t> TCPSender::ms_until_next_send() const
+{
+  if ( !paced_until_ms_.has_value() ) {
+    return nullopt;
+  }
+  return paced_until_ms_.value() - min( time_ms_, paced_until_ms_.value() );
+}
+
+optional<uint64_t> TCPSender::ms_until_deadline() const
+{
+  optional<uint64_t> next = ms_until_next_send();
+  // (Past the flush deadline, a segment still held back waits for the window to open.)
+  if ( held_since_ms_.has_value() && time_ms_ < held_since_ms_.value() + flush_deadline_ms_ ) {
+    const uint64_t flush_delay = held_since_ms_.value() + flush_deadline_ms_ - time_ms_;
+    next = min( next.value_or( flush_delay ), flush_delay );
+  }
+  if ( retrans_timer_.is_timer_active() && !pending_messages_.empty() ) {
+    next = min( next.value_or( retrans_timer_.ms_until_expiry() ), retrans_timer_.ms_until_expiry() );
+  }
+  return next;
+}
+
+TCPSenderMessage TCPSender::make_message( const OutstandingSegment& segment ) const
+{
+  TCPSenderMessage msg = make_empty_message();
+  msg.seqno = Wrap32::wrap( segment.seqno, isn_ );
+  msg.SYN = segment.SYN;
+  if ( segment.SYN ) {
+    msg.SACK_permitted = sack_;
+    if ( window_scale_ != 0 ) {
+      msg.window_scale = window_scale_;
+    }
+    msg.mss = advertised_mss_;
+  }
+  msg.payload = unacked_slice( segment.seqno + segment.SYN - 1, segment.payload_size );
+  msg.FIN = segment.FIN;
+  return msg;
+}
+
+Buffer TCPSender::unacked_slice( uint64_t first_index, uint64_t len ) const
+{
+  if ( len == 0 ) {
+    return {};
+  }
+
+  // Find the slice holding `first_index`, searching from whichever end of the buffer is nearer
+  // (new segments are at the back, and most retransmissions near the front)
+  auto it = unacked_bytes_.begin();
+  uint64_t offset = first_index - unacked_first_index_;
+  if ( offset > unacked_size_ / 2 ) {
+    uint64_t slice_end = unacked_first_index_ + unacked_size_;
+    auto rit = unacked_bytes_.rbegin();
+    while ( slice_end - rit->size() > first_index ) {
+      slice_end -= rit->size();
+      ++rit;
+    }
+    offset = first_index - ( slice_end - rit->size() );
+    it = prev( rit.base() );
+  } else {
+    while ( offset >= it->size() ) {
+      offset -= it->size();
+      ++it;
+    }
+  }
+
+  if ( it->size() - offset >= len ) {
+    return it->substr( offset, len );
+  }
+
+  // The payload spans several slices: join them
+  string joined;
+  joined.reserve( len );
+  for ( ; joined.size() < len; ++it, offset = 0 ) {
+    joined += it->view().substr( offset, len - joined.size() );
+  }
+  return joined;
+}
+
+void TCPSender::release_unacked( uint64_t len )
+{
+  unacked_first_index_ += len;
+  unacked_size_ -= len;
+  while ( len != 0 ) {
+    auto& front = unacked_bytes_.front();
+    if ( len < front.size() ) {
+      front.remove_prefix( len );
+      break;
+    }
+    len -= front.size();
+    unacked_bytes_.pop_front();
   }
 }
 
 TCPSenderMessage TCPSender::make_empty_message() const
 {
-  return { Wrap32::wrap( next_seq_number_, isn_ ), false, {}, false, input_.has_error() };
+  return { Wrap32::wrap( next_seq_number_, isn_ ), false, {}, false, input_.has_error(), false, {} };
 }
 
 void TCPSender::receive( const TCPReceiverMessage& msg )
@@ -74,6 +386,7 @@ void TCPSender::receive( const TCPReceiverMessage& msg )
     return;
   }
 
+  const uint32_t previous_window = window_capacity_;
   window_capacity_ = msg.window_size;
   if ( !msg.ackno.has_value() )
     return;
@@ -82,21 +395,78 @@ void TCPSender::receive( const TCPReceiverMessage& msg )
   if ( received_ack_seq > next_seq_number_ )
     return;
 
-  bool acknowledged = false;
+  if ( sack_ ) {
+    update_scoreboard( msg.sack_blocks );
+  }
+
+  // An ACK that acknowledges nothing new (and doesn't update the window) hints that a segment was lost
+  if ( received_ack_seq == ack_sequence_number_ ) {
+    const bool duplicate = !pending_messages_.empty() && msg.window_size == previous_window;
+    if ( duplicate && congestion_control_->fast_retransmit() ) {
+      on_duplicate_ack();
+    }
+    return;
+  }
+
+  uint64_t acked_bytes = 0;
+  optional<uint64_t> rtt_sample;
   while ( !pending_messages_.empty() ) {
-    const auto& front_msg = pending_messages_.front();
-    if ( ack_sequence_number_ + front_msg.sequence_length() > received_ack_seq ) {
+    const auto& front = pending_messages_.front();
+    if ( ack_sequence_number_ + front.sequence_length() > received_ack_seq ) {
       break;
     }
-    ack_sequence_number_ += front_msg.sequence_length();
-    total_outgoing_seq_ -= front_msg.sequence_length();
-    pending_messages_.pop();
-    acknowledged = true;
+    ack_sequence_number_ += front.sequence_length();
+    total_outgoing_seq_ -= front.sequence_length();
+    acked_bytes += front.sequence_length();
+    rtt_sample = front.retransmitted ? nullopt : optional { time_ms_ - front.sent_ms };
+    if ( front.probe ) {
+      probe_acknowledged();
+    }
+    release_unacked( front.payload_size );
+    pending_messages_.pop_front();
+  }
+
+  // An ACK that lands inside the first outstanding segment acknowledges its beginning: trim that off
+  if ( repacketize_ && !pending_messages_.empty() && received_ack_seq > ack_sequence_number_ ) {
+    auto& front = pending_messages_.front();
+    uint64_t trimmed = received_ack_seq - ack_sequence_number_;
+    ack_sequence_number_ += trimmed;
+    total_outgoing_seq_ -= trimmed;
+    acked_bytes += trimmed;
+    front.seqno += trimmed;
+    if ( front.SYN ) {
+      front.SYN = false;
+      trimmed--;
+    }
+    front.payload_size -= trimmed;
+    release_unacked( trimmed );
   }
 
-  if ( acknowledged ) {
+  if ( acked_bytes != 0 ) {
+    if ( rtt_sample.has_value() ) {
+      rtt_.add_sample( *rtt_sample );
+    }
+    duplicate_acks_ = 0;
+    if ( in_recovery_ ) {
+      on_recovery_ack( received_ack_seq, acked_bytes );
+    } else {
+      congestion_control_->on_ack( acked_bytes, time_ms_ );
+
+      // After a timeout, each ACK short of what was outstanding then exposes the next lost segment
+      if ( timeout_recovery_ ) {
+        timeout_recovery_ = received_ack_seq < recover_;
+        fast_retransmit_pending_ = timeout_recovery_;
+        resend_from_ = max( resend_from_, received_ack_seq );
+      }
+    }
     retrans_count_ = 0;
-    retrans_timer_.reload_timer( initial_RTO_ms_ );
+    if ( not adaptive_RTO_ ) {
+      retrans_timer_.reload_timer( initial_RTO_ms_ );
+    } else if ( rtt_sample.has_value() ) {
+      retrans_timer_.reload_timer( rtt_.RTO_ms() );
+    } else {
+      retrans_timer_.reset_timer(); // keep any backoff until a segment can be timed
+    }
     if ( pending_messages_.empty() ) {
       retrans_timer_.deactivate_timer();
     } else {
@@ -105,17 +475,229 @@ void TCPSender::receive( const TCPReceiverMessage& msg )
   }
 }
 
+void TCPSender::on_duplicate_ack()
+{
+  duplicate_acks_++;
+  const uint64_t mss = congestion_control_->mss();
+
+  // Each further duplicate means another segment has left the network, so let another one in:
+  // the next hole, if the SACK blocks show one, or else new data
+  if ( in_recovery_ ) {
+    if ( next_hole() != nullptr ) {
+      fast_retransmit_pending_ = true;
+    } else {
+      recovery_inflation_ += mss;
+    }
+    return;
+  }
+
+  // What's missing may be a path MTU probe: then the path just can't take segments that big
+  if ( duplicate_acks_ == 3 && pending_messages_.front().probe ) {
+    probe_lost();
+    return;
+  }
+
+  // Fast retransmit on the third duplicate, unless it is for data sent before the last recovery or timeout
+  if ( duplicate_acks_ == 3 && ack_sequence_number_ >= recover_ ) {
+    in_recovery_ = true;
+    recover_ = next_seq_number_;
+    congestion_control_->on_loss( total_outgoing_seq_, time_ms_ );
+    recovery_inflation_ = 3 * mss;
+    resend_from_ = ack_sequence_number_;
+    fast_retransmit_pending_ = true;
+  }
+}
+
+void TCPSender::on_recovery_ack( uint64_t received_ack_seq, uint64_t acked_bytes )
+{
+  // A full ACK (or any new ACK, for Reno) ends recovery, deflating the window back to ssthresh
+  if ( received_ack_seq >= recover_ || !congestion_control_->recovers_partial_acks() ) {
+    in_recovery_ = false;
+    recovery_inflation_ = 0;
+    return;
+  }
+
+  // A partial ACK: the next outstanding segment was lost too. Resend it (unless it has been already,
+  // as a hole), and deflate the window by the newly acknowledged bytes, less the one segment that this
+  // ACK shows has left the network.
+  recovery_inflation_ -= min( recovery_inflation_, acked_bytes );
+  recovery_inflation_ += congestion_control_->mss();
+  resend_from_ = max( resend_from_, received_ack_seq );
+  fast_retransmit_pending_ = true;
+}
+
+void TCPSender::update_scoreboard( const vector<TCPReceiverMessage::SACKBlock>& blocks )
+{
+  for ( const auto& block : blocks ) {
+    const uint64_t left = block.left.unwrap( isn_, next_seq_number_ );
+    const uint64_t right = block.right.unwrap( isn_, next_seq_number_ );
+    if ( right <= max( left, ack_sequence_number_ ) || right > next_seq_number_ ) {
+      continue; // stale, or nothing we sent
+    }
+
+    // Mark the segments that the block covers entirely
+    auto it = ranges::lower_bound( pending_messages_, left, {}, &OutstandingSegment::seqno );
+    for ( ; it != pending_messages_.end() && it->seqno + it->sequence_length() <= right; ++it ) {
+      it->sacked = true;
+      if ( it->probe ) {
+        it->probe = false;
+        probe_acknowledged();
+      }
+    }
+    highest_sacked_ = max( highest_sacked_, right );
+  }
+}
+
+TCPSender::OutstandingSegment* TCPSender::next_hole()
+{
+  auto it = ranges::lower_bound( pending_messages_, resend_from_, {}, &OutstandingSegment::seqno );
+  for ( ; it != pending_messages_.end(); ++it ) {
+    if ( it->seqno != ack_sequence_number_ && it->seqno >= highest_sacked_ ) {
+      break; // nothing has overtaken it
+    }
+    if ( !it->sacked ) {
+      return &*it;
+    }
+  }
+  return nullptr;
+}
+
+void TCPSender::retransmit( OutstandingSegment& segment, const TransmitFunction& transmit )
+{
+  transmit( make_message( segment ) );
+  segment.retransmitted = true;
+  resend_from_ = max( resend_from_, segment.seqno + segment.sequence_length() );
+}
+
 void TCPSender::tick( uint64_t ms_since_last_tick, const TransmitFunction& transmit )
 {
+  time_ms_ += ms_since_last_tick;
+  const bool flush_due = held_since_ms_.has_value() && time_ms_ - held_since_ms_.value() >= flush_deadline_ms_;
+  const bool pacing_due = paced_until_ms_.has_value() && time_ms_ >= paced_until_ms_.value();
+  if ( flush_due || pacing_due ) {
+    push( transmit );
+  }
   if ( retrans_timer_.advance_timer( ms_since_last_tick ).has_timer_expired() ) {
     if ( pending_messages_.empty() ) {
       return;
     }
-    transmit( pending_messages_.front() );
+    if ( pending_messages_.front().probe ) {
+      probe_lost(); // not a sign of congestion, so no backoff
+      resend_lost_probe( transmit );
+      retrans_timer_.reset_timer();
+      return;
+    }
     if ( window_capacity_ != 0 ) {
+      if ( retrans_count_ == 0 ) {
+        congestion_control_->on_timeout( total_outgoing_seq_, time_ms_ );
+      }
+      in_recovery_ = false;
+      recovery_inflation_ = 0;
+      duplicate_acks_ = 0;
+      recover_ = next_seq_number_;
+      timeout_recovery_ = congestion_control_->fast_retransmit();
       retrans_count_ += 1;
-      retrans_timer_.apply_exponential_backoff();
+      retrans_timer_.apply_exponential_backoff( max_RTO_ms_ );
+      if ( retrans_count_ == MTU_BLACK_HOLE_RETRANSMISSIONS && mtu_.fall_back() ) {
+        update_mss();
+      }
     }
+    retransmit_after_timeout( transmit );
     retrans_timer_.reset_timer();
   }
 }
+
+void TCPSender::retransmit_after_timeout( const TransmitFunction& transmit )
+{
+  resend_from_ = 0; // after a timeout, any hole may need resending again
+  if ( !repacketize_ ) {
+    if ( pending_messages_.front().payload_size > mtu_.mss() ) {
+      repacketize( 1 ); // too big for the path, having fallen back to a smaller MSS
+    }
+    retransmit( pending_messages_.front(), transmit );
+    return;
+  }
+
+  // Recut the run of segments from the front up to the first SACKed one
+  const auto run_end = ranges::find_if( pending_messages_, &OutstandingSegment::sacked );
+  repacketize( static_cast<uint64_t>( distance( pending_messages_.begin(), run_end ) ) );
+
+  // Resend from the front, as much as the windows allow (but always at least the first segment)
+  const uint64_t receive_window = window_capacity_ == 0 ? 1 : window_capacity_;
+  const uint64_t budget = min( receive_window, congestion_window() );
+  uint64_t resent = 0;
+  for ( auto& segment : pending_messages_ ) {
+    if ( segment.sacked ) {
+      break;
+    }
+    if ( resent != 0 && resent + segment.sequence_length() > budget ) {
+      break;
+    }
+    retransmit( segment, transmit );
+    resent += segment.sequence_length();
+  }
+}
+
+void TCPSender::repacketize( uint64_t count )
+{
+  if ( count == 0 ) {
+    return;
+  }
+  const auto run_end = next( pending_messages_.begin(), static_cast<ptrdiff_t>( count ) );
+
+  uint64_t seqno = pending_messages_.front().seqno;
+  bool SYN = pending_messages_.front().SYN;
+  const bool FIN = prev( run_end )->FIN;
+  uint64_t payload_left = 0;
+  for ( auto it = pending_messages_.begin(); it != run_end; ++it ) {
+    payload_left += it->payload_size;
+    if ( it->probe ) {
+      probe_size_ = 0; // no longer a probe: the outcome would say nothing
+    }
+  }
+
+  // Cut it again into full-sized segments. None can be timed any longer (nor could the originals).
+  deque<OutstandingSegment> repacketized;
+  do {
+    const uint64_t payload_size = min( payload_left, mtu_.mss() );
+    payload_left -= payload_size;
+    repacketized.push_back( { seqno, payload_size, SYN, FIN && payload_left == 0, time_ms_, true, false, false } );
+    seqno += repacketized.back().sequence_length();
+    SYN = false;
+  } while ( payload_left != 0 );
+
+  pending_messages_.erase( pending_messages_.begin(), run_end );
+  pending_messages_.insert( pending_messages_.begin(), repacketized.begin(), repacketized.end() );
+}
+
+void TCPSender::probe_acknowledged()
+{
+  mtu_.probe_succeeded( probe_size_ );
+  probe_size_ = 0;
+  update_mss();
+}
+
+void TCPSender::probe_lost()
+{
+  mtu_.probe_failed( probe_size_ );
+  probe_size_ = 0;
+  const auto& probe = pending_messages_.front();
+  lost_probe_end_ = probe.seqno + probe.sequence_length();
+  repacketize( 1 );
+}
+
+void TCPSender::resend_lost_probe( const TransmitFunction& transmit )
+{
+  for ( auto& segment : pending_messages_ ) {
+    if ( segment.seqno >= lost_probe_end_ ) {
+      break;
+    }
+    retransmit( segment, transmit );
+  }
+  lost_probe_end_ = 0;
+}
+
+void TCPSender::update_mss()
+{
+  congestion_control_->set_mss( mtu_.mss() );
+}
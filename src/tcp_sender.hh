@@ -1,12 +1,19 @@
 #pragma once
 
+#include "buffer.hh"
 #include "byte_stream.hh"
+#include "congestion_control.hh"
+#include "tcp_config.hh"
 #include "tcp_receiver_message.hh"
 #include "tcp_sender_message.hh"
 
+#include <algorithm>
 #include <cstdint>
+#include <deque>
 #include <functional>
-#include <queue>
+#include <memory>
+#include <optional>
+#include <vector>
 
 class RetryTimer
 {
@@ -24,7 +31,14 @@ public:
 
   void reset_timer() { timer_elapsed_ms_ = 0; }
 
-  void apply_exponential_backoff() { RTO_duration_ms_ <<= 1; }
+  void apply_exponential_backoff( uint64_t max_RTO_ms = UINT64_MAX )
+  {
+    RTO_duration_ms_ = std::min( RTO_duration_ms_ << 1, max_RTO_ms );
+  }
+
+  uint64_t RTO_ms() const { return RTO_duration_ms_; }
+
+  uint64_t ms_until_expiry() const { return RTO_duration_ms_ - std::min( timer_elapsed_ms_, RTO_duration_ms_ ); }
 
   void reload_timer( uint64_t initial_RTO_ms )
   {
@@ -62,13 +76,74 @@ private:
   uint64_t timer_elapsed_ms_ {};
 };
 
+// Round-trip time estimation and the retransmission timeout it implies (RFC 6298)
+class RTTEstimator
+{
+public:
+  RTTEstimator( uint64_t initial_RTO_ms, uint64_t min_RTO_ms, uint64_t max_RTO_ms )
+    : initial_RTO_ms_( initial_RTO_ms ), min_RTO_ms_( min_RTO_ms ), max_RTO_ms_( max_RTO_ms )
+  {}
+
+  // Fold in a round-trip measurement (which must not come from a retransmitted segment)
+  void add_sample( uint64_t rtt_ms );
+
+  bool has_samples() const { return has_samples_; }
+  double srtt_ms() const { return srtt_ms_; }     // smoothed round-trip time
+  double rttvar_ms() const { return rttvar_ms_; } // round-trip time variation
+  uint64_t latest_rtt_ms() const { return latest_rtt_ms_; }
+  uint64_t min_rtt_ms() const { return min_rtt_ms_; }
+
+  // SRTT + 4 * RTTVAR, clamped to [min_RTO_ms, max_RTO_ms] (or the initial RTO before any samples)
+  uint64_t RTO_ms() const;
+
+private:
+  static constexpr double CLOCK_GRANULARITY_MS = 1; // the sender's clock advances in whole milliseconds
+
+  uint64_t initial_RTO_ms_;
+  uint64_t min_RTO_ms_;
+  uint64_t max_RTO_ms_;
+  bool has_samples_ {};
+  double srtt_ms_ {};
+  double rttvar_ms_ {};
+  uint64_t latest_rtt_ms_ {};
+  uint64_t min_rtt_ms_ { UINT64_MAX };
+};
+
+// Packetization-layer path MTU discovery (RFC 4821): a search for the largest payload that gets through,
+// by now and then sending a segment bigger than the current MSS and seeing whether it is acknowledged
+class PathMTUSearch
+{
+public:
+  // Search from `base_mss` (assumed to get through) up to `max_mss`, or not at all if they are equal
+  PathMTUSearch( uint64_t base_mss, uint64_t max_mss )
+    : base_mss_( std::min( base_mss, max_mss ) ), mss_( base_mss_ ), high_( max_mss )
+  {}
+
+  uint64_t mss() const { return mss_; }       // the largest payload known to get through
+  uint64_t max_mss() const { return high_; }  // the largest payload not yet known to be too big
+  uint64_t probe_size() const;                // payload of the next probe, or 0 if the search is over
+  void limit( uint64_t max_mss );             // e.g. to the MSS the peer advertised
+  void probe_succeeded( uint64_t probe_size );
+  void probe_failed( uint64_t probe_size );
+  bool fall_back(); // after repeated timeouts (maybe the path changed): back to the base MSS, if above it
+
+private:
+  static constexpr uint64_t SEARCH_GRANULARITY = 32; // stop once the bounds are this close
+
+  uint64_t base_mss_;
+  uint64_t mss_;
+  uint64_t high_;
+  bool tried_max_ {}; // the first probe tries the maximum, as most paths will take it
+};
+
 class TCPSender
 {
 public:
   /* Construct TCP sender with given default Retransmission Timeout and possible ISN */
-  TCPSender( ByteStream&& input, Wrap32 isn, uint64_t initial_RTO_ms )
-    : input_( std::move( input ) ), isn_( isn ), initial_RTO_ms_( initial_RTO_ms ), retrans_timer_( initial_RTO_ms )
-  {}
+  TCPSender( ByteStream&& input, Wrap32 isn, uint64_t initial_RTO_ms );
+
+  /* Construct TCP sender with the ISN, timeouts and congestion control from `config` */
+  TCPSender( ByteStream&& input, const TCPConfig& config );
 
   /* Generate an empty TCPSenderMessage */
   TCPSenderMessage make_empty_message() const;
@@ -79,15 +154,33 @@ public:
   /* Type of the `transmit` function that the push and tick methods can use to send messages */
   using TransmitFunction = std::function<void( const TCPSenderMessage& )>;
 
+  /* The peer's SYN advertised the largest payload it will take */
+  void limit_mss( uint64_t peer_mss );
+
+  /* While corked, hold back small segments until uncorked (or the flush deadline passes) */
+  void set_corked( bool corked ) { corked_ = corked; }
+
   /* Push bytes from the outbound stream */
   void push( const TransmitFunction& transmit );
 
   /* Time has passed by the given # of milliseconds since the last time the tick() method was called */
   void tick( uint64_t ms_since_last_tick, const TransmitFunction& transmit );
 
+  /* With pacing, how long until tick() can send the segment that push() held back (if it held one back) */
+  std::optional<uint64_t> ms_until_next_send() const;
+
+  /* How long until tick() next has something to do (a retransmission, or a held-back segment to send), if any */
+  std::optional<uint64_t> ms_until_deadline() const;
+
   // Accessors
   uint64_t sequence_numbers_in_flight() const;  // How many sequence numbers are outstanding?
   uint64_t consecutive_retransmissions() const; // How many consecutive *re*transmissions have happened?
+  const CongestionControl& congestion_control() const { return *congestion_control_; }
+  const RTTEstimator& rtt() const { return rtt_; } // Round-trip time estimates
+  uint64_t mss() const { return mtu_.mss(); }       // Largest payload sent in a segment (except in probes)
+  uint64_t RTO_ms() const { return retrans_timer_.RTO_ms(); } // The current (maybe backed-off) timeout
+  bool in_fast_recovery() const { return in_recovery_; }
+  bool corked() const { return corked_; }
   Writer& writer() { return input_.writer(); }
   const Writer& writer() const { return input_.writer(); }
 
@@ -95,18 +188,110 @@ public:
   const Reader& reader() const { return input_.reader(); }
 
 private:
+  // Both public constructors come here: the initial RTO is apart from `config`, whose rt_timeout is only 16 bits
+  TCPSender( ByteStream&& input, const TCPConfig& config, uint64_t initial_RTO_ms );
+
   // Variables initialized in constructor
   ByteStream input_;
   Wrap32 isn_;
   uint64_t initial_RTO_ms_;
+  bool adaptive_RTO_;
+  uint64_t max_RTO_ms_;
+  bool sack_;
+  uint8_t window_scale_;
+  uint16_t advertised_mss_;
+  bool repacketize_; // trim partial ACKs and recut on timeout? (only with congestion control)
   // added variables
   uint64_t next_seq_number_ {};
   uint64_t ack_sequence_number_ {};
-  uint16_t window_capacity_ { 1 }; // start from 1
-  std::queue<TCPSenderMessage> pending_messages_ {};
+  uint32_t window_capacity_ { 1 }; // start from 1
+  // A segment in flight. Its payload is in the retransmission buffer, and the message is rebuilt from it
+  // to transmit or retransmit.
+  struct OutstandingSegment
+  {
+    uint64_t seqno;        // absolute sequence number of its first byte
+    uint64_t payload_size; // bytes of payload (following the SYN, if any)
+    bool SYN;
+    bool FIN;
+    uint64_t sent_ms;   // when it was first sent, by the clock of tick()
+    bool retransmitted; // if so, its acknowledgment can't be timed (Karn's rule)
+    bool sacked;        // has the receiver selectively acknowledged it?
+    bool probe;         // is it a path MTU probe, bigger than the MSS?
+
+    uint64_t sequence_length() const { return SYN + payload_size + FIN; }
+  };
+  std::deque<OutstandingSegment> pending_messages_ {}; // in sequence-number order: the SACK scoreboard
+
+  // The retransmission buffer: the unacknowledged bytes popped from the input stream, in stream order.
+  // The slices share their storage with what the writer pushed (with Storage::Chunked), so nothing is copied.
+  std::deque<Buffer> unacked_bytes_ {};
+  uint64_t unacked_first_index_ {}; // stream index of the first unacknowledged byte
+  uint64_t unacked_size_ {};
+
+  TCPSenderMessage make_message( const OutstandingSegment& segment ) const;
+  Buffer unacked_slice( uint64_t first_index, uint64_t len ) const; // copies only if it spans several slices
+  void release_unacked( uint64_t len );                               // drop acknowledged bytes
   uint64_t total_outgoing_seq_ {};
   uint64_t retrans_count_ {};
   bool SYN_sent_flag_ {};
   bool FIN_sent_flag_ {};
   RetryTimer retrans_timer_;
+  RTTEstimator rtt_;
+  PathMTUSearch mtu_;
+  std::unique_ptr<CongestionControl> congestion_control_;
+  uint64_t time_ms_ {}; // total time passed to tick()
+
+  // Fast retransmit and fast recovery (RFC 5681 and RFC 6582)
+  uint64_t duplicate_acks_ {};
+  bool in_recovery_ {};
+  uint64_t recover_ {};             // next_seq_number_ when recovery (or the last timeout) began
+  uint64_t recovery_inflation_ {};  // bytes the congestion window is inflated by during recovery
+  bool fast_retransmit_pending_ {}; // should push() resend the next hole?
+  bool timeout_recovery_ {};        // still repairing the losses behind a timeout?
+
+  // Selective acknowledgment (RFC 2018 and RFC 6675): a hole is an outstanding segment that hasn't been
+  // SACKed, but that later data has overtaken. Only the front segment counts without any SACK blocks.
+  uint64_t highest_sacked_ {}; // one past the highest sequence number SACKed
+  uint64_t resend_from_ {};    // holes below this have already been resent during this recovery
+
+  void update_scoreboard( const std::vector<TCPReceiverMessage::SACKBlock>& blocks );
+  OutstandingSegment* next_hole(); // the first hole at or beyond resend_from_, if any
+  void retransmit( OutstandingSegment& segment, const TransmitFunction& transmit );
+
+  // After a timeout, recut the outstanding data into full-sized segments and resend as many as cwnd allows
+  void retransmit_after_timeout( const TransmitFunction& transmit );
+  void repacketize( uint64_t count ); // recut the first `count` outstanding segments into ones of at most the MSS
+
+  // Path MTU discovery. A lost probe says nothing about congestion: its data is just resent in smaller segments.
+  static constexpr uint64_t MTU_BLACK_HOLE_RETRANSMISSIONS = 2; // timeouts in a row before falling back
+  uint64_t probe_size_ {};     // payload of the probe in flight, or 0 if none
+  uint64_t lost_probe_end_ {}; // if nonzero, the pieces of a lost probe up to here still need resending
+  void probe_acknowledged();
+  void probe_lost();
+  void resend_lost_probe( const TransmitFunction& transmit );
+  void update_mss();
+
+  // Coalescing small writes into full segments (Nagle's algorithm, and corking)
+  bool nagle_;
+  uint64_t flush_deadline_ms_;
+  bool corked_ {};
+  std::optional<uint64_t> held_since_ms_ {}; // when push() began holding back a small segment, if it is
+  bool hold_small_segment( uint64_t max_payload );
+
+  // Pacing, with a token bucket: each segment spends tokens (bytes), which refill at the pacing rate. The bucket
+  // holds enough for a small burst, so that a coarse tick can keep up. Only new data is paced; retransmissions
+  // repair losses at once.
+  static constexpr uint64_t PACING_BURST_SEGMENTS = 2;
+  static constexpr uint64_t PACING_BURST_MS = 1;
+  bool pacing_;
+  double pacing_tokens_ {};
+  uint64_t pacing_refilled_ms_ {};
+  std::optional<uint64_t> paced_until_ms_ {}; // when push() held back a segment for pacing, when it may go
+  uint64_t pacing_rate() const;               // in bytes per second, or 0 if not pacing
+  double pacing_burst( uint64_t rate ) const; // in bytes
+  void refill_pacing_tokens( uint64_t rate );
+  bool wait_for_pacing( uint64_t bytes, uint64_t rate );
+  void on_duplicate_ack();
+  void on_recovery_ack( uint64_t received_ack_seq, uint64_t acked_bytes );
+  uint64_t congestion_window() const; // including any inflation during recovery
 };
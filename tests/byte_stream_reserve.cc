@@ -0,0 +1,90 @@
+#include "byte_stream.hh"
+
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+// Count the bytes allocated and not yet freed (each allocation remembers its size, just before the block)
+namespace {
+size_t live_bytes = 0;
+constexpr size_t header = alignof( max_align_t );
+} // namespace
+
+// NOLINTBEGIN(*-no-malloc, *-owning-memory, *-pointer-arithmetic, *-reinterpret-cast)
+void* operator new( size_t size )
+{
+  auto* block = static_cast<char*>( malloc( size + header ) );
+  if ( block == nullptr ) {
+    throw bad_alloc {};
+  }
+  *reinterpret_cast<size_t*>( block ) = size;
+  live_bytes += size;
+  return block + header;
+}
+
+void operator delete( void* ptr ) noexcept
+{
+  if ( ptr == nullptr ) {
+    return;
+  }
+  auto* block = static_cast<char*>( ptr ) - header;
+  live_bytes -= *reinterpret_cast<size_t*>( block );
+  free( block );
+}
+
+void operator delete( void* ptr, size_t /* size */ ) noexcept
+{
+  operator delete( ptr );
+}
+// NOLINTEND(*-no-malloc, *-owning-memory, *-pointer-arithmetic, *-reinterpret-cast)
+
+int main()
+{
+  try {
+    // Many small writes through reserve()/commit() (as a read from an fd makes them), each reserving all the room
+    // there is: the stream must hold about what was written, not a reservation's worth of memory for each
+    constexpr size_t capacity = 64000;
+    constexpr size_t writes = 1000;
+    ByteStream stream { capacity };
+    const size_t before = live_bytes;
+
+    string expected;
+    for ( size_t i = 0; i < writes; ++i ) {
+      const string data = to_string( i % 10 ) + "bytes";
+      const auto regions = stream.writer().reserve();
+      stream.writer().commit( data.copy( regions.front().data(), data.size() ) );
+      expected += data;
+    }
+
+    const size_t held = live_bytes - before;
+    if ( held > 4 * capacity ) {
+      throw runtime_error( "after " + to_string( writes ) + " small writes (" + to_string( expected.size() )
+                           + " bytes), the stream holds " + to_string( held ) + " bytes of memory" );
+    }
+
+    string got;
+    read( stream.reader(), expected.size(), got );
+    if ( got != expected ) {
+      throw runtime_error( "reserve/commit lost or reordered bytes" );
+    }
+
+    // A write that fills most of its reservation still becomes a chunk without being copied
+    const auto regions = stream.writer().reserve( 100 );
+    const char* const reserved = regions.front().data();
+    stream.writer().commit( 90 );
+    if ( stream.reader().peek().data() != reserved ) {
+      throw runtime_error( "a mostly filled reservation was copied" );
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
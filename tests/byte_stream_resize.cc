@@ -0,0 +1,67 @@
+#include "byte_stream.hh"
+#include "byte_stream_test_harness.hh"
+
+#include <exception>
+#include <iostream>
+
+using namespace std;
+
+int main()
+{
+  try {
+    for ( const auto storage : { ByteStream::Storage::Chunked, ByteStream::Storage::Ring } ) {
+      {
+        ByteStreamTestHarness test { "resize: grow an empty stream", 2, storage };
+
+        test.execute( SetCapacity { 5 } );
+        test.execute( Capacity { 5 } );
+        test.execute( AvailableCapacity { 5 } );
+        test.execute( Push { "hello!" } );
+        test.execute( BytesPushed { 5 } );
+        test.execute( Peek { "hello" } );
+      }
+
+      {
+        ByteStreamTestHarness test { "resize: grow with wrapped data buffered", 4, storage };
+
+        test.execute( Push { "abc" } );
+        test.execute( Pop { 2 } );
+        test.execute( Push { "def" } );
+        test.execute( AvailableCapacity { 0 } );
+        test.execute( SetCapacity { 7 } );
+        test.execute( AvailableCapacity { 3 } );
+        test.execute( PeekAll { "cdef" } );
+        test.execute( Push { "ghijk" } );
+        test.execute( BytesBuffered { 7 } );
+        test.execute( Pop { 1 } );
+        test.execute( Push { "lm" } );
+        test.execute( Close {} );
+        test.execute( ReadAll { "defghil" } );
+        test.execute( IsFinished { true } );
+      }
+
+      {
+        ByteStreamTestHarness test { "resize: shrink, but not below what is buffered", 8, storage };
+
+        test.execute( Push { "abcdef" } );
+        test.execute( Pop { 3 } );
+        test.execute( SetCapacity { 2 } );
+        test.execute( Capacity { 3 } );
+        test.execute( AvailableCapacity { 0 } );
+        test.execute( PeekAll { "def" } );
+        test.execute( Pop { 2 } );
+        test.execute( Push { "ghi" } );
+        test.execute( PeekAll { "fgh" } );
+        test.execute( Pop { 3 } );
+        test.execute( SetCapacity { 1 } );
+        test.execute( Push { "xyz" } );
+        test.execute( ReadAll { "x" } );
+      }
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,79 @@
+#include "byte_stream.hh"
+#include "byte_stream_test_harness.hh"
+
+#include <exception>
+#include <iostream>
+
+using namespace std;
+
+int main()
+{
+  try {
+    {
+      ByteStreamTestHarness test { "ring: wrap around end of buffer", 4, ByteStream::Storage::Ring };
+
+      test.execute( Push { "abc" } );
+      test.execute( Pop { 2 } );
+      test.execute( Push { "def" } );
+      test.execute( BytesBuffered { 4 } );
+      test.execute( AvailableCapacity { 0 } );
+      test.execute( PeekOnce { "cd" } );
+      test.execute( PeekAll { "cdef" } );
+      test.execute( PeekAll { "cde", 3 } );
+      test.execute( Pop { 2 } );
+      test.execute( PeekOnce { "ef" } );
+      test.execute( Push { "gh" } );
+      test.execute( Peek { "efgh" } );
+      test.execute( Close {} );
+      test.execute( ReadAll { "efgh" } );
+      test.execute( IsFinished { true } );
+    }
+
+    {
+      ByteStreamTestHarness test { "ring: truncated push that wraps", 5, ByteStream::Storage::Ring };
+
+      test.execute( Push { "hello" } );
+      test.execute( Pop { 3 } );
+      test.execute( Push { "world" } );
+      test.execute( BytesPushed { 8 } );
+      test.execute( BytesBuffered { 5 } );
+      test.execute( PeekOnce { "lo" } );
+      test.execute( Peek { "lowor" } );
+      test.execute( Pop { 5 } );
+      test.execute( BufferEmpty { true } );
+      test.execute( Push { "!" } );
+      test.execute( PeekOnce { "!" } );
+    }
+
+    {
+      ByteStreamTestHarness test { "ring: reserve/commit across the wrap point", 6, ByteStream::Storage::Ring };
+
+      test.execute( PushReserved { "abcd" } );
+      test.execute( Pop { 3 } );
+      test.execute( PushReserved { "efghijk" } );
+      test.execute( BytesPushed { 9 } );
+      test.execute( AvailableCapacity { 0 } );
+      test.execute( PeekOnce { "def" } );
+      test.execute( PeekAll { "defghi" } );
+      test.execute( Close {} );
+      test.execute( PushReserved { "z" } );
+      test.execute( BytesPushed { 9 } );
+      test.execute( ReadAll { "defghi" } );
+    }
+
+    {
+      ByteStreamTestHarness test { "ring: zero capacity", 0, ByteStream::Storage::Ring };
+
+      test.execute( Push { "cat" } );
+      test.execute( BytesPushed { 0 } );
+      test.execute( PeekOnce { "" } );
+      test.execute( Close {} );
+      test.execute( IsFinished { true } );
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,106 @@
+#include "spsc_byte_stream.hh"
+
+#include <cstddef>
+#include <exception>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+void handoff_test( const size_t input_len,    // NOLINT(bugprone-easily-swappable-parameters)
+                   const size_t capacity,     // NOLINT(bugprone-easily-swappable-parameters)
+                   const size_t random_seed ) // NOLINT(bugprone-easily-swappable-parameters)
+{
+  const string data = [&] {
+    default_random_engine rd { random_seed };
+    uniform_int_distribution<char> ud;
+    string ret;
+    for ( size_t i = 0; i < input_len; ++i ) {
+      ret += ud( rd );
+    }
+    return ret;
+  }();
+
+  SPSCByteStream stream { capacity };
+
+  thread producer { [&] {
+    default_random_engine rd { random_seed + 1 };
+    uniform_int_distribution<size_t> write_size { 1, 2 * capacity };
+    size_t written = 0;
+    while ( written < data.size() ) {
+      stream.writer().wait();
+      written += stream.writer().push( string_view { data }.substr( written, write_size( rd ) ) );
+    }
+    stream.writer().close();
+  } };
+
+  string output;
+  while ( not stream.reader().is_finished() ) {
+    stream.reader().wait();
+    for ( const auto view : stream.reader().peek_all() ) {
+      output += view;
+      stream.reader().pop( view.size() );
+    }
+  }
+  producer.join();
+
+  if ( output != data ) {
+    throw runtime_error( "SPSCByteStream: mismatch between data written (" + to_string( data.size() )
+                         + " bytes) and read (" + to_string( output.size() ) + " bytes) with capacity="
+                         + to_string( capacity ) );
+  }
+  if ( stream.reader().bytes_popped() != data.size() or stream.writer().bytes_pushed() != data.size() ) {
+    throw runtime_error( "SPSCByteStream: unexpected byte counts" );
+  }
+}
+
+void program_body()
+{
+  handoff_test( 1, 1, 1234 );
+  handoff_test( 100000, 1, 4321 );
+  handoff_test( 100000, 7, 1111 );
+  handoff_test( 1000000, 4096, 2222 );
+
+  SPSCByteStream stream { 4 };
+  if ( stream.writer().push( "hello" ) != 4 or stream.writer().available_capacity() != 0 ) {
+    throw runtime_error( "SPSCByteStream: push did not stop at capacity" );
+  }
+  stream.reader().pop( 3 );
+  if ( stream.writer().push( "!!!" ) != 3 or stream.reader().peek() != "l" ) {
+    throw runtime_error( "SPSCByteStream: unexpected peek across the wrap point" );
+  }
+
+  // reserve()/commit() across the wrap point, and pop_buffer() up to it
+  stream.reader().pop( 3 );
+  const auto regions = stream.writer().reserve();
+  if ( regions.size() != 2 or regions.at( 0 ).size() != 1 or regions.at( 1 ).size() != 2 ) {
+    throw runtime_error( "SPSCByteStream: unexpected regions from reserve()" );
+  }
+  regions.at( 0 ).front() = 'a';
+  regions.at( 1 ).front() = 'b';
+  stream.writer().commit( 2 );
+  if ( stream.reader().pop_buffer().view() != "!a" or stream.reader().pop_buffer().view() != "b" ) {
+    throw runtime_error( "SPSCByteStream: unexpected bytes after reserve()/commit()" );
+  }
+
+  stream.set_error();
+  stream.reader().wait(); // must not block once the stream has an error
+  if ( not stream.reader().has_error() ) {
+    throw runtime_error( "SPSCByteStream: error flag lost" );
+  }
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
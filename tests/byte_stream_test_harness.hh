@@ -3,8 +3,10 @@
 #include "byte_stream.hh"
 #include "common.hh"
 
+#include <algorithm>
 #include <concepts>
 #include <optional>
+#include <string_view>
 #include <utility>
 
 static_assert( sizeof( Reader ) == sizeof( ByteStream ),
@@ -16,8 +18,13 @@ static_assert( sizeof( Writer ) == sizeof( ByteStream ),
 class ByteStreamTestHarness : public TestHarness<ByteStream>
 {
 public:
-  ByteStreamTestHarness( std::string test_name, uint64_t capacity )
-    : TestHarness( move( test_name ), "capacity=" + std::to_string( capacity ), ByteStream { capacity } )
+  ByteStreamTestHarness( std::string test_name,
+                         uint64_t capacity,
+                         ByteStream::Storage storage = ByteStream::Storage::Chunked )
+    : TestHarness( move( test_name ),
+                   "capacity=" + std::to_string( capacity )
+                     + ( storage == ByteStream::Storage::Ring ? ", storage=ring" : "" ),
+                   ByteStream { capacity, storage } )
   {}
 
   size_t peek_size() { return object().reader().peek().size(); }
@@ -34,6 +41,25 @@ struct Push : public Action<ByteStream>
   void execute( ByteStream& bs ) const override { bs.writer().push( data_ ); }
 };
 
+struct PushReserved : public Push
+{
+  using Push::Push;
+  std::string description() const override
+  {
+    return "reserve/commit \"" + Printer::prettify( data_ ) + "\" to the stream";
+  }
+  void execute( ByteStream& bs ) const override
+  {
+    std::string_view remaining = data_;
+    uint64_t written = 0;
+    for ( const auto region : bs.writer().reserve( data_.size() ) ) {
+      written += remaining.copy( region.data(), region.size() );
+      remaining.remove_prefix( std::min( region.size(), remaining.size() ) );
+    }
+    bs.writer().commit( written );
+  }
+};
+
 struct Close : public Action<ByteStream>
 {
   std::string description() const override { return "close"; }
@@ -55,6 +81,15 @@ struct Pop : public Action<ByteStream>
   void execute( ByteStream& bs ) const override { bs.reader().pop( len_ ); }
 };
 
+struct SetCapacity : public Action<ByteStream>
+{
+  uint64_t capacity_;
+
+  explicit SetCapacity( uint64_t capacity ) : capacity_( capacity ) {}
+  std::string description() const override { return "set_capacity( " + std::to_string( capacity_ ) + " )"; }
+  void execute( ByteStream& bs ) const override { bs.set_capacity( capacity_ ); }
+};
+
 /* expectations */
 
 struct Peek : public Expectation<ByteStream>
@@ -107,6 +142,37 @@ struct PeekOnce : public Peek
   }
 };
 
+struct PeekAll : public Expectation<ByteStream>
+{
+  std::string output_;
+  uint64_t max_len_;
+
+  explicit PeekAll( std::string output, uint64_t max_len = UINT64_MAX )
+    : output_( move( output ) ), max_len_( max_len )
+  {}
+
+  std::string description() const override
+  {
+    return "peek_all(" + ( max_len_ == UINT64_MAX ? "" : " " + std::to_string( max_len_ ) + " " )
+           + ") gives \"" + Printer::prettify( output_ ) + "\"";
+  }
+
+  void execute( ByteStream& bs ) const override
+  {
+    std::string got;
+    for ( const auto view : bs.reader().peek_all( max_len_ ) ) {
+      if ( view.empty() ) {
+        throw ExpectationViolation { "Reader::peek_all() returned an empty string_view" };
+      }
+      got += view;
+    }
+    if ( got != output_ ) {
+      throw ExpectationViolation { "Expected peek_all() to produce \"" + Printer::prettify( output_ )
+                                   + "\", but found \"" + Printer::prettify( got ) + "\"" };
+    }
+  }
+};
+
 struct IsClosed : public ConstExpectBool<ByteStream>
 {
   using ConstExpectBool::ConstExpectBool;
@@ -149,6 +215,13 @@ struct AvailableCapacity : public ExpectNumber<ByteStream, uint64_t>
   size_t value( ByteStream& bs ) const override { return bs.writer().available_capacity(); }
 };
 
+struct Capacity : public ExpectNumber<ByteStream, uint64_t>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "capacity"; }
+  size_t value( ByteStream& bs ) const override { return bs.capacity(); }
+};
+
 struct BytesPushed : public ExpectNumber<ByteStream, uint64_t>
 {
   using ExpectNumber::ExpectNumber;
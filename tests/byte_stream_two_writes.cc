@@ -55,6 +55,9 @@ int main()
       test.execute( AvailableCapacity { 11 } );
       test.execute( BytesBuffered { 4 } );
       test.execute( Peek { "ttac" } );
+      test.execute( PeekAll { "ttac" } );
+      test.execute( PeekAll { "tta", 3 } );
+      test.execute( PeekAll { "t", 1 } );
 
       test.execute( Pop { 4 } );
 
@@ -125,6 +128,25 @@ int main()
       test.execute( BytesBuffered { 0 } );
     }
 
+    {
+      ByteStreamTestHarness test { "push-reserve/commit-overflow", 5 };
+
+      test.execute( Push { "cat" } );
+      test.execute( PushReserved { "tac" } );
+
+      test.execute( BytesPushed { 5 } );
+      test.execute( AvailableCapacity { 0 } );
+      test.execute( BytesBuffered { 5 } );
+      test.execute( PeekAll { "catta" } );
+
+      test.execute( Pop { 4 } );
+      test.execute( PushReserved { "dog" } );
+
+      test.execute( BytesPushed { 8 } );
+      test.execute( AvailableCapacity { 1 } );
+      test.execute( Peek { "adog" } );
+    }
+
   } catch ( const exception& e ) {
     cerr << "Exception: " << e.what() << endl;
     return EXIT_FAILURE;
@@ -0,0 +1,456 @@
+#include "eventloop.hh"
+#include "exception.hh"
+#include "file_descriptor.hh"
+#include "test_should_be.hh"
+
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <fcntl.h>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+using Result = EventLoop::Result;
+using Backend = EventLoop::Backend;
+
+static pair<FileDescriptor, FileDescriptor> make_pipe()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "pipe2", ::pipe2( fds.data(), O_NONBLOCK | O_CLOEXEC ) );
+  return { FileDescriptor { fds[0] }, FileDescriptor { fds[1] } };
+}
+
+static string describe( Backend backend )
+{
+  switch ( backend ) {
+    case Backend::Poll:
+      return "poll";
+    case Backend::Epoll:
+      return "epoll";
+    default:
+      return "io_uring";
+  }
+}
+
+static void expect_string( const string& actual, const string& expected )
+{
+  if ( actual != expected ) {
+    throw runtime_error( "read \"" + actual + "\", not \"" + expected + "\"" );
+  }
+}
+
+static void expect_result( Result actual, Result expected, const string& what )
+{
+  if ( actual != expected ) {
+    throw runtime_error( what + ": wait_next_event returned " + to_string( static_cast<int>( actual ) )
+                         + ", not " + to_string( static_cast<int>( expected ) ) );
+  }
+}
+
+// A readable fd is served, and the loop times out when nothing is ready
+static void readable( Backend backend )
+{
+  EventLoop loop { backend };
+  auto [read_end, write_end] = make_pipe();
+  string got;
+  bool cancelled = false;
+  loop.add_rule(
+    "read",
+    read_end,
+    Direction::In,
+    [&] {
+      string buffer;
+      read_end.read( buffer );
+      got += buffer;
+    },
+    [] { return true; },
+    [&] { cancelled = true; } );
+
+  expect_result( loop.wait_next_event( 0 ), Result::Timeout, "empty pipe" );
+  write_end.write( "hello" );
+  expect_result( loop.wait_next_event( 0 ), Result::Success, "pipe with data" );
+  expect_string( got, "hello" );
+  expect_result( loop.wait_next_event( 0 ), Result::Timeout, "drained pipe" );
+
+  // A closed fd's rule goes away, and a hangup cancels the reader's rule: then there is nothing to wait for
+  loop.add_rule(
+    "never", write_end, Direction::Out, [] {}, [] { return false; } );
+  write_end.close();
+  expect_result( loop.wait_next_event( 0 ), Result::Success, "closed pipe" );
+  test_should_be( cancelled, true );
+  expect_result( loop.wait_next_event( 0 ), Result::Exit, "pipe hung up" );
+}
+
+// Only one rule is served per iteration, in the order the rules were added
+static void order( Backend backend )
+{
+  EventLoop loop { backend };
+  vector<pair<FileDescriptor, FileDescriptor>> pipes;
+  pipes.reserve( 100 );
+  string served;
+  const size_t category = loop.add_category( "read" );
+  for ( size_t i = 0; i < 100; ++i ) {
+    pipes.push_back( make_pipe() );
+    loop.add_rule( category, pipes.back().first, Direction::In, [&, i] {
+      string buffer;
+      pipes.at( i ).first.read( buffer );
+      served += buffer;
+    } );
+  }
+
+  pipes.at( 70 ).second.write( "c" );
+  pipes.at( 3 ).second.write( "a" );
+  pipes.at( 42 ).second.write( "b" );
+  for ( size_t i = 0; i < 3; ++i ) {
+    expect_result( loop.wait_next_event( 0 ), Result::Success, "ready pipes" );
+    test_should_be( served.size(), i + 1 );
+  }
+  expect_string( served, "abc" );
+  expect_result( loop.wait_next_event( 0 ), Result::Timeout, "drained pipes" );
+}
+
+// Interest can come from a predicate, from the rule's handle, or both
+static void interest( Backend backend )
+{
+  EventLoop loop { backend };
+  auto [read_end, write_end] = make_pipe();
+  bool wanted = false;
+  size_t reads = 0;
+  auto read_rule = loop.add_rule(
+    "read",
+    read_end,
+    Direction::In,
+    [&] {
+      string buffer;
+      read_end.read( buffer );
+      ++reads;
+    },
+    [&] { return wanted; } );
+  auto write_rule = loop.add_rule( "write", write_end, Direction::Out, [&] { write_end.write( "x" ); } );
+
+  write_rule.disable();
+  expect_result( loop.wait_next_event( 0 ), Result::Exit, "nothing interested" );
+
+  write_rule.enable();
+  expect_result( loop.wait_next_event( 0 ), Result::Success, "writable pipe" );
+  write_rule.disable();
+  expect_result( loop.wait_next_event( 0 ), Result::Exit, "predicate still false" );
+
+  wanted = true;
+  expect_result( loop.wait_next_event( 0 ), Result::Success, "predicate flipped" );
+  test_should_be( reads, size_t { 1 } );
+  read_rule.disable();
+  write_end.write( "y" );
+  expect_result( loop.wait_next_event( 0 ), Result::Exit, "disabled despite the predicate" );
+  read_rule.enable();
+  expect_result( loop.wait_next_event( 0 ), Result::Success, "enabled again" );
+  test_should_be( reads, size_t { 2 } );
+
+  read_rule.cancel();
+  expect_result( loop.wait_next_event( 0 ), Result::Exit, "cancelled" );
+}
+
+// A writer's rule is cancelled when the reader hangs up, and a file (which epoll refuses) is always ready
+static void hangup_and_files( Backend backend )
+{
+  EventLoop loop { backend };
+  auto [read_end, write_end] = make_pipe();
+  bool write_cancelled = false;
+  loop.add_rule(
+    "write",
+    write_end,
+    Direction::Out,
+    [&] { write_end.write( "x" ); },
+    [] { return true; },
+    [&] { write_cancelled = true; } );
+  read_end.close();
+  expect_result( loop.wait_next_event( 0 ), Result::Success, "reader hung up" );
+  test_should_be( write_cancelled, true );
+
+  FileDescriptor null { CheckSystemCall( "open", ::open( "/dev/null", O_RDONLY | O_CLOEXEC ) ) };
+  loop.add_rule( "read a file", null, Direction::In, [&] {
+    string buffer;
+    null.read( buffer );
+  } );
+  expect_result( loop.wait_next_event( -1 ), Result::Success, "file" );
+  test_should_be( null.eof(), true );
+  expect_result( loop.wait_next_event( 0 ), Result::Exit, "file at EOF" );
+}
+
+// With Dispatch::All, one call serves every ready rule, each while it stays ready (up to the budget)
+static void dispatch_all( Backend backend )
+{
+  EventLoop loop { backend, EventLoop::Dispatch::All, 3 };
+  vector<pair<FileDescriptor, FileDescriptor>> pipes;
+  pipes.reserve( 3 );
+  string served;
+  const size_t category = loop.add_category( "read" );
+  for ( size_t i = 0; i < 3; ++i ) {
+    pipes.push_back( make_pipe() );
+    loop.add_rule( category, pipes.back().first, Direction::In, [&, i] {
+      string buffer( 1, '\0' ); // a byte at a time
+      pipes.at( i ).first.read( buffer );
+      served += buffer;
+    } );
+  }
+
+  pipes.at( 2 ).second.write( "c" );
+  pipes.at( 0 ).second.write( "aaaaa" );
+  expect_result( loop.wait_next_event( 0 ), Result::Success, "ready pipes" );
+  expect_string( served, "aaac" );
+  expect_result( loop.wait_next_event( 0 ), Result::Success, "the rest of the first pipe" );
+  expect_string( served, "aaacaa" );
+  expect_result( loop.wait_next_event( 0 ), Result::Timeout, "drained pipes" );
+
+  // Rules take turns to go first (after the first pipe, which went first last time)
+  served.clear();
+  pipes.at( 0 ).second.write( string( 10, 'a' ) );
+  pipes.at( 1 ).second.write( string( 10, 'b' ) );
+  pipes.at( 2 ).second.write( string( 10, 'c' ) );
+  expect_result( loop.wait_next_event( 0 ), Result::Success, "all ready" );
+  expect_result( loop.wait_next_event( 0 ), Result::Success, "all still ready" );
+  expect_result( loop.wait_next_event( 0 ), Result::Success, "all still ready" );
+  expect_string( served, "bbbcccaaa"
+                         "cccaaabbb"
+                         "aaabbbccc" );
+}
+
+// With Dispatch::All, a rule that an earlier callback made uninterested isn't served, and non-fd rules don't keep
+// the fds from being served
+static void dispatch_all_interest( Backend backend )
+{
+  EventLoop loop { backend, EventLoop::Dispatch::All, 2 };
+  auto [read_end, write_end] = make_pipe();
+  auto [other_read_end, other_write_end] = make_pipe();
+  bool other_wanted = true;
+  string served;
+  loop.add_rule( "read", read_end, Direction::In, [&] {
+    string buffer;
+    read_end.read( buffer );
+    served += buffer;
+    other_wanted = false;
+  } );
+  loop.add_rule(
+    "other",
+    other_read_end,
+    Direction::In,
+    [&] {
+      string buffer;
+      other_read_end.read( buffer );
+      served += buffer;
+    },
+    [&] { return other_wanted; } );
+  size_t ticks = 0;
+  loop.add_rule( "tick", [&] { ++ticks; }, [&] { return ticks < 5; } );
+
+  write_end.write( "x" );
+  other_write_end.write( "y" );
+  expect_result( loop.wait_next_event( -1 ), Result::Success, "both ready" );
+  expect_string( served, "x" );
+  test_should_be( ticks, size_t { 2 } );
+  other_wanted = true;
+  expect_result( loop.wait_next_event( -1 ), Result::Success, "other ready" );
+  expect_string( served, "xy" );
+  test_should_be( ticks, size_t { 4 } );
+}
+
+// Timers go off in order, never early, and once or periodically; they can be rearmed, disarmed and cancelled
+static void timers( Backend backend )
+{
+  using namespace std::chrono_literals;
+  using Clock = EventLoop::Clock;
+
+  EventLoop loop { backend };
+  const size_t category = loop.add_category( "timer" );
+  string fired;
+  bool early = false;
+  const auto start = Clock::now();
+  auto timer = [&]( char name, Clock::duration delay ) {
+    return [&, name, delay] {
+      early |= Clock::now() < start + delay;
+      fired += name;
+    };
+  };
+
+  loop.add_timer( category, 3ms, timer( 'c', 3ms ) );
+  loop.add_timer( category, 1ms, timer( 'a', 1ms ) );
+  loop.add_timer( category, 2ms, timer( 'b', 2ms ) );
+  loop.add_timer( category, 2ms, timer( 'x', 2ms ) ).cancel();
+  const auto rearmed = loop.add_timer( category, 1h, timer( 'd', 4ms ) );
+  loop.set_timer( rearmed, 4ms );
+  const auto disarmed = loop.add_timer( category, 1ms, timer( 'y', 1ms ) );
+  loop.set_timer( disarmed, nullopt );
+  loop.add_timer( category, nullopt, timer( 'z', 0ms ) );
+
+  while ( fired.size() < 4 ) {
+    expect_result( loop.wait_next_event( -1 ), Result::Success, "timers pending" );
+  }
+  expect_string( fired, "abcd" );
+  test_should_be( early, false );
+  expect_result( loop.wait_next_event( -1 ), Result::Exit, "timers done" );
+
+  // A periodic timer goes off until disarmed, skipping its callback while disabled
+  size_t ticks = 0;
+  auto periodic = loop.add_timer( category, 1ms, [&] { ticks++; }, 1ms );
+  while ( ticks < 3 ) {
+    expect_result( loop.wait_next_event( -1 ), Result::Success, "periodic timer" );
+  }
+  periodic.disable();
+  expect_result( loop.wait_next_event( -1 ), Result::Success, "disabled timer" );
+  test_should_be( ticks, size_t { 3 } );
+  periodic.enable();
+  expect_result( loop.wait_next_event( -1 ), Result::Success, "enabled timer" );
+  test_should_be( ticks, size_t { 4 } );
+  loop.set_timer( periodic, nullopt );
+  expect_result( loop.wait_next_event( -1 ), Result::Exit, "periodic timer disarmed" );
+
+  // Timers and fds wait together
+  auto [read_end, write_end] = make_pipe();
+  loop.add_rule( category, read_end, Direction::In, [&] {
+    string buffer;
+    read_end.read( buffer );
+    fired += buffer;
+  } );
+  loop.add_timer( category, 1ms, [&] { write_end.write( "e" ); } );
+  expect_result( loop.wait_next_event( -1 ), Result::Success, "timer" );
+  expect_result( loop.wait_next_event( -1 ), Result::Success, "pipe written by timer" );
+  expect_string( fired, "abcde" );
+}
+
+// Read rules get what the reads on each wakeup return (each datagram), and each write() sends one datagram. There
+// are more datagrams than the io_uring provides buffers for, so its reads run out, and are rearmed.
+static void reads_and_writes( Backend backend )
+{
+  EventLoop loop { backend };
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair",
+                   ::socketpair( AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds.data() ) );
+  FileDescriptor sender { fds[0] };
+  FileDescriptor receiver { fds[1] };
+
+  constexpr size_t count = 200;
+  vector<string> datagrams;
+  size_t batches = 0;
+  const auto datagram_rule = loop.add_read_rule(
+    loop.add_category( "datagrams" ),
+    receiver,
+    [&]( span<const string_view> batch ) {
+      batches++;
+      datagrams.insert( datagrams.end(), batch.begin(), batch.end() );
+    },
+    [&] { return datagrams.size() < count; } );
+  for ( size_t i = 0; i < count; ++i ) {
+    loop.write( sender, { "datagram ", to_string( i ) }, datagram_rule );
+  }
+
+  for ( size_t i = 0; i < count and datagrams.size() < count; ++i ) {
+    expect_result( loop.wait_next_event( 1000 ), Result::Success, "datagrams" );
+  }
+  test_should_be( datagrams.size(), count );
+  test_should_be( batches < count / 2, true ); // many datagrams at a time
+  vector<bool> seen( count );
+  for ( const auto& datagram : datagrams ) {
+    const size_t i = stoul( datagram.substr( datagram.find( ' ' ) + 1 ) );
+    expect_string( datagram, "datagram " + to_string( i ) );
+    test_should_be( static_cast<bool>( seen.at( i ) ), false );
+    seen.at( i ) = true;
+  }
+  expect_result( loop.wait_next_event( 0 ), Result::Exit, "all datagrams read" );
+
+  // A read rule is cancelled at EOF, after the data before it
+  auto [read_end, write_end] = make_pipe();
+  string got;
+  bool cancelled = false;
+  loop.add_read_rule(
+    loop.add_category( "stream" ),
+    read_end,
+    [&]( span<const string_view> batch ) {
+      for ( const auto data : batch ) {
+        got += data;
+      }
+    },
+    {},
+    [&] { cancelled = true; } );
+  write_end.write( "hello" );
+  write_end.close();
+  for ( size_t i = 0; i < 10 and not cancelled; ++i ) {
+    const auto result = loop.wait_next_event( 1000 );
+    if ( not cancelled ) { // (the wait that cancels it may find nothing else to do)
+      expect_result( result, Result::Success, "stream" );
+    }
+  }
+  expect_string( got, "hello" );
+  test_should_be( cancelled, true );
+  expect_result( loop.wait_next_event( 0 ), Result::Exit, "stream at EOF" );
+}
+
+// A write that finds no room is dropped; one that fails cancels its owner, rather than ending the loop
+static void write_errors( Backend backend )
+{
+  EventLoop loop { backend };
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair",
+                   ::socketpair( AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds.data() ) );
+  FileDescriptor sender { fds[0] };
+  FileDescriptor receiver { fds[1] };
+
+  auto [read_end, write_end] = make_pipe();
+  bool cancelled = false;
+  const auto owner = loop.add_read_rule(
+    loop.add_category( "owner" ), read_end, []( span<const string_view> /* batch */ ) {}, {}, [&] {
+      cancelled = true;
+    } );
+
+  // many more datagrams than the socket will queue, with nothing reading them
+  for ( size_t i = 0; i < 100; ++i ) {
+    loop.write( sender, { string( 1000, 'x' ) }, owner );
+  }
+  expect_result( loop.wait_next_event( 10 ), Result::Timeout, "writes with no room" );
+  test_should_be( cancelled, false );
+
+  receiver.close();
+  loop.write( sender, { "to nobody" }, owner );
+  for ( size_t i = 0; i < 10 and not cancelled; ++i ) {
+    loop.wait_next_event( 10 );
+  }
+  test_should_be( cancelled, true );
+  expect_result( loop.wait_next_event( 0 ), Result::Exit, "owner cancelled" );
+}
+
+int main()
+{
+  try {
+    test_should_be( EventLoop {}.backend() == Backend::Epoll, true );
+
+    for ( const auto backend : { Backend::Poll, Backend::Epoll, Backend::IoUring } ) {
+      try {
+        readable( backend );
+        order( backend );
+        interest( backend );
+        hangup_and_files( backend );
+        dispatch_all( backend );
+        dispatch_all_interest( backend );
+        timers( backend );
+        reads_and_writes( backend );
+        write_errors( backend );
+      } catch ( const exception& e ) {
+        throw runtime_error( describe( backend ) + " backend: " + e.what() );
+      }
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
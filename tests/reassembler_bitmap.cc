@@ -0,0 +1,123 @@
+#include "random.hh"
+#include "reassembler_test_harness.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+static constexpr auto Bitmap = Reassembler::Engine::Bitmap;
+
+// Feed the same random, overlapping, out-of-window inserts (and resizes) to both engines and check they agree at
+// every step
+static void differential_test( uint64_t capacity, size_t num_inserts, default_random_engine& rd )
+{
+  const size_t stream_len = capacity * 8;
+  string d( stream_len, 0 );
+  generate( d.begin(), d.end(), [&] { return rd(); } );
+
+  Reassembler map_engine { ByteStream { capacity } };
+  Reassembler bitmap_engine { ByteStream { capacity }, Bitmap };
+  string map_out;
+  string bitmap_out;
+
+  for ( size_t i = 0; i < num_inserts and not map_engine.writer().is_closed(); ++i ) {
+    const uint64_t base = map_engine.writer().bytes_pushed();
+    const uint64_t first = min<uint64_t>( stream_len, base + rd() % ( capacity + 8 ) - min<uint64_t>( base, 4 ) );
+    const uint64_t len = min<uint64_t>( stream_len - first, rd() % ( capacity / 2 + 2 ) );
+    const bool last = first + len == stream_len;
+
+    map_engine.insert( first, d.substr( first, len ), last );
+    bitmap_engine.insert( first, d.substr( first, len ), last );
+
+    if ( map_engine.bytes_pending() != bitmap_engine.bytes_pending() ) {
+      throw runtime_error( "bytes_pending mismatch after insert @ " + to_string( first ) + ": map="
+                           + to_string( map_engine.bytes_pending() )
+                           + " bitmap=" + to_string( bitmap_engine.bytes_pending() ) );
+    }
+    if ( map_engine.writer().bytes_pushed() != bitmap_engine.writer().bytes_pushed() ) {
+      throw runtime_error( "bytes_pushed mismatch after insert @ " + to_string( first ) );
+    }
+
+    // now and then, resize both (the bitmap engine must carry its pending bytes over to a new ring)
+    if ( rd() % 16 == 0 ) {
+      const uint64_t new_capacity = 1 + rd() % ( capacity * 2 );
+      map_engine.set_capacity( new_capacity );
+      bitmap_engine.set_capacity( new_capacity );
+      if ( map_engine.writer().available_capacity() != bitmap_engine.writer().available_capacity() ) {
+        throw runtime_error( "available_capacity mismatch after resizing to " + to_string( new_capacity ) );
+      }
+    }
+
+    // drain part of the output so the window slides (and wraps around the ring)
+    const uint64_t to_read = rd() % ( map_engine.reader().bytes_buffered() + 1 );
+    string chunk;
+    read( map_engine.reader(), to_read, chunk );
+    map_out += chunk;
+    read( bitmap_engine.reader(), to_read, chunk );
+    bitmap_out += chunk;
+  }
+
+  if ( map_out != bitmap_out or map_engine.writer().is_closed() != bitmap_engine.writer().is_closed() ) {
+    throw runtime_error( "output mismatch between map and bitmap engines (capacity=" + to_string( capacity )
+                         + ")" );
+  }
+}
+
+int main()
+{
+  try {
+    {
+      ReassemblerTestHarness test { "bitmap: holes and overlaps", 8, Bitmap };
+
+      test.execute( Insert { "b", 1 } );
+      test.execute( Insert { "d", 3 } );
+      test.execute( BytesPending { 2 } );
+      test.execute( Insert { "bcde", 1 } );
+      test.execute( BytesPending { 4 } );
+      test.execute( ReadAll( "" ) );
+      test.execute( Insert { "a", 0 } );
+      test.execute( BytesPending { 0 } );
+      test.execute( ReadAll( "abcde" ) );
+    }
+
+    {
+      ReassemblerTestHarness test { "bitmap: window wraps around the ring", 4, Bitmap };
+
+      test.execute( Insert { "abc", 0 } );
+      test.execute( ReadAll( "abc" ) );
+      test.execute( Insert { "efgh", 4 } );
+      test.execute( BytesPending { 3 } );
+      test.execute( Insert { "de", 3 } );
+      test.execute( BytesPending { 0 } );
+      test.execute( ReadAll( "defg" ) );
+      test.execute( Insert { "hij", 7 }.is_last() );
+      test.execute( ReadAll( "hij" ) );
+      test.execute( IsFinished { true } );
+    }
+
+    {
+      ReassemblerTestHarness test { "bitmap: bytes beyond the window are dropped", 2, Bitmap };
+
+      test.execute( Insert { "xyz", 1 }.is_last() );
+      test.execute( BytesPending { 1 } );
+      test.execute( Insert { "w", 0 } );
+      test.execute( ReadAll( "wx" ) );
+      test.execute( IsFinished { false } );
+    }
+
+    auto rd = get_random_engine();
+    for ( const uint64_t capacity : { 1, 2, 63, 64, 65, 1000, 4096 } ) {
+      differential_test( capacity, 2000, rd );
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
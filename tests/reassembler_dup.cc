@@ -88,6 +88,19 @@ int main()
       test.execute( IsFinished { false } );
     }
 
+    {
+      ReassemblerTestHarness test { "dup of the last substring", 4 };
+
+      test.execute( Insert { "abcd", 0 } );
+      test.execute( BytesPushed( 4 ) );
+      test.execute( IsFinished { false } );
+
+      test.execute( Insert { "cd", 2 }.is_last() );
+      test.execute( IsFinished { false } );
+      test.execute( ReadAll( "abcd" ) );
+      test.execute( IsFinished { true } );
+    }
+
   } catch ( const exception& e ) {
     cerr << "Exception: " << e.what() << endl;
     return EXIT_FAILURE;
@@ -129,6 +129,21 @@ int main()
       test.execute( ReadAll( "" ) );
       test.execute( IsFinished { true } );
     }
+
+    for ( const auto engine : { Reassembler::Engine::Map, Reassembler::Engine::Bitmap } ) {
+      ReassemblerTestHarness test { "holes batch", 8, engine };
+
+      test.execute( InsertBatch { { Insert { "cd", 2 }, Insert { "ab", 0 }, Insert { "gh", 6 }.is_last() } } );
+      test.execute( BytesPushed( 4 ) );
+      test.execute( BytesPending( 2 ) );
+      test.execute( ReadAll( "abcd" ) );
+
+      test.execute( InsertBatch { { Insert { "ef", 4 } } } );
+      test.execute( BytesPushed( 8 ) );
+      test.execute( BytesPending( 0 ) );
+      test.execute( ReadAll( "efgh" ) );
+      test.execute( IsFinished { true } );
+    }
   } catch ( const exception& e ) {
     cerr << "Exception: " << e.what() << endl;
     return EXIT_FAILURE;
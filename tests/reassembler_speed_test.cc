@@ -3,49 +3,179 @@
 #include <algorithm>
 #include <chrono>
 #include <cstddef>
+#include <cstdlib>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
-#include <queue>
+#include <new>
 #include <random>
-#include <tuple>
+#include <span>
+#include <string>
+#include <vector>
 
 using namespace std;
 using namespace std::chrono;
 
-void speed_test( const size_t num_chunks,   // NOLINT(bugprone-easily-swappable-parameters)
-                 const size_t capacity,     // NOLINT(bugprone-easily-swappable-parameters)
-                 const size_t random_seed ) // NOLINT(bugprone-easily-swappable-parameters)
+// Count every heap allocation, so each run can report how many it made. (The deletes are kept
+// out of line so GCC doesn't mistake their free() for a mismatch with a built-in operator new.)
+static size_t allocation_count = 0; // NOLINT(*-avoid-non-const-global-variables)
+
+void* operator new( size_t size )
+{
+  ++allocation_count;
+  if ( void* ptr = malloc( max<size_t>( size, 1 ) ) ) { // NOLINT(*-no-malloc, *-owning-memory)
+    return ptr;
+  }
+  throw bad_alloc {};
+}
+
+[[gnu::noinline]] void operator delete( void* ptr ) noexcept
+{
+  free( ptr ); // NOLINT(*-no-malloc, *-owning-memory)
+}
+
+[[gnu::noinline]] void operator delete( void* ptr, size_t /* size */ ) noexcept
+{
+  free( ptr ); // NOLINT(*-no-malloc, *-owning-memory)
+}
+
+enum class Workload
+{
+  Overlapping, // three overlapping, out-of-order copies of each chunk
+  Batch,       // the overlapping copies, handed over three at a time with insert_batch()
+  InOrder,     // MSS-sized segments, always the next expected bytes
+  Reordered,   // MSS-sized segments, shuffled within each window
+  Duplicated,  // every MSS-sized segment three times, shuffled within each window
+  OneByte,     // 1-byte segments, in order
+  Interleaved, // 1-byte segments: every odd byte of the window, then the even bytes from the back
+};
+
+static string workload_name( Workload workload )
+{
+  switch ( workload ) {
+    case Workload::Overlapping:
+      return "overlapping";
+    case Workload::Batch:
+      return "batched";
+    case Workload::InOrder:
+      return "in-order";
+    case Workload::Reordered:
+      return "reordered";
+    case Workload::Duplicated:
+      return "duplicated";
+    case Workload::OneByte:
+      return "one-byte";
+    case Workload::Interleaved:
+      return "interleaved";
+  }
+  throw runtime_error( "unknown workload" );
+}
+
+static constexpr size_t mss = 1460;
+
+// Split `data` into segments. Every segment lies within a window of `capacity` bytes that starts at the
+// stream's next expected index, provided the reader drains the stream after each insert.
+static vector<Reassembler::Segment> make_segments( const Buffer& data,
+                                                   const size_t capacity,
+                                                   const Workload workload,
+                                                   default_random_engine& rd )
+{
+  vector<Reassembler::Segment> segments;
+  const auto add = [&]( size_t first_index, size_t len ) {
+    len = min( len, data.size() - first_index );
+    segments.push_back( { first_index, data.substr( first_index, len ), first_index + len == data.size() } );
+  };
+
+  for ( size_t window = 0; window < data.size(); window += capacity ) {
+    const size_t window_end = min( window + capacity, data.size() );
+    const size_t first_in_window = segments.size();
+
+    switch ( workload ) {
+      case Workload::Overlapping:
+      case Workload::Batch:
+        add( window + 2, capacity * 2 );
+        add( window, capacity * 2 );
+        add( window + 1, capacity * 2 );
+        break;
+
+      case Workload::InOrder:
+      case Workload::Reordered:
+        for ( size_t i = window; i < window_end; i += mss ) {
+          add( i, min( mss, window_end - i ) );
+        }
+        break;
+
+      case Workload::Duplicated:
+        for ( size_t i = window; i < window_end; i += mss ) {
+          for ( int copy = 0; copy < 3; copy++ ) {
+            add( i, min( mss, window_end - i ) );
+          }
+        }
+        break;
+
+      case Workload::OneByte:
+        for ( size_t i = window; i < window_end; i++ ) {
+          add( i, 1 );
+        }
+        break;
+
+      case Workload::Interleaved:
+        for ( size_t i = window + 1; i < window_end; i += 2 ) {
+          add( i, 1 );
+        }
+        for ( size_t i = ( window_end - window + 1 ) / 2; i > 0; i-- ) {
+          add( window + ( i - 1 ) * 2, 1 );
+        }
+        break;
+    }
+
+    if ( workload == Workload::Reordered or workload == Workload::Duplicated ) {
+      shuffle( segments.begin() + static_cast<ptrdiff_t>( first_in_window ), segments.end(), rd );
+    }
+  }
+
+  return segments;
+}
+
+void speed_test( const size_t num_bytes,   // NOLINT(bugprone-easily-swappable-parameters)
+                 const size_t capacity,    // NOLINT(bugprone-easily-swappable-parameters)
+                 const size_t random_seed, // NOLINT(bugprone-easily-swappable-parameters)
+                 const Reassembler::Engine engine,
+                 const Workload workload )
 {
+  default_random_engine rd { random_seed };
+
   // Generate the data to be written
   const string data = [&] {
-    default_random_engine rd { random_seed };
     uniform_int_distribution<char> ud;
     string ret;
-    for ( size_t i = 0; i < num_chunks * capacity; ++i ) {
+    ret.reserve( num_bytes );
+    for ( size_t i = 0; i < num_bytes; ++i ) {
       ret += ud( rd );
     }
     return ret;
   }();
 
-  // Split the data into segments before writing
-  queue<tuple<uint64_t, string, bool>> split_data;
-  for ( size_t i = 0; i < data.size(); i += capacity ) {
-    split_data.emplace( i + 2, data.substr( i + 2, capacity * 2 ), i + 2 + capacity * 2 >= data.size() );
-    split_data.emplace( i, data.substr( i, capacity * 2 ), i + capacity * 2 >= data.size() );
-    split_data.emplace( i + 1, data.substr( i + 1, capacity * 2 ), i + 1 + capacity * 2 >= data.size() );
-  }
+  // Split the data into segments (sharing one copy of the bytes) before writing
+  vector<Reassembler::Segment> split_data = make_segments( Buffer { data }, capacity, workload, rd );
+  const size_t batch_size = workload == Workload::Batch ? 3 : 1;
 
-  Reassembler reassembler { ByteStream { capacity } };
+  Reassembler reassembler { ByteStream { capacity }, engine };
 
   string output_data;
   output_data.reserve( data.size() );
 
+  uint64_t peak_pending = 0;
+  const size_t allocations_before = allocation_count;
   const auto start_time = steady_clock::now();
-  while ( not split_data.empty() ) {
-    auto& next = split_data.front();
-    reassembler.insert( get<uint64_t>( next ), move( get<string>( next ) ), get<bool>( next ) );
-    split_data.pop();
+  for ( size_t i = 0; i < split_data.size(); i += batch_size ) {
+    if ( batch_size == 1 ) {
+      auto& next = split_data[i];
+      reassembler.insert( next.first_index, move( next.data ), next.is_last_substring );
+    } else {
+      reassembler.insert_batch( span { split_data }.subspan( i, min( batch_size, split_data.size() - i ) ) );
+    }
+    peak_pending = max( peak_pending, reassembler.bytes_pending() );
 
     while ( reassembler.reader().bytes_buffered() ) {
       output_data += reassembler.reader().peek();
@@ -54,6 +184,7 @@ void speed_test( const size_t num_chunks,   // NOLINT(bugprone-easily-swappable-
   }
 
   const auto stop_time = steady_clock::now();
+  const size_t allocations = allocation_count - allocations_before;
 
   if ( not reassembler.reader().is_finished() ) {
     throw runtime_error( "Reassembler did not close ByteStream when finished" );
@@ -64,33 +195,73 @@ void speed_test( const size_t num_chunks,   // NOLINT(bugprone-easily-swappable-
   }
 
   auto test_duration = duration_cast<duration<double>>( stop_time - start_time );
-  auto bytes_per_second = static_cast<double>( num_chunks * capacity ) / test_duration.count();
-  auto bits_per_second = 8 * bytes_per_second;
-  auto gigabits_per_second = bits_per_second / 1e9;
+  auto ns_per_byte = test_duration.count() * 1e9 / static_cast<double>( num_bytes );
+  auto gigabits_per_second = 8 / ns_per_byte;
 
   fstream debug_output;
   debug_output.open( "/dev/tty" );
 
-  cout << "Reassembler to ByteStream with capacity=" << capacity << " reached " << fixed << setprecision( 2 )
-       << gigabits_per_second << " Gbit/s.\n";
+  const string engine_name = engine == Reassembler::Engine::Bitmap ? "bitmap" : "map";
 
-  debug_output << "             Reassembler throughput: " << fixed << setprecision( 2 ) << gigabits_per_second
-               << " Gbit/s\n";
+  // One JSON object per line, for scripts that track regressions or size receive buffers
+  cout << fixed << setprecision( 3 ) << R"({"engine": ")" << engine_name << R"(", "workload": ")"
+       << workload_name( workload ) << R"(", "capacity": )" << capacity << R"(, "bytes": )" << num_bytes
+       << R"(, "segments": )" << split_data.size() << R"(, "ns_per_byte": )" << ns_per_byte
+       << R"(, "gbit_per_s": )" << gigabits_per_second << R"(, "peak_bytes_pending": )" << peak_pending
+       << R"(, "allocations": )" << allocations << "}\n";
 
-  if ( gigabits_per_second < 0.1 ) {
+  debug_output << "             Reassembler (" << engine_name << ", " << workload_name( workload )
+               << ", capacity=" << capacity << ") throughput: " << fixed << setprecision( 2 )
+               << gigabits_per_second << " Gbit/s\n";
+
+  if ( workload == Workload::Overlapping and gigabits_per_second < 0.1 ) {
     throw runtime_error( "Reassembler did not meet minimum speed of 0.1 Gbit/s." );
   }
 }
 
-void program_body()
+void program_body( span<char*> args )
 {
-  speed_test( 10000, 1500, 1370 );
+  constexpr size_t seed = 1370;
+  constexpr size_t mib = 1 << 20;
+  const vector engines { Reassembler::Engine::Map, Reassembler::Engine::Bitmap };
+  const vector segment_workloads {
+    Workload::InOrder, Workload::Reordered, Workload::Duplicated, Workload::OneByte, Workload::Interleaved };
+
+  // With a capacity argument (e.g. 1073741824), run just the segment workloads at that capacity
+  if ( args.size() > 1 ) {
+    const size_t capacity = stoull( args[1] );
+    for ( const auto workload : segment_workloads ) {
+      for ( const auto engine : engines ) {
+        speed_test( max( capacity * 2, 15 * mib ), capacity, seed, engine, workload );
+      }
+    }
+    return;
+  }
+
+  for ( const auto engine : engines ) {
+    speed_test( 10000 * 1500, 1500, seed, engine, Workload::Overlapping );
+    speed_test( 10000 * 1500, 1500, seed, engine, Workload::Batch );
+  }
+
+  for ( const auto workload : segment_workloads ) {
+    const bool one_byte = workload == Workload::OneByte or workload == Workload::Interleaved;
+    for ( const size_t capacity : { size_t { 1500 }, size_t { mib } } ) {
+      for ( const auto engine : engines ) {
+        speed_test( one_byte ? mib : 16 * mib, capacity, seed, engine, workload );
+      }
+    }
+  }
+
+  for ( const auto engine : engines ) {
+    speed_test( 32 * mib, 16 * mib, seed, engine, Workload::InOrder );
+    speed_test( 32 * mib, 16 * mib, seed, engine, Workload::Reordered );
+  }
 }
 
-int main()
+int main( int argc, char* argv[] )
 {
   try {
-    program_body();
+    program_body( span( argv, argc ) );
   } catch ( const exception& e ) {
     cerr << "Exception: " << e.what() << "\n";
     return EXIT_FAILURE;
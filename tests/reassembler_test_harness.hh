@@ -7,6 +7,7 @@
 #include <optional>
 #include <sstream>
 #include <utility>
+#include <vector>
 
 template<std::derived_from<TestStep<ByteStream>> T>
 struct ReassemblerTestStep : public TestStep<Reassembler>
@@ -27,10 +28,13 @@ struct ReassemblerTestStep : public TestStep<Reassembler>
 class ReassemblerTestHarness : public TestHarness<Reassembler>
 {
 public:
-  ReassemblerTestHarness( std::string test_name, uint64_t capacity )
+  ReassemblerTestHarness( std::string test_name,
+                          uint64_t capacity,
+                          Reassembler::Engine engine = Reassembler::Engine::Map )
     : TestHarness( move( test_name ),
-                   "capacity=" + std::to_string( capacity ),
-                   { Reassembler { ByteStream { capacity } } } )
+                   "capacity=" + std::to_string( capacity )
+                     + ( engine == Reassembler::Engine::Bitmap ? ", engine=bitmap" : "" ),
+                   { Reassembler { ByteStream { capacity }, engine } } )
   {}
 
   template<std::derived_from<TestStep<ByteStream>> T>
@@ -75,3 +79,30 @@ struct Insert : public Action<Reassembler>
 
   void execute( Reassembler& r ) const override { r.insert( first_index_, data_, is_last_substring_ ); }
 };
+
+struct InsertBatch : public Action<Reassembler>
+{
+  std::vector<Insert> inserts_;
+
+  explicit InsertBatch( std::vector<Insert> inserts ) : inserts_( move( inserts ) ) {}
+
+  std::string description() const override
+  {
+    std::ostringstream ss;
+    ss << "insert batch {";
+    for ( const auto& insert : inserts_ ) {
+      ss << " " << insert.description() << ";";
+    }
+    ss << " }";
+    return ss.str();
+  }
+
+  void execute( Reassembler& r ) const override
+  {
+    std::vector<Reassembler::Segment> segments;
+    for ( const auto& insert : inserts_ ) {
+      segments.push_back( { insert.first_index_, insert.data_, insert.is_last_substring_ } );
+    }
+    r.insert_batch( segments );
+  }
+};
@@ -8,6 +8,7 @@
 #include <optional>
 #include <sstream>
 #include <utility>
+#include <vector>
 
 template<std::derived_from<TestStep<Reassembler>> T>
 struct DirectReassemblerTest : public TestStep<TCPReceiver>
@@ -40,10 +41,15 @@ struct DirectByteStreamTest : public TestStep<TCPReceiver>
 class TCPReceiverTestHarness : public TestHarness<TCPReceiver>
 {
 public:
-  TCPReceiverTestHarness( std::string test_name, uint64_t capacity )
+  TCPReceiverTestHarness( std::string test_name,
+                          uint64_t capacity,
+                          Reassembler::Engine engine = Reassembler::Engine::Map,
+                          uint8_t window_scale = 0 )
     : TestHarness( move( test_name ),
-                   "capacity=" + std::to_string( capacity ),
-                   { TCPReceiver { Reassembler { ByteStream { capacity } } } } )
+                   "capacity=" + std::to_string( capacity )
+                     + ( engine == Reassembler::Engine::Bitmap ? ", engine=bitmap" : "" )
+                     + ( window_scale ? ", window_scale=" + std::to_string( window_scale ) : "" ),
+                   { TCPReceiver { Reassembler { ByteStream { capacity }, engine }, window_scale } } )
   {}
 
   template<std::derived_from<TestStep<Reassembler>> T>
@@ -61,11 +67,11 @@ public:
   using TestHarness<TCPReceiver>::execute;
 };
 
-struct ExpectWindow : public ExpectNumber<TCPReceiver, uint16_t>
+struct ExpectWindow : public ExpectNumber<TCPReceiver, uint32_t>
 {
   using ExpectNumber::ExpectNumber;
   std::string name() const override { return "window_size"; }
-  uint16_t value( TCPReceiver& rs ) const override { return rs.send().window_size; }
+  uint32_t value( TCPReceiver& rs ) const override { return rs.send().window_size; }
 };
 
 struct ExpectAckno : public ExpectNumber<TCPReceiver, std::optional<Wrap32>>
@@ -111,6 +117,38 @@ struct ExpectAcknoBetween : public Expectation<TCPReceiver>
   }
 };
 
+struct ExpectSackBlocks : public Expectation<TCPReceiver>
+{
+  std::vector<std::pair<Wrap32, Wrap32>> blocks_;
+
+  explicit ExpectSackBlocks( std::vector<std::pair<Wrap32, Wrap32>> blocks ) : blocks_( std::move( blocks ) ) {}
+
+  static std::string describe( const std::vector<std::pair<Wrap32, Wrap32>>& blocks )
+  {
+    std::ostringstream ss;
+    ss << "{";
+    for ( const auto& [left, right] : blocks ) {
+      ss << " [" << left << ", " << right << ")";
+    }
+    ss << " }";
+    return ss.str();
+  }
+
+  std::string description() const override { return "SACK blocks are " + describe( blocks_ ); }
+
+  void execute( TCPReceiver& rs ) const override
+  {
+    std::vector<std::pair<Wrap32, Wrap32>> actual;
+    for ( const auto& block : rs.send().sack_blocks ) {
+      actual.emplace_back( block.left, block.right );
+    }
+    if ( actual != blocks_ ) {
+      throw ExpectationViolation( "The TCPReceiver should have sent SACK blocks " + describe( blocks_ )
+                                  + ", but instead it sent " + describe( actual ) + "." );
+    }
+  }
+};
+
 struct HasAckno : public ExpectBool<TCPReceiver>
 {
   using ExpectBool::ExpectBool;
@@ -135,6 +173,18 @@ struct SegmentArrives : public Action<TCPReceiver>
     return *this;
   }
 
+  SegmentArrives& with_sack_permitted()
+  {
+    msg_.SACK_permitted = true;
+    return *this;
+  }
+
+  SegmentArrives& with_window_scale( uint8_t window_scale )
+  {
+    msg_.window_scale = window_scale;
+    return *this;
+  }
+
   SegmentArrives& with_rst()
   {
     msg_.RST = true;
@@ -175,6 +225,12 @@ struct SegmentArrives : public Action<TCPReceiver>
     if ( msg_.SYN ) {
       ss << " +SYN";
     }
+    if ( msg_.SACK_permitted ) {
+      ss << " +SACK-permitted";
+    }
+    if ( msg_.window_scale.has_value() ) {
+      ss << " window_scale=" << static_cast<int>( msg_.window_scale.value() );
+    }
     if ( not msg_.payload.empty() ) {
       ss << " payload=\"" << Printer::prettify( msg_.payload ) << "\"";
     }
@@ -191,3 +247,30 @@ struct SegmentArrives : public Action<TCPReceiver>
     return ss.str();
   }
 };
+
+// Segments that arrive together, handed to the receiver with one receive_batch() (their ackno expectations unused)
+struct SegmentsArrive : public Action<TCPReceiver>
+{
+  std::vector<SegmentArrives> segments_;
+
+  explicit SegmentsArrive( std::vector<SegmentArrives> segments ) : segments_( std::move( segments ) ) {}
+
+  void execute( TCPReceiver& rs ) const override
+  {
+    std::vector<TCPSenderMessage> messages;
+    for ( const auto& segment : segments_ ) {
+      messages.push_back( segment.msg_ );
+    }
+    rs.receive_batch( messages );
+  }
+
+  std::string description() const override
+  {
+    std::string desc = "receive batch:";
+    for ( const auto& segment : segments_ ) {
+      const auto text = segment.description();
+      desc += " " + text.substr( text.find( '(' ), text.rfind( ')' ) - text.find( '(' ) + 1 );
+    }
+    return desc;
+  }
+};
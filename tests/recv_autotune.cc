@@ -0,0 +1,186 @@
+#include "random.hh"
+#include "tcp_peer.hh"
+#include "tcp_receiver.hh"
+#include "test_should_be.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+static constexpr uint64_t RTT_MS = 50;
+
+// A receiver behind a link with a fixed round-trip time. Every round, the sender fills the window that the
+// receiver last advertised, and the application reads what it is willing to (after which the receiver
+// advertises the window it opened).
+class AutotunedReceiver
+{
+public:
+  AutotunedReceiver( uint64_t initial_capacity, uint64_t max_capacity, uint64_t idle_ms, Wrap32 isn )
+    : receiver_( Reassembler { ByteStream { initial_capacity } } )
+    , tuner_( initial_capacity, max_capacity, idle_ms )
+    , isn_( isn )
+  {
+    receiver_.receive( { .seqno = isn_, .SYN = true } );
+    tuner_.update( receiver_, now_ms_, true, advertised_edge_ );
+    advertise();
+  }
+
+  // Run one round trip, with the application reading at most `read_limit` bytes
+  void round( uint64_t read_limit )
+  {
+    now_ms_ += RTT_MS;
+    transfer( advertised_edge_ - receiver_.writer().bytes_pushed(), read_limit );
+  }
+
+  // Send `len` bytes at once (within the window last advertised), with the application reading at most
+  // `read_limit` bytes
+  void transfer( uint64_t len, uint64_t read_limit )
+  {
+    for ( uint64_t sent = 0; sent < len; sent += SEGMENT_SIZE ) {
+      const uint64_t index = receiver_.writer().bytes_pushed();
+      const string payload( min( SEGMENT_SIZE, len - sent ), 'x' );
+      receiver_.receive( { .seqno = isn_ + 1 + index, .payload = payload } );
+      tuner_.update( receiver_, now_ms_, true, advertised_edge_ );
+    }
+    receiver_.reader().pop( min( read_limit, receiver_.reader().bytes_buffered() ) );
+    tuner_.update( receiver_, now_ms_, false, advertised_edge_ );
+    advertise();
+  }
+
+  void idle( uint64_t ms )
+  {
+    now_ms_ += ms;
+    tuner_.update( receiver_, now_ms_, false, advertised_edge_ );
+  }
+
+  // The window left of the one last advertised
+  uint64_t window() const { return advertised_edge_ - receiver_.writer().bytes_pushed(); }
+
+  TCPReceiver& receiver() { return receiver_; }
+  const ReceiveBufferTuner& tuner() const { return tuner_; }
+
+private:
+  static constexpr uint64_t SEGMENT_SIZE = 100;
+
+  TCPReceiver receiver_;
+  ReceiveBufferTuner tuner_;
+  Wrap32 isn_;
+  uint64_t now_ms_ {};
+  uint64_t advertised_edge_ {};
+
+  void advertise() { advertised_edge_ = receiver_.writer().bytes_pushed() + receiver_.send().window_size; }
+};
+
+int main()
+{
+  try {
+    auto rd = get_random_engine();
+
+    // A reader that keeps up lets the window grow, round by round, to the ceiling
+    {
+      AutotunedReceiver conn { 1000, 16000, 1000, Wrap32 { uniform_int_distribution<uint32_t>()( rd ) } };
+      uint64_t last_capacity = conn.receiver().capacity();
+      for ( int i = 0; i < 12; ++i ) {
+        conn.round( UINT64_MAX );
+        const uint64_t capacity = conn.receiver().capacity();
+        if ( capacity < last_capacity ) {
+          throw runtime_error( "receive buffer shrank while the reader kept up (capacity " + to_string( capacity )
+                               + ")" );
+        }
+        last_capacity = capacity;
+      }
+      test_should_be( conn.tuner().rtt_ms().value_or( 0 ), RTT_MS );
+      test_should_be( conn.receiver().capacity(), uint64_t { 16000 } );
+      test_should_be( conn.receiver().send().window_size, uint32_t { 16000 } );
+
+      // ... and an idle connection gives the memory back, but never takes back the window it offered: the
+      // window stops growing, and the buffer shrinks only as the peer uses the window up
+      conn.idle( 1000 );
+      test_should_be( conn.receiver().capacity(), uint64_t { 16000 } );
+      test_should_be( conn.window(), uint64_t { 16000 } );
+      conn.transfer( 6000, UINT64_MAX );
+      test_should_be( conn.receiver().capacity(), uint64_t { 10000 } );
+      test_should_be( conn.window(), uint64_t { 10000 } );
+      conn.transfer( 10000, UINT64_MAX );
+      test_should_be( conn.receiver().capacity(), uint64_t { 1000 } );
+      test_should_be( conn.window(), uint64_t { 1000 } );
+    }
+
+    // A reader that falls behind doesn't
+    {
+      AutotunedReceiver conn { 1000, 16000, 1000, Wrap32 { uniform_int_distribution<uint32_t>()( rd ) } };
+      for ( int i = 0; i < 10; ++i ) {
+        conn.round( 0 );
+      }
+      test_should_be( conn.receiver().capacity(), uint64_t { 1000 } );
+
+      // Nor does the buffer shrink while it still holds data
+      conn.idle( 5000 );
+      test_should_be( conn.receiver().reader().bytes_buffered(), uint64_t { 1000 } );
+    }
+
+    // The reader's pace, not the sender's, sets the size
+    {
+      AutotunedReceiver conn { 1000, 1000000, 1000, Wrap32 { uniform_int_distribution<uint32_t>()( rd ) } };
+      for ( int i = 0; i < 20; ++i ) {
+        conn.round( 3000 );
+      }
+      if ( conn.receiver().capacity() > 6000 ) {
+        throw runtime_error( "receive buffer grew beyond twice the reader's pace (capacity "
+                             + to_string( conn.receiver().capacity() ) + ")" );
+      }
+    }
+
+    // A peer that goes idle still takes a whole window it offered before
+    {
+      TCPConfig cfg;
+      cfg.recv_autotune = true;
+      cfg.recv_initial_capacity = 1000;
+      cfg.recv_capacity = 16000;
+      TCPPeer peer { cfg };
+
+      // The remote end's view: the edge of the window the peer last offered it
+      const Wrap32 isn { uniform_int_distribution<uint32_t>()( rd ) };
+      uint64_t offered_edge = 0;
+      const auto transmit = [&]( const TCPMessage& msg ) {
+        if ( msg.receiver.ackno.has_value() ) {
+          offered_edge = msg.receiver.ackno->unwrap( isn, offered_edge ) - 1 + msg.receiver.window_size;
+        }
+      };
+      const TCPReceiverMessage ack { .ackno = cfg.isn + 1, .window_size = UINT16_MAX };
+      const auto send_window = [&] {
+        for ( uint64_t index = peer.inbound_reader().bytes_popped() + peer.inbound_reader().bytes_buffered();
+              index < offered_edge;
+              index += cfg.mss ) {
+          const string payload( min<uint64_t>( cfg.mss, offered_edge - index ), 'x' );
+          peer.receive( { { .seqno = isn + 1 + index, .payload = payload }, ack }, transmit );
+        }
+      };
+
+      peer.receive( { { .seqno = isn, .SYN = true }, {} }, transmit );
+      for ( int i = 0; i < 12; ++i ) {
+        peer.tick( RTT_MS, transmit );
+        send_window();
+        peer.inbound_reader().pop( peer.inbound_reader().bytes_buffered() );
+        peer.update_window( transmit );
+      }
+      test_should_be( offered_edge - peer.receiver().writer().bytes_pushed(), uint64_t { 16000 } );
+
+      peer.tick( 2 * cfg.recv_idle_ms, transmit );
+      const uint64_t edge = offered_edge;
+      send_window();
+      test_should_be( peer.receiver().writer().bytes_pushed(), edge );
+      test_should_be( peer.receiver().reassembler().bytes_pending(), uint64_t { 0 } );
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
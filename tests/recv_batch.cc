@@ -0,0 +1,127 @@
+#include "random.hh"
+#include "receiver_test_harness.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Receive the same random segments one at a time and in batches, and check the two receivers always agree
+static void differential_test( Reassembler::Engine engine, default_random_engine& rd )
+{
+  constexpr uint64_t capacity = 1000;
+  const uint32_t isn = uniform_int_distribution<uint32_t> { 0, UINT32_MAX }( rd );
+  TCPReceiver one_at_a_time { Reassembler { ByteStream { capacity }, engine } };
+  TCPReceiver batched { Reassembler { ByteStream { capacity }, engine } };
+
+  string data( 5000, '\0' );
+  for ( auto& c : data ) {
+    c = static_cast<char>( 'a' + rd() % 26 );
+  }
+
+  vector<TCPSenderMessage> batch;
+  string out_one;
+  string out_batched;
+  for ( size_t step = 0; step < 2000 and out_one.size() < data.size(); ++step ) {
+    // mostly near the next byte wanted, now and then a SYN (again), the FIN, or a segment from before the SYN
+    TCPSenderMessage msg;
+    const uint64_t wanted = one_at_a_time.writer().bytes_pushed();
+    const uint64_t index = min<uint64_t>( data.size(), wanted + rd() % 200 - min<uint64_t>( wanted, 50 ) );
+    const uint64_t len = min<uint64_t>( data.size() - index, rd() % 100 );
+    msg.seqno = Wrap32::wrap( index + 1, Wrap32 { isn } );
+    msg.payload = data.substr( index, len );
+    msg.FIN = index + len == data.size() and rd() % 4 == 0;
+    if ( step == 0 or rd() % 50 == 0 ) {
+      msg = { .seqno = Wrap32 { isn }, .SYN = true };
+    }
+    batch.push_back( msg );
+    one_at_a_time.receive( move( msg ) );
+
+    if ( rd() % 5 == 0 ) {
+      batched.receive_batch( batch );
+      batch.clear();
+
+      // both read at the same moments
+      string chunk;
+      read( one_at_a_time.reader(), rd() % 300, chunk );
+      out_one += chunk;
+      read( batched.reader(), chunk.size(), chunk );
+      out_batched += chunk;
+      if ( out_one != out_batched or one_at_a_time.send().ackno != batched.send().ackno
+           or one_at_a_time.send().window_size != batched.send().window_size
+           or one_at_a_time.writer().is_closed() != batched.writer().is_closed() ) {
+        throw runtime_error( "receive_batch() disagrees with receive() at step " + to_string( step ) );
+      }
+    }
+  }
+}
+
+int main()
+{
+  try {
+    auto rd = get_random_engine();
+
+    {
+      const uint32_t isn = uniform_int_distribution<uint32_t> { 0, UINT32_MAX }( rd );
+      TCPReceiverTestHarness test { "batch: SYN and data in order", 4000 };
+      test.execute( SegmentsArrive { { SegmentArrives {}.with_syn().with_seqno( isn ),
+                                       SegmentArrives {}.with_seqno( isn + 1 ).with_data( "abcd" ),
+                                       SegmentArrives {}.with_seqno( isn + 5 ).with_data( "efgh" ) } } );
+      test.execute( ExpectAckno { Wrap32 { isn + 9 } } );
+      test.execute( ExpectWindow { 3992 } );
+      test.execute( ReadAll { "abcdefgh" } );
+    }
+
+    {
+      const uint32_t isn = uniform_int_distribution<uint32_t> { 0, UINT32_MAX }( rd );
+      TCPReceiverTestHarness test { "batch: out of order, with the FIN", 4000 };
+      test.execute( SegmentArrives {}.with_syn().with_seqno( isn ) );
+      test.execute( SegmentsArrive { { SegmentArrives {}.with_seqno( isn + 9 ).with_data( "ijkl" ).with_fin(),
+                                       SegmentArrives {}.with_seqno( isn + 5 ).with_data( "efgh" ),
+                                       SegmentArrives {}.with_seqno( isn + 7 ).with_data( "gh" ) } } );
+      test.execute( ExpectAckno { Wrap32 { isn + 1 } } );
+      test.execute( BytesPending { 8 } );
+      test.execute( SegmentsArrive { { SegmentArrives {}.with_seqno( isn + 1 ).with_data( "abcd" ) } } );
+      test.execute( ExpectAckno { Wrap32 { isn + 14 } } );
+      test.execute( ReadAll { "abcdefghijkl" } );
+      test.execute( IsFinished { true } );
+    }
+
+    {
+      const uint32_t isn = uniform_int_distribution<uint32_t> { 0, UINT32_MAX }( rd );
+      TCPReceiverTestHarness test { "batch: data before the SYN is dropped", 4000 };
+      test.execute( SegmentsArrive { { SegmentArrives {}.with_seqno( isn + 1 ).with_data( "abcd" ),
+                                       SegmentArrives {}.with_syn().with_seqno( isn ),
+                                       SegmentArrives {}.with_seqno( isn + 5 ).with_data( "efgh" ) } } );
+      test.execute( ExpectAckno { Wrap32 { isn + 1 } } );
+      test.execute( BytesPending { 4 } );
+    }
+
+    {
+      const uint32_t isn = uniform_int_distribution<uint32_t> { 0, UINT32_MAX }( rd );
+      TCPReceiverTestHarness test { "batch: RST ends it", 4000 };
+      test.execute( SegmentsArrive { { SegmentArrives {}.with_syn().with_seqno( isn ),
+                                       SegmentArrives {}.with_seqno( isn + 1 ).with_data( "abcd" ),
+                                       SegmentArrives {}.with_seqno( isn + 5 ).with_rst(),
+                                       SegmentArrives {}.with_seqno( isn + 5 ).with_data( "efgh" ) } } );
+      test.execute( ExpectReset { true } );
+      test.execute( BytesPushed { 4 } );
+    }
+
+    for ( const auto engine : { Reassembler::Engine::Map, Reassembler::Engine::Bitmap } ) {
+      for ( size_t i = 0; i < 20; ++i ) {
+        differential_test( engine, rd );
+      }
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
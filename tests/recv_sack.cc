@@ -0,0 +1,143 @@
+#include "random.hh"
+#include "receiver_test_harness.hh"
+#include "tcp_segment.hh"
+#include "test_should_be.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+using namespace std;
+
+// Serialize a segment carrying the SACK options, and check they survive being parsed back
+// With all of a SYN's options (`syn`), only three SACK blocks fit in the 40 bytes of options; otherwise, all four
+static void check_options_roundtrip( default_random_engine& rd, bool syn )
+{
+  const uint32_t isn = uniform_int_distribution<uint32_t> { 0, UINT32_MAX }( rd );
+
+  TCPSegment original;
+  original.message.sender.seqno = Wrap32 { isn };
+  original.message.sender.SYN = syn;
+  original.message.sender.SACK_permitted = syn;
+  if ( syn ) {
+    original.message.sender.mss = 1000;
+    original.message.sender.window_scale = 7;
+  }
+  original.message.sender.payload = string { "hello" };
+  original.message.receiver.ackno = Wrap32 { isn + 100 };
+  original.message.receiver.window_size = 1234;
+  for ( uint32_t i = 0; i < TCPReceiverMessage::MAX_SACK_BLOCKS + 1; i++ ) {
+    const Wrap32 left { isn + 200 + 20 * i };
+    original.message.receiver.sack_blocks.push_back( { left, left + 10 } );
+  }
+  original.compute_checksum( 0 );
+  const size_t blocks_sent = syn ? 3 : TCPReceiverMessage::MAX_SACK_BLOCKS;
+  test_should_be( original.header_length(), size_t { 20 + ( syn ? 12 : 0 ) + 4 + 8 * blocks_sent } );
+
+  TCPSegment parsed;
+  if ( not parse( parsed, serialize( original ), 0 ) ) {
+    throw runtime_error( "segment with SACK options failed to parse" );
+  }
+
+  const auto& sender = parsed.message.sender;
+  const auto& receiver = parsed.message.receiver;
+  if ( sender.SYN != syn or sender.SACK_permitted != syn or sender.payload.view() != "hello" ) {
+    throw runtime_error( "SYN, SACK-permitted or payload did not survive a roundtrip" );
+  }
+  if ( syn and ( sender.mss != uint16_t { 1000 } or sender.window_scale != uint8_t { 7 } ) ) {
+    throw runtime_error( "MSS or window scale did not survive a roundtrip" );
+  }
+  if ( receiver.ackno != Wrap32 { isn + 100 } ) {
+    throw runtime_error( "ackno did not survive a roundtrip" );
+  }
+  test_should_be( receiver.window_size, uint32_t { 1234 } );
+
+  // Only as many blocks as fit in the options are sent
+  test_should_be( receiver.sack_blocks.size(), blocks_sent );
+  for ( size_t i = 0; i < receiver.sack_blocks.size(); i++ ) {
+    test_should_be( receiver.sack_blocks[i].left, original.message.receiver.sack_blocks[i].left );
+    test_should_be( receiver.sack_blocks[i].right, original.message.receiver.sack_blocks[i].right );
+  }
+}
+
+int main()
+{
+  try {
+    auto rd = get_random_engine();
+
+    check_options_roundtrip( rd, false );
+    check_options_roundtrip( rd, true );
+
+    for ( const auto engine : { Reassembler::Engine::Map, Reassembler::Engine::Bitmap } ) {
+      {
+        const uint32_t isn = uniform_int_distribution<uint32_t> { 0, UINT32_MAX }( rd );
+        TCPReceiverTestHarness test { "no SACK blocks unless the SYN permits them", 2358, engine };
+        test.execute( SegmentArrives {}.with_syn().with_seqno( isn ) );
+        test.execute( SegmentArrives {}.with_seqno( isn + 5 ).with_data( "efgh" ) );
+        test.execute( BytesPending { 4 } );
+        test.execute( ExpectSackBlocks { {} } );
+      }
+
+      {
+        const uint32_t isn = uniform_int_distribution<uint32_t> { 0, UINT32_MAX }( rd );
+        TCPReceiverTestHarness test { "SACK blocks report what is held past the ackno", 2358, engine };
+        test.execute( SegmentArrives {}.with_syn().with_sack_permitted().with_seqno( isn ) );
+        test.execute( ExpectSackBlocks { {} } );
+
+        test.execute( SegmentArrives {}.with_seqno( isn + 5 ).with_data( "efgh" ) );
+        test.execute( ExpectAckno { Wrap32 { isn + 1 } } );
+        test.execute( ExpectSackBlocks { { { Wrap32 { isn + 5 }, Wrap32 { isn + 9 } } } } );
+
+        // The most recent arrival comes first
+        test.execute( SegmentArrives {}.with_seqno( isn + 13 ).with_data( "mn" ) );
+        test.execute( ExpectSackBlocks {
+          { { Wrap32 { isn + 13 }, Wrap32 { isn + 15 } }, { Wrap32 { isn + 5 }, Wrap32 { isn + 9 } } } } );
+
+        // Blocks that come to touch are merged
+        test.execute( SegmentArrives {}.with_seqno( isn + 9 ).with_data( "ijkl" ) );
+        test.execute( ExpectSackBlocks { { { Wrap32 { isn + 5 }, Wrap32 { isn + 15 } } } } );
+
+        // Filling the hole leaves nothing to report
+        test.execute( SegmentArrives {}.with_seqno( isn + 1 ).with_data( "abcd" ) );
+        test.execute( ExpectAckno { Wrap32 { isn + 15 } } );
+        test.execute( ExpectSackBlocks { {} } );
+        test.execute( ReadAll { "abcdefghijklmn" } );
+      }
+
+      {
+        const uint32_t isn = uniform_int_distribution<uint32_t> { 0, UINT32_MAX }( rd );
+        TCPReceiverTestHarness test { "more holes than SACK blocks", 2358, engine };
+        test.execute( SegmentArrives {}.with_syn().with_sack_permitted().with_seqno( isn ) );
+        for ( const uint32_t offset : { 3, 5, 7, 11, 9 } ) {
+          test.execute( SegmentArrives {}.with_seqno( isn + offset ).with_data( "x" ) );
+        }
+        test.execute( ExpectSackBlocks { { { Wrap32 { isn + 9 }, Wrap32 { isn + 10 } },
+                                           { Wrap32 { isn + 3 }, Wrap32 { isn + 4 } },
+                                           { Wrap32 { isn + 5 }, Wrap32 { isn + 6 } },
+                                           { Wrap32 { isn + 7 }, Wrap32 { isn + 8 } } } } );
+      }
+
+      {
+        const uint32_t isn = uniform_int_distribution<uint32_t> { 0, UINT32_MAX }( rd );
+        TCPReceiverTestHarness test { "SACK block across the end of the window's storage", 8, engine };
+        test.execute( SegmentArrives {}.with_syn().with_sack_permitted().with_seqno( isn ) );
+        test.execute( SegmentArrives {}.with_seqno( isn + 1 ).with_data( "abcdef" ) );
+        test.execute( ReadAll { "abcdef" } );
+        test.execute( SegmentArrives {}.with_seqno( isn + 8 ).with_data( "hij" ) );
+        test.execute( BytesPending { 3 } );
+        test.execute( ExpectSackBlocks { { { Wrap32 { isn + 8 }, Wrap32 { isn + 11 } } } } );
+        test.execute( SegmentArrives {}.with_seqno( isn + 7 ).with_data( "g" ) );
+        test.execute( ExpectSackBlocks { {} } );
+        test.execute( ReadAll { "ghij" } );
+      }
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
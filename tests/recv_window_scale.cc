@@ -0,0 +1,104 @@
+#include "random.hh"
+#include "receiver_test_harness.hh"
+#include "tcp_segment.hh"
+#include "test_should_be.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+// Serialize a segment with the given window and shift, and parse it back with the same shift
+static TCPSegment wire_roundtrip( const TCPSegment& original )
+{
+  TCPSegment parsed { .window_shift = original.window_shift };
+  if ( not parse( parsed, serialize( original ), 0 ) ) {
+    throw runtime_error( "segment failed to parse" );
+  }
+  return parsed;
+}
+
+static void check_wire_format( default_random_engine& rd )
+{
+  const uint32_t isn = uniform_int_distribution<uint32_t> { 0, UINT32_MAX }( rd );
+
+  // A SYN's window is never scaled, and the option carries the shift count
+  TCPSegment syn;
+  syn.message.sender.seqno = Wrap32 { isn };
+  syn.message.sender.SYN = true;
+  syn.message.sender.window_scale = 7;
+  syn.message.receiver.window_size = 70000;
+  syn.window_shift = 7;
+  syn.compute_checksum( 0 );
+  test_should_be( syn.header_length(), size_t { 24 } );
+  TCPSegment parsed = wire_roundtrip( syn );
+  if ( parsed.message.sender.window_scale != uint8_t { 7 } ) {
+    throw runtime_error( "window-scale option did not survive a roundtrip" );
+  }
+  test_should_be( parsed.message.receiver.window_size, uint32_t { UINT16_MAX } );
+
+  // Shift counts beyond 14 are treated as 14
+  syn.message.sender.window_scale = 20;
+  syn.compute_checksum( 0 );
+  if ( wire_roundtrip( syn ).message.sender.window_scale != TCPReceiverMessage::MAX_WINDOW_SCALE ) {
+    throw runtime_error( "window-scale option was not limited to 14" );
+  }
+
+  // Later windows are sent in units of 2^shift bytes
+  TCPSegment data;
+  data.message.sender.seqno = Wrap32 { isn + 1 };
+  data.message.sender.payload = string { "hello" };
+  data.message.receiver.ackno = Wrap32 { isn + 1 };
+  data.message.receiver.window_size = 999936;
+  data.window_shift = 7;
+  data.compute_checksum( 0 );
+  test_should_be( data.header_length(), size_t { 20 } );
+  test_should_be( wire_roundtrip( data ).message.receiver.window_size, uint32_t { 999936 } );
+}
+
+int main()
+{
+  try {
+    auto rd = get_random_engine();
+
+    check_wire_format( rd );
+
+    {
+      const uint32_t isn = uniform_int_distribution<uint32_t> { 0, UINT32_MAX }( rd );
+      TCPReceiverTestHarness test { "no scaling unless the peer's SYN offers it", 1000000, {}, 7 };
+      test.execute( SegmentArrives {}.with_syn().with_seqno( isn ) );
+      test.execute( ExpectWindow { UINT16_MAX } );
+    }
+
+    {
+      const uint32_t isn = uniform_int_distribution<uint32_t> { 0, UINT32_MAX }( rd );
+      TCPReceiverTestHarness test { "no scaling unless configured", 1000000 };
+      test.execute( SegmentArrives {}.with_syn().with_window_scale( 7 ).with_seqno( isn ) );
+      test.execute( ExpectWindow { UINT16_MAX } );
+    }
+
+    {
+      const uint32_t isn = uniform_int_distribution<uint32_t> { 0, UINT32_MAX }( rd );
+      TCPReceiverTestHarness test { "scaled window, rounded down to the unit", 1000000, {}, 7 };
+      test.execute( SegmentArrives {}.with_syn().with_window_scale( 2 ).with_seqno( isn ) );
+      test.execute( ExpectWindow { 999936 } );
+      test.execute( SegmentArrives {}.with_seqno( isn + 1 ).with_data( string( 1000, 'x' ) ) );
+      test.execute( ExpectWindow { 998912 } );
+    }
+
+    {
+      const uint32_t isn = uniform_int_distribution<uint32_t> { 0, UINT32_MAX }( rd );
+      TCPReceiverTestHarness test { "scaled window at its max", 10000000, {}, 7 };
+      test.execute( SegmentArrives {}.with_syn().with_window_scale( 7 ).with_seqno( isn ) );
+      test.execute( ExpectWindow { uint32_t { UINT16_MAX } << 7 } );
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
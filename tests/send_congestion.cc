@@ -0,0 +1,113 @@
+#include "random.hh"
+#include "sender_test_harness.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+int main()
+{
+  try {
+    auto rd = get_random_engine();
+    const string data( 20000, 'x' );
+
+    for ( const auto algorithm : { CongestionControl::Algorithm::Reno,
+                                   CongestionControl::Algorithm::NewReno,
+                                   CongestionControl::Algorithm::Cubic } ) {
+      {
+        TCPConfig cfg;
+        const Wrap32 isn( rd() );
+        cfg.isn = isn;
+        cfg.congestion_control = algorithm;
+
+        TCPSenderTestHarness test { "Initial window limits the first flight, then slow start grows it", cfg };
+        test.execute( Push {} );
+        test.execute( ExpectMessage {}.with_no_flags().with_syn( true ).with_payload_size( 0 ).with_seqno( isn ) );
+        test.execute( ExpectCongestionWindow { 10000 } );
+        test.execute( AckReceived { isn + 1 }.with_win( 40000 ) );
+        test.execute( ExpectCongestionWindow { 10001 } );
+        test.execute( Push { data } );
+        test.execute( ExpectSeqnosInFlight { 10000 } ); // no runt segment for the window's last byte
+        test.execute( AckReceived { isn + 1 + 10000 }.with_win( 40000 ) );
+        test.execute( ExpectCongestionWindow { 20001 } );
+        test.execute( ExpectSeqnosInFlight { 10000 } );
+      }
+
+      {
+        TCPConfig cfg;
+        const Wrap32 isn( rd() );
+        cfg.isn = isn;
+        cfg.congestion_control = algorithm;
+
+        TCPSenderTestHarness test { "Receiver's window limits when smaller than the congestion window", cfg };
+        test.execute( Push {} );
+        test.execute( ExpectMessage {}.with_no_flags().with_syn( true ).with_payload_size( 0 ).with_seqno( isn ) );
+        test.execute( AckReceived { isn + 1 }.with_win( 4 ) );
+        test.execute( Push { "abcdefg" } );
+        test.execute( ExpectMessage {}.with_no_flags().with_data( "abcd" ) );
+        test.execute( ExpectNoSegment {} );
+      }
+
+      {
+        TCPConfig cfg;
+        const Wrap32 isn( rd() );
+        cfg.isn = isn;
+        cfg.congestion_control = algorithm;
+        const uint64_t ssthresh = algorithm == CongestionControl::Algorithm::Cubic ? 7000 : 5000;
+
+        TCPSenderTestHarness test { "Timeout collapses the window to one segment", cfg };
+        test.execute( Push {} );
+        test.execute( ExpectMessage {}.with_no_flags().with_syn( true ).with_payload_size( 0 ).with_seqno( isn ) );
+        test.execute( AckReceived { isn + 1 }.with_win( 40000 ) );
+        test.execute( Push { data } );
+        test.execute( ExpectSeqnosInFlight { 10000 } );
+        test.execute( Tick { cfg.rt_timeout } );
+        test.execute( ExpectCongestionWindow { 1000 } );
+        test.execute( ExpectSlowStartThreshold { ssthresh } );
+
+        // A second timeout for the same data doesn't shrink the threshold again
+        test.execute( Tick { 2ULL * cfg.rt_timeout } );
+        test.execute( ExpectConsecutiveRetransmissions { 2 } );
+        test.execute( ExpectSlowStartThreshold { ssthresh } );
+
+        // Acknowledging the first segment (in slow start) lets two more out
+        test.execute( AckReceived { isn + 1 + 1000 }.with_win( 40000 ) );
+        test.execute( ExpectCongestionWindow { 2000 } );
+        test.execute( ExpectSeqnosInFlight { 9000 } );
+      }
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.congestion_control = CongestionControl::Algorithm::Reno;
+
+      TCPSenderTestHarness test { "Reno grows by one segment per window in congestion avoidance", cfg };
+      test.execute( Push {} );
+      test.execute( AckReceived { isn + 1 }.with_win( 40000 ) );
+      test.execute( Push { data } );
+      test.execute( Tick { cfg.rt_timeout } );
+      test.execute( ExpectSlowStartThreshold { 5000 } );
+
+      // Slow start up to the threshold...
+      test.execute( AckReceived { isn + 1 + 4000 }.with_win( 40000 ) );
+      test.execute( ExpectCongestionWindow { 5000 } );
+
+      // ...then one more segment once a whole window's worth has been acknowledged
+      test.execute( AckReceived { isn + 1 + 8000 }.with_win( 40000 ) );
+      test.execute( ExpectCongestionWindow { 5000 } );
+      test.execute( AckReceived { isn + 1 + 10000 }.with_win( 40000 ) );
+      test.execute( ExpectCongestionWindow { 6000 } );
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,140 @@
+#include "random.hh"
+#include "sender_test_harness.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+// Connect, then send `count` full segments (with a window large enough not to matter)
+static void send_segments( TCPSenderTestHarness& test, Wrap32 isn, uint64_t count )
+{
+  test.execute( Push {} );
+  test.execute( ExpectMessage {}.with_no_flags().with_syn( true ).with_payload_size( 0 ).with_seqno( isn ) );
+  test.execute( AckReceived { isn + 1 }.with_win( 40000 ) );
+  test.execute( Push { string( count * 1000, 'x' ) } );
+  for ( uint64_t i = 0; i < count; i++ ) {
+    test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 1 + i * 1000 ) );
+  }
+  test.execute( ExpectNoSegment {} );
+}
+
+int main()
+{
+  try {
+    auto rd = get_random_engine();
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.congestion_control = CongestionControl::Algorithm::NewReno;
+
+      TCPSenderTestHarness test { "NewReno fast retransmit and recovery", cfg };
+      send_segments( test, isn, 8 );
+
+      // The third duplicate ACK resends the first segment and halves the window
+      test.execute( AckReceived { isn + 1 }.with_win( 40000 ) );
+      test.execute( AckReceived { isn + 1 }.with_win( 40000 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( AckReceived { isn + 1 }.with_win( 40000 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 1 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectFastRecovery { true } );
+      test.execute( ExpectCongestionWindow { 4000 } );
+
+      // Further duplicates inflate the window until new data can go out
+      test.execute( Push { string( 4000, 'y' ) } );
+      test.execute( ExpectNoSegment {} );
+      test.execute( AckReceived { isn + 1 }.with_win( 40000 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( AckReceived { isn + 1 }.with_win( 40000 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 8001 ) );
+      test.execute( ExpectNoSegment {} );
+
+      // A partial ACK resends the next hole and stays in recovery
+      test.execute( AckReceived { isn + 3001 }.with_win( 40000 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 3001 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 9001 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectFastRecovery { true } );
+
+      // A full ACK ends recovery, with the window deflated to ssthresh
+      test.execute( AckReceived { isn + 9001 }.with_win( 40000 ) );
+      test.execute( ExpectFastRecovery { false } );
+      test.execute( ExpectCongestionWindow { 4000 } );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 10001 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 11001 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectSeqnosInFlight { 3000 } );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.congestion_control = CongestionControl::Algorithm::Reno;
+
+      TCPSenderTestHarness test { "Reno leaves recovery at the first new ACK", cfg };
+      send_segments( test, isn, 8 );
+      for ( int i = 0; i < 3; i++ ) {
+        test.execute( AckReceived { isn + 1 }.with_win( 40000 ) );
+      }
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 1 ) );
+      test.execute( ExpectFastRecovery { true } );
+
+      test.execute( AckReceived { isn + 3001 }.with_win( 40000 ) );
+      test.execute( ExpectFastRecovery { false } );
+      test.execute( ExpectCongestionWindow { 4000 } );
+      test.execute( ExpectNoSegment {} );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.congestion_control = CongestionControl::Algorithm::Cubic;
+
+      TCPSenderTestHarness test { "Window updates are not duplicate ACKs", cfg };
+      send_segments( test, isn, 4 );
+      test.execute( AckReceived { isn + 1 }.with_win( 40001 ) );
+      test.execute( AckReceived { isn + 1 }.with_win( 40002 ) );
+      test.execute( AckReceived { isn + 1 }.with_win( 40003 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectFastRecovery { false } );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.congestion_control = CongestionControl::Algorithm::Cubic;
+
+      TCPSenderTestHarness test { "Duplicate ACKs for data sent before a timeout don't retransmit", cfg };
+      send_segments( test, isn, 4 );
+      test.execute( Tick { cfg.rt_timeout } );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 1 ) );
+      for ( int i = 0; i < 3; i++ ) {
+        test.execute( AckReceived { isn + 1 }.with_win( 40000 ) );
+      }
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectFastRecovery { false } );
+
+      // But each ACK that falls short of what was outstanding at the timeout resends the next segment
+      test.execute( AckReceived { isn + 1001 }.with_win( 40000 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 1001 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( AckReceived { isn + 4001 }.with_win( 40000 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectSeqnosInFlight { 0 } );
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
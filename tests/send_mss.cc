@@ -0,0 +1,194 @@
+#include "random.hh"
+#include "sender_test_harness.hh"
+#include "tcp_segment.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+static void check_wire_format()
+{
+  TCPSegment syn;
+  syn.message.sender.SYN = true;
+  syn.message.sender.mss = 1460;
+  syn.message.sender.window_scale = 7;
+  syn.compute_checksum( 0 );
+  if ( syn.header_length() != 28 ) {
+    throw runtime_error( "MSS option did not take 4 bytes" );
+  }
+
+  TCPSegment parsed;
+  if ( not parse( parsed, serialize( syn ), 0 ) ) {
+    throw runtime_error( "segment failed to parse" );
+  }
+  if ( parsed.message.sender.mss != uint16_t { 1460 } or parsed.message.sender.window_scale != uint8_t { 7 } ) {
+    throw runtime_error( "MSS option did not survive a roundtrip" );
+  }
+}
+
+// Connect, with a window large enough not to matter
+static void connect( TCPSenderTestHarness& test, Wrap32 isn )
+{
+  test.execute( Push {} );
+  test.execute( ExpectMessage {}.with_syn( true ).with_payload_size( 0 ).with_seqno( isn ) );
+  test.execute( AckReceived { isn + 1 }.with_win( 40000 ) );
+}
+
+int main()
+{
+  try {
+    auto rd = get_random_engine();
+
+    check_wire_format();
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.mss = 1460;
+
+      TCPSenderTestHarness test { "Payloads are cut at the configured MSS, which the SYN advertises", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ).with_mss( 1460 ).with_seqno( isn ) );
+      test.execute( AckReceived { isn + 1 }.with_win( 40000 ) );
+      test.execute( Push { string( 3000, 'x' ) } );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1460 ).with_seqno( isn + 1 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1460 ).with_seqno( isn + 1461 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 80 ).with_seqno( isn + 2921 ) );
+      test.execute( ExpectNoSegment {} );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.mss = 1460;
+
+      TCPSenderTestHarness test { "The peer's MSS limits payloads", cfg };
+      test.execute( LimitMSS { 536 } );
+      test.execute( ExpectMSS { 536 } );
+      connect( test, isn );
+      test.execute( Push { string( 1000, 'x' ) } );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 536 ).with_seqno( isn + 1 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 464 ).with_seqno( isn + 537 ) );
+      test.execute( ExpectNoSegment {} );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.mss = 1460;
+      cfg.path_mtu_discovery = true;
+
+      TCPSenderTestHarness test { "A path MTU probe that gets through raises the MSS", cfg };
+      connect( test, isn );
+      test.execute( ExpectMSS { TCPConfig::MAX_PAYLOAD_SIZE } );
+      test.execute( Push { string( 4000, 'x' ) } );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1460 ).with_seqno( isn + 1 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 1461 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 2461 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 540 ).with_seqno( isn + 3461 ) );
+      test.execute( ExpectNoSegment {} );
+
+      test.execute( AckReceived { isn + 1461 }.with_win( 40000 ) );
+      test.execute( ExpectMSS { 1460 } );
+      test.execute( AckReceived { isn + 4001 }.with_win( 40000 ) );
+      test.execute( Push { string( 3000, 'y' ) } );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1460 ).with_seqno( isn + 4001 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1460 ).with_seqno( isn + 5461 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 80 ).with_seqno( isn + 6921 ) );
+      test.execute( ExpectNoSegment {} );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.mss = 1460;
+      cfg.path_mtu_discovery = true;
+
+      TCPSenderTestHarness test { "A lost probe is resent in pieces, without backoff", cfg };
+      connect( test, isn );
+      test.execute( Push { string( 2460, 'x' ) } );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1460 ).with_seqno( isn + 1 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 1461 ) );
+      test.execute( Tick { cfg.rt_timeout } );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 1 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 460 ).with_seqno( isn + 1001 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectRTO { cfg.rt_timeout } );
+      test.execute( ExpectConsecutiveRetransmissions { 0 } );
+      test.execute( ExpectMSS { TCPConfig::MAX_PAYLOAD_SIZE } );
+
+      // The next probe tries halfway between what got through and what didn't
+      test.execute( AckReceived { isn + 2461 }.with_win( 40000 ) );
+      test.execute( Push { string( 3000, 'y' ) } );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1230 ).with_seqno( isn + 2461 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 3691 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 770 ).with_seqno( isn + 4691 ) );
+      test.execute( ExpectNoSegment {} );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.mss = 1460;
+      cfg.path_mtu_discovery = true;
+      cfg.congestion_control = CongestionControl::Algorithm::Reno;
+
+      TCPSenderTestHarness test { "Duplicate ACKs for a lost probe don't shrink the congestion window", cfg };
+      connect( test, isn );
+      test.execute( Push { string( 4460, 'x' ) } );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1460 ).with_seqno( isn + 1 ) );
+      for ( uint64_t i = 0; i < 3; i++ ) {
+        const Wrap32 seqno = isn + 1461 + i * 1000;
+        test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( seqno ) );
+      }
+      test.execute( ExpectNoSegment {} );
+      for ( int i = 0; i < 3; i++ ) {
+        test.execute( AckReceived { isn + 1 }.with_win( 40000 ) );
+      }
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 1 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 460 ).with_seqno( isn + 1001 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectFastRecovery { false } );
+      test.execute( ExpectCongestionWindow { 10 * TCPConfig::MAX_PAYLOAD_SIZE + 1 } ); // as it was after the SYN
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.mss = 1460;
+      cfg.path_mtu_discovery = true;
+
+      TCPSenderTestHarness test { "Repeated timeouts fall back to the base MSS", cfg };
+      connect( test, isn );
+      test.execute( Push { string( 1460, 'x' ) } );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1460 ).with_seqno( isn + 1 ) );
+      test.execute( AckReceived { isn + 1461 }.with_win( 40000 ) );
+      test.execute( ExpectMSS { 1460 } );
+
+      test.execute( Push { string( 1460, 'y' ) } );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1460 ).with_seqno( isn + 1461 ) );
+      test.execute( Tick { cfg.rt_timeout } );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1460 ).with_seqno( isn + 1461 ) );
+      test.execute( Tick { 2U * cfg.rt_timeout } );
+      test.execute( ExpectMSS { TCPConfig::MAX_PAYLOAD_SIZE } );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 1461 ) );
+      test.execute( ExpectNoSegment {} );
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
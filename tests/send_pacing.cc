@@ -0,0 +1,135 @@
+#include "random.hh"
+#include "sender_test_harness.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <string>
+
+using namespace std;
+
+// Connect after a 100 ms round trip, with a receive window large enough not to matter. With Reno's initial
+// window (10000, and one more for the SYN's ACK) in slow start, the pacing rate is 2 * 10001 bytes per 100 ms:
+// a 1000-byte segment every 5 ms.
+static void connect( TCPSenderTestHarness& test, Wrap32 isn )
+{
+  test.execute( Push {} );
+  test.execute( ExpectMessage {}.with_syn( true ).with_payload_size( 0 ).with_seqno( isn ) );
+  test.execute( Tick { 100 } );
+  test.execute( AckReceived { isn + 1 }.with_win( 60000 ) );
+  test.execute( ExpectSmoothedRTT { 100 } );
+}
+
+static TCPConfig paced_config( Wrap32 isn )
+{
+  TCPConfig cfg;
+  cfg.isn = isn;
+  cfg.congestion_control = CongestionControl::Algorithm::Reno;
+  cfg.pacing = true;
+  return cfg;
+}
+
+int main()
+{
+  try {
+    auto rd = get_random_engine();
+
+    {
+      const Wrap32 isn( rd() );
+      TCPSenderTestHarness test { "Pacing spreads a window out, after a small burst", paced_config( isn ) };
+      connect( test, isn );
+      test.execute( ExpectCongestionWindow { 10001 } );
+      test.execute( Push { string( 5000, 'x' ) } );
+      test.execute( ExpectMessage {}.with_payload_size( 1000 ).with_seqno( isn + 1 ) );
+      test.execute( ExpectMessage {}.with_payload_size( 1000 ).with_seqno( isn + 1001 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectNextSendDelay { 5 } );
+      test.execute( Tick { 4 } );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectNextSendDelay { 1 } );
+      test.execute( Tick { 1 } );
+      test.execute( ExpectMessage {}.with_payload_size( 1000 ).with_seqno( isn + 2001 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( Tick { 5 } );
+      test.execute( ExpectMessage {}.with_payload_size( 1000 ).with_seqno( isn + 3001 ) );
+      test.execute( ExpectNoSegment {} );
+
+      // A late tick catches up, but only by a burst
+      test.execute( Tick { 50 } );
+      test.execute( ExpectMessage {}.with_payload_size( 1000 ).with_seqno( isn + 4001 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectNextSendDelay { nullopt } );
+      test.execute( Push { string( 3000, 'y' ) } );
+      test.execute( ExpectMessage {}.with_payload_size( 1000 ).with_seqno( isn + 5001 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectNextSendDelay { 5 } );
+    }
+
+    {
+      const Wrap32 isn( rd() );
+      TCPConfig cfg = paced_config( isn );
+      cfg.mss = 1460;
+      cfg.path_mtu_discovery = true;
+      TCPSenderTestHarness test { "A path MTU probe held back by pacing goes when it may", cfg };
+      connect( test, isn );
+      test.execute( Push { string( 1000, 'a' ) } ); // (too little to probe with)
+      test.execute( ExpectMessage {}.with_payload_size( 1000 ).with_seqno( isn + 1 ) );
+      test.execute( Push { string( 1000, 'b' ) } );
+      test.execute( ExpectMessage {}.with_payload_size( 1000 ).with_seqno( isn + 1001 ) );
+      test.execute( Push { string( 5000, 'x' ) } );
+      test.execute( ExpectNoSegment {} );
+      test.execute( Tick { 4 } );
+      test.execute( ExpectNoSegment {} );
+      test.execute( Tick { 6 } );
+      test.execute( ExpectMessage {}.with_payload_size( 1460 ).with_seqno( isn + 2001 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( AckReceived { isn + 3461 }.with_win( 60000 ) );
+      test.execute( ExpectMSS { 1460 } );
+    }
+
+    {
+      const Wrap32 isn( rd() );
+      TCPSenderTestHarness test { "Retransmissions are not paced", paced_config( isn ) };
+      connect( test, isn );
+      test.execute( Push { string( 2000, 'x' ) } );
+      test.execute( ExpectMessage {}.with_payload_size( 1000 ).with_seqno( isn + 1 ) );
+      test.execute( ExpectMessage {}.with_payload_size( 1000 ).with_seqno( isn + 1001 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( Tick { 1000 } );
+      test.execute( ExpectMessage {}.with_payload_size( 1000 ).with_seqno( isn + 1 ) );
+    }
+
+    {
+      const Wrap32 isn( rd() );
+      TCPConfig cfg = paced_config( isn );
+      cfg.pacing = false;
+      TCPSenderTestHarness test { "Without pacing, the window goes out at once", cfg };
+      connect( test, isn );
+      test.execute( Push { string( 5000, 'x' ) } );
+      for ( uint32_t i = 0; i < 5; ++i ) {
+        test.execute( ExpectMessage {}.with_payload_size( 1000 ).with_seqno( isn + 1 + 1000 * i ) );
+      }
+      test.execute( ExpectNextSendDelay { nullopt } );
+    }
+
+    {
+      const Wrap32 isn( rd() );
+      TCPConfig cfg = paced_config( isn );
+      cfg.congestion_control = CongestionControl::Algorithm::None;
+      TCPSenderTestHarness test { "No congestion control, no pacing", cfg };
+      connect( test, isn );
+      test.execute( Push { string( 5000, 'x' ) } );
+      for ( uint32_t i = 0; i < 5; ++i ) {
+        test.execute( ExpectMessage {}.with_payload_size( 1000 ).with_seqno( isn + 1 + 1000 * i ) );
+      }
+      test.execute( ExpectNextSendDelay { nullopt } );
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,111 @@
+#include "random.hh"
+#include "sender_test_harness.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+// Connect, then send `count` segments of `size` bytes, one write each (with a window large enough not to matter)
+static void send_small_segments( TCPSenderTestHarness& test, Wrap32 isn, uint64_t count, uint64_t size )
+{
+  test.execute( Push {} );
+  test.execute( ExpectMessage {}.with_no_flags().with_syn( true ).with_payload_size( 0 ).with_seqno( isn ) );
+  test.execute( AckReceived { isn + 1 }.with_win( 40000 ) );
+  for ( uint64_t i = 0; i < count; i++ ) {
+    test.execute( Push { string( size, 'x' ) } );
+    test.execute( ExpectMessage {}.with_no_flags().with_payload_size( size ).with_seqno( isn + 1 + i * size ) );
+  }
+  test.execute( ExpectNoSegment {} );
+}
+
+int main()
+{
+  try {
+    auto rd = get_random_engine();
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.congestion_control = CongestionControl::Algorithm::Reno;
+
+      TCPSenderTestHarness test { "A partial ACK trims the segment it lands in", cfg };
+      send_small_segments( test, isn, 1, 1000 );
+      test.execute( AckReceived { isn + 401 }.with_win( 40000 ) );
+      test.execute( ExpectSeqnosInFlight { 600 } );
+      test.execute( ExpectNoSegment {} );
+      test.execute( Tick { cfg.rt_timeout - 1U } );
+      test.execute( ExpectNoSegment {} );
+      test.execute( Tick { 1 } );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 600 ).with_seqno( isn + 401 ) );
+      test.execute( ExpectNoSegment {} );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.congestion_control = CongestionControl::Algorithm::Reno;
+
+      TCPSenderTestHarness test { "A timeout resends small segments merged, up to the congestion window", cfg };
+      send_small_segments( test, isn, 5, 300 );
+      test.execute( Tick { cfg.rt_timeout } );
+      test.execute( ExpectCongestionWindow { TCPConfig::MAX_PAYLOAD_SIZE } );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 1 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectSeqnosInFlight { 1500 } );
+
+      // The rest follows as the window opens, in the new segment boundaries
+      test.execute( AckReceived { isn + 1001 }.with_win( 40000 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 500 ).with_seqno( isn + 1001 ) );
+      test.execute( AckReceived { isn + 1501 }.with_win( 40000 ) );
+      test.execute( ExpectSeqnosInFlight { 0 } );
+      test.execute( ExpectNoSegment {} );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.congestion_control = CongestionControl::Algorithm::Reno;
+      cfg.sack = true;
+
+      TCPSenderTestHarness test { "Repacketizing stops at the first SACKed segment", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ).with_sack_permitted( true ).with_seqno( isn ) );
+      test.execute( AckReceived { isn + 1 }.with_win( 40000 ) );
+      for ( uint64_t i = 0; i < 5; i++ ) {
+        test.execute( Push { string( 300, 'x' ) } );
+        test.execute( ExpectMessage {}.with_payload_size( 300 ).with_seqno( isn + 1 + i * 300 ) );
+      }
+      test.execute( AckReceived { isn + 1 }.with_win( 40000 ).with_sack( isn + 901, isn + 1201 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( Tick { cfg.rt_timeout } );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 900 ).with_seqno( isn + 1 ) );
+      test.execute( ExpectNoSegment {} );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+
+      TCPSenderTestHarness test { "Without congestion control, segments are resent as they were", cfg };
+      send_small_segments( test, isn, 3, 300 );
+      test.execute( AckReceived { isn + 151 }.with_win( 40000 ) );
+      test.execute( ExpectSeqnosInFlight { 900 } );
+      test.execute( Tick { cfg.rt_timeout } );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 300 ).with_seqno( isn + 1 ) );
+      test.execute( ExpectNoSegment {} );
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
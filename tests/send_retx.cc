@@ -16,6 +16,27 @@ int main()
   try {
     auto rd = get_random_engine();
 
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      const uint16_t retx_timeout = uniform_int_distribution<uint16_t> { 10, 10000 }( rd );
+      cfg.isn = isn;
+      cfg.rt_timeout = retx_timeout;
+
+      TCPSenderTestHarness test { "The next deadline is the retransmission timeout", cfg };
+      test.execute( ExpectDeadline { nullopt } );
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_no_flags().with_syn( true ).with_payload_size( 0 ).with_seqno( isn ) );
+      test.execute( ExpectDeadline { retx_timeout } );
+      test.execute( Tick { 3 } );
+      test.execute( ExpectDeadline { retx_timeout - 3U } );
+      test.execute( Tick { retx_timeout - 3U } );
+      test.execute( ExpectMessage {}.with_no_flags().with_syn( true ).with_payload_size( 0 ).with_seqno( isn ) );
+      test.execute( ExpectDeadline { 2U * retx_timeout } );
+      test.execute( AckReceived { isn + 1 } );
+      test.execute( ExpectDeadline { nullopt } );
+    }
+
     {
       TCPConfig cfg;
       const Wrap32 isn( rd() );
@@ -200,6 +221,54 @@ int main()
       test.execute( ExpectSeqnosInFlight { 0 } );
       test.execute( HasError { false } );
     }
+
+    // Segments are rebuilt from the retransmission buffer, across the boundaries between writes
+    for ( const auto storage : { ByteStream::Storage::Chunked, ByteStream::Storage::Ring } ) {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.stream_storage = storage;
+      cfg.sack = true;
+      cfg.congestion_control = CongestionControl::Algorithm::NewReno;
+
+      string data;
+      for ( char c = 'a'; c < 'a' + 20; c++ ) {
+        data += string( 300, c );
+      }
+
+      TCPSenderTestHarness test { "Retransmitted payloads span several writes", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_no_flags().with_syn( true ).with_payload_size( 0 ).with_seqno( isn ) );
+      for ( size_t i = 0; i < data.size(); i += 300 ) {
+        test.execute( Push { data.substr( i, 300 ) } );
+      }
+      test.execute( ExpectNoSegment {} );
+      test.execute( AckReceived { isn + 1 }.with_win( 40000 ) );
+      for ( size_t i = 0; i < 6; i++ ) {
+        test.execute( ExpectMessage {}.with_no_flags().with_seqno( isn + 1 + i * 1000 ).with_data(
+          data.substr( i * 1000, 1000 ) ) );
+      }
+      test.execute( ExpectNoSegment {} );
+
+      // Lose the first and fifth segments
+      test.execute( AckReceived { isn + 1 }.with_win( 40000 ).with_sack( isn + 1001, isn + 2001 ) );
+      test.execute( AckReceived { isn + 1 }.with_win( 40000 ).with_sack( isn + 1001, isn + 3001 ) );
+      test.execute( AckReceived { isn + 1 }.with_win( 40000 ).with_sack( isn + 1001, isn + 4001 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_seqno( isn + 1 ).with_data( data.substr( 0, 1000 ) ) );
+      test.execute( AckReceived { isn + 1 }.with_win( 40000 ).with_sack( isn + 5001, isn + 6001 ) );
+      test.execute(
+        ExpectMessage {}.with_no_flags().with_seqno( isn + 4001 ).with_data( data.substr( 4000, 1000 ) ) );
+      test.execute( ExpectNoSegment {} );
+
+      // After a partial ACK, a timeout resends the (new) first segment
+      test.execute( AckReceived { isn + 4001 }.with_win( 40000 ).with_sack( isn + 5001, isn + 6001 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( Tick { cfg.rt_timeout } );
+      test.execute(
+        ExpectMessage {}.with_no_flags().with_seqno( isn + 4001 ).with_data( data.substr( 4000, 1000 ) ) );
+      test.execute( AckReceived { isn + 6001 }.with_win( 40000 ) );
+      test.execute( ExpectSeqnosInFlight { 0 } );
+    }
   } catch ( const exception& e ) {
     cerr << e.what() << endl;
     return 1;
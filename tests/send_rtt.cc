@@ -0,0 +1,138 @@
+#include "random.hh"
+#include "sender_test_harness.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+int main()
+{
+  try {
+    auto rd = get_random_engine();
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.adaptive_RTO = true;
+      cfg.min_RTO_ms = 10;
+
+      TCPSenderTestHarness test { "RTO follows SRTT and RTTVAR", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_no_flags().with_syn( true ).with_payload_size( 0 ).with_seqno( isn ) );
+      test.execute( ExpectRTO { cfg.rt_timeout } );
+      test.execute( Tick { 50 } );
+      test.execute( AckReceived { isn + 1 } );
+      test.execute( ExpectSmoothedRTT { 50 } );
+      test.execute( ExpectRTTVariation { 25 } );
+      test.execute( ExpectRTO { 150 } );
+
+      test.execute( Push { "abc" } );
+      test.execute( ExpectMessage {}.with_data( "abc" ) );
+      test.execute( Tick { 30 } );
+      test.execute( AckReceived { isn + 4 } );
+      test.execute( ExpectSmoothedRTT { 47.5 } );
+      test.execute( ExpectRTTVariation { 23.75 } );
+      test.execute( ExpectRTO { 143 } );
+
+      // Karn's rule: the retransmitted segment's ACK is not a sample, and the backoff stays
+      test.execute( Push { "def" } );
+      test.execute( ExpectMessage {}.with_data( "def" ) );
+      test.execute( Tick { 142 } );
+      test.execute( ExpectNoSegment {} );
+      test.execute( Tick { 1 } );
+      test.execute( ExpectMessage {}.with_data( "def" ) );
+      test.execute( ExpectRTO { 286 } );
+      test.execute( Tick { 5 } );
+      test.execute( AckReceived { isn + 7 } );
+      test.execute( ExpectSmoothedRTT { 47.5 } );
+      test.execute( ExpectRTO { 286 } );
+
+      // The next timed segment brings the RTO back down
+      test.execute( Push { "ghi" } );
+      test.execute( ExpectMessage {}.with_data( "ghi" ) );
+      test.execute( Tick { 40 } );
+      test.execute( AckReceived { isn + 10 } );
+      test.execute( ExpectSmoothedRTT { 46.5625 } );
+      test.execute( ExpectRTTVariation { 19.6875 } );
+      test.execute( ExpectRTO { 126 } );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.adaptive_RTO = true;
+
+      TCPSenderTestHarness test { "RTO is clamped to the minimum", cfg };
+      test.execute( Push {} );
+      test.execute( Tick { 1 } );
+      test.execute( AckReceived { isn + 1 } );
+      test.execute( ExpectRTO { cfg.min_RTO_ms } );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.adaptive_RTO = true;
+      cfg.rt_timeout = 1000;
+      cfg.max_RTO_ms = 3000;
+
+      TCPSenderTestHarness test { "Backoff is clamped to the maximum", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( Tick { 1000 } );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( ExpectRTO { 2000 } );
+      test.execute( Tick { 2000 } );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( ExpectRTO { 3000 } );
+      test.execute( Tick { 3000 } );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( ExpectRTO { 3000 } );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+
+      TCPSenderTestHarness test { "Fixed RTO still measures round trips", cfg };
+      test.execute( Push {} );
+      test.execute( Tick { 20 } );
+      test.execute( AckReceived { isn + 1 } );
+      test.execute( ExpectSmoothedRTT { 20 } );
+      test.execute( ExpectRTO { cfg.rt_timeout } );
+    }
+
+    {
+      // The (ISN, RTO) constructor keeps the whole RTO, even one too long for TCPConfig::rt_timeout
+      const Wrap32 isn( rd() );
+      constexpr uint64_t rto = 100000;
+      TCPSender sender { ByteStream { 4000 }, isn, rto };
+      vector<TCPSenderMessage> sent;
+      const auto transmit = [&]( const TCPSenderMessage& msg ) { sent.push_back( msg ); };
+      sender.push( transmit );
+      sender.tick( rto - 1, transmit );
+      if ( sender.RTO_ms() != rto or sent.size() != 1 ) {
+        throw runtime_error( "an initial RTO of " + to_string( rto ) + " ms was cut short" );
+      }
+      sender.tick( 1, transmit );
+      if ( sent.size() != 2 ) {
+        throw runtime_error( "no retransmission after an initial RTO of " + to_string( rto ) + " ms" );
+      }
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,130 @@
+#include "random.hh"
+#include "sender_test_harness.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+// Connect (checking the SYN's SACK-permitted flag), then send `count` full segments
+static void send_segments( TCPSenderTestHarness& test, Wrap32 isn, uint64_t count, bool sack )
+{
+  test.execute( Push {} );
+  test.execute( ExpectMessage {}.with_no_flags().with_syn( true ).with_sack_permitted( sack ).with_seqno( isn ) );
+  test.execute( AckReceived { isn + 1 }.with_win( 40000 ) );
+  test.execute( Push { string( count * 1000, 'x' ) } );
+  for ( uint64_t i = 0; i < count; i++ ) {
+    test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 1 + i * 1000 ) );
+  }
+  test.execute( ExpectNoSegment {} );
+}
+
+int main()
+{
+  try {
+    auto rd = get_random_engine();
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.congestion_control = CongestionControl::Algorithm::NewReno;
+
+      TCPSenderTestHarness test { "SACK is only offered when configured", cfg };
+      send_segments( test, isn, 1, false );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.sack = true;
+      cfg.congestion_control = CongestionControl::Algorithm::NewReno;
+
+      TCPSenderTestHarness test { "SACK recovery resends each hole once", cfg };
+      send_segments( test, isn, 8, true );
+
+      // The first and third segments are lost; the rest arrive and are SACKed
+      test.execute( AckReceived { isn + 1 }.with_win( 40000 ).with_sack( isn + 1001, isn + 2001 ) );
+      test.execute( AckReceived { isn + 1 }.with_win( 40000 ).with_sack( isn + 3001, isn + 4001 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( AckReceived { isn + 1 }.with_win( 40000 ).with_sack( isn + 3001, isn + 5001 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 1 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectFastRecovery { true } );
+
+      // The next duplicate resends the other hole, rather than waiting for a partial ACK
+      test.execute( AckReceived { isn + 1 }.with_win( 40000 ).with_sack( isn + 3001, isn + 6001 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 2001 ) );
+      test.execute( ExpectNoSegment {} );
+
+      // With no holes left, duplicates don't resend anything the receiver already has
+      test.execute( AckReceived { isn + 1 }.with_win( 40000 ).with_sack( isn + 3001, isn + 7001 ) );
+      test.execute( AckReceived { isn + 1 }.with_win( 40000 ).with_sack( isn + 3001, isn + 8001 ) );
+      test.execute( ExpectNoSegment {} );
+
+      // Nor does the partial ACK for the first hole: the second has been resent already
+      test.execute( AckReceived { isn + 2001 }.with_win( 40000 ).with_sack( isn + 3001, isn + 8001 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectFastRecovery { true } );
+
+      test.execute( AckReceived { isn + 8001 }.with_win( 40000 ) );
+      test.execute( ExpectFastRecovery { false } );
+      test.execute( ExpectSeqnosInFlight { 0 } );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.sack = true;
+      cfg.congestion_control = CongestionControl::Algorithm::Reno;
+
+      TCPSenderTestHarness test { "SACKed segments are skipped after a timeout", cfg };
+      send_segments( test, isn, 5, true );
+      test.execute( AckReceived { isn + 1 }.with_win( 40000 ).with_sack( isn + 2001, isn + 3001 ) );
+      test.execute( AckReceived { isn + 1 }.with_win( 40000 ).with_sack( isn + 4001, isn + 5001 ) );
+      test.execute( ExpectNoSegment {} );
+
+      test.execute( Tick { cfg.rt_timeout } );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 1 ) );
+      test.execute( ExpectNoSegment {} );
+
+      test.execute( AckReceived { isn + 1001 }.with_win( 40000 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 1001 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( AckReceived { isn + 3001 }.with_win( 40000 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 3001 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( AckReceived { isn + 5001 }.with_win( 40000 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectSeqnosInFlight { 0 } );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.sack = true;
+      cfg.congestion_control = CongestionControl::Algorithm::NewReno;
+
+      TCPSenderTestHarness test { "Stale and bogus SACK blocks are ignored", cfg };
+      send_segments( test, isn, 4, true );
+      test.execute( AckReceived { isn + 1001 }.with_win( 40000 ).with_sack( isn + 1, isn + 1001 ) );
+      test.execute( AckReceived { isn + 1001 }.with_win( 40000 ).with_sack( isn + 3001, isn + 9001 ) );
+      test.execute( AckReceived { isn + 1001 }.with_win( 40000 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( AckReceived { isn + 1001 }.with_win( 40000 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ).with_seqno( isn + 1001 ) );
+      test.execute( ExpectNoSegment {} );
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -46,6 +46,25 @@ int main()
       test.execute( ExpectNoSegment {} );
     }
 
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.send_capacity = 1 << 20;
+      cfg.window_scale = 7;
+
+      TCPSenderTestHarness test { "Scaled window beyond 64 KiB is respected", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_no_flags().with_syn( true ).with_window_scale( 7 ).with_seqno( isn ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 200000 ) );
+      test.execute( Push { string( 300000, 'x' ) } );
+      for ( size_t i = 0; i < 200; i++ ) {
+        test.execute( ExpectMessage {}.with_no_flags().with_payload_size( 1000 ) );
+      }
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectSeqnosInFlight { 200000 } );
+    }
+
     {
       const size_t MIN_WIN = 5;
       const size_t MAX_WIN = 100;
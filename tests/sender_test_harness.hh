@@ -18,6 +18,7 @@ struct SenderAndOutput
 {
   TCPSender sender;
   std::queue<TCPSenderMessage> output {};
+  uint64_t max_payload_size = TCPConfig::MAX_PAYLOAD_SIZE;
 
   auto make_transmit()
   {
@@ -80,6 +81,69 @@ struct ExpectConsecutiveRetransmissions : public ExpectNumber<SenderAndOutput, u
   uint64_t value( SenderAndOutput& ss ) const override { return ss.sender.consecutive_retransmissions(); }
 };
 
+struct ExpectCongestionWindow : public ExpectNumber<SenderAndOutput, uint64_t>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "congestion_control().cwnd"; }
+  uint64_t value( SenderAndOutput& ss ) const override { return ss.sender.congestion_control().cwnd(); }
+};
+
+struct ExpectSlowStartThreshold : public ExpectNumber<SenderAndOutput, uint64_t>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "congestion_control().ssthresh"; }
+  uint64_t value( SenderAndOutput& ss ) const override { return ss.sender.congestion_control().ssthresh(); }
+};
+
+struct ExpectRTO : public ExpectNumber<SenderAndOutput, uint64_t>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "RTO_ms"; }
+  uint64_t value( SenderAndOutput& ss ) const override { return ss.sender.RTO_ms(); }
+};
+
+struct ExpectSmoothedRTT : public ExpectNumber<SenderAndOutput, double>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "rtt().srtt_ms"; }
+  double value( SenderAndOutput& ss ) const override { return ss.sender.rtt().srtt_ms(); }
+};
+
+struct ExpectRTTVariation : public ExpectNumber<SenderAndOutput, double>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "rtt().rttvar_ms"; }
+  double value( SenderAndOutput& ss ) const override { return ss.sender.rtt().rttvar_ms(); }
+};
+
+struct ExpectMSS : public ExpectNumber<SenderAndOutput, uint64_t>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "mss"; }
+  uint64_t value( SenderAndOutput& ss ) const override { return ss.sender.mss(); }
+};
+
+struct ExpectNextSendDelay : public ExpectNumber<SenderAndOutput, std::optional<uint64_t>>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "ms_until_next_send"; }
+  std::optional<uint64_t> value( SenderAndOutput& ss ) const override { return ss.sender.ms_until_next_send(); }
+};
+
+struct ExpectDeadline : public ExpectNumber<SenderAndOutput, std::optional<uint64_t>>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "ms_until_deadline"; }
+  std::optional<uint64_t> value( SenderAndOutput& ss ) const override { return ss.sender.ms_until_deadline(); }
+};
+
+struct ExpectFastRecovery : public ExpectBool<SenderAndOutput>
+{
+  using ExpectBool::ExpectBool;
+  std::string name() const override { return "in_fast_recovery"; }
+  bool value( SenderAndOutput& ss ) const override { return ss.sender.in_fast_recovery(); }
+};
+
 struct ExpectNoSegment : public Expectation<SenderAndOutput>
 {
   std::string description() const override { return "nothing to send"; }
@@ -183,6 +247,30 @@ struct Tick : public Action<SenderAndOutput>
   }
 };
 
+struct SetCork : public Action<SenderAndOutput>
+{
+  bool corked_;
+
+  explicit SetCork( bool corked ) : corked_( corked ) {}
+  std::string description() const override { return corked_ ? "cork" : "uncork, then push to TCPSender"; }
+  void execute( SenderAndOutput& ss ) const override
+  {
+    ss.sender.set_corked( corked_ );
+    if ( not corked_ ) {
+      ss.sender.push( ss.make_transmit() );
+    }
+  }
+};
+
+struct LimitMSS : public Action<SenderAndOutput>
+{
+  uint64_t peer_mss_;
+
+  explicit LimitMSS( uint64_t peer_mss ) : peer_mss_( peer_mss ) {}
+  std::string description() const override { return "peer advertises an MSS of " + std::to_string( peer_mss_ ); }
+  void execute( SenderAndOutput& ss ) const override { ss.sender.limit_mss( peer_mss_ ); }
+};
+
 struct Receive : public Action<SenderAndOutput>
 {
   TCPReceiverMessage msg_;
@@ -192,19 +280,29 @@ struct Receive : public Action<SenderAndOutput>
   std::string description() const override
   {
     std::ostringstream desc;
-    desc << "receive(ack=" << to_string( msg_.ackno ) << ", win=" << msg_.window_size << ")";
+    desc << "receive(ack=" << to_string( msg_.ackno ) << ", win=" << msg_.window_size;
+    for ( const auto& block : msg_.sack_blocks ) {
+      desc << ", sack=[" << block.left << ", " << block.right << ")";
+    }
+    desc << ")";
     if ( push_ ) {
       desc << ", then push stream to TCPSender";
     }
     return desc.str();
   }
 
-  Receive& with_win( uint16_t win )
+  Receive& with_win( uint32_t win )
   {
     msg_.window_size = win;
     return *this;
   }
 
+  Receive& with_sack( Wrap32 left, Wrap32 right )
+  {
+    msg_.sack_blocks.push_back( { left, right } );
+    return *this;
+  }
+
   void execute( SenderAndOutput& ss ) const override
   {
     ss.sender.receive( msg_ );
@@ -235,6 +333,9 @@ struct ExpectMessage : public Expectation<SenderAndOutput>
   std::optional<bool> syn {};
   std::optional<bool> fin {};
   std::optional<bool> rst {};
+  std::optional<bool> sack_permitted {};
+  std::optional<std::optional<uint8_t>> window_scale {};
+  std::optional<uint16_t> mss {};
   std::optional<Wrap32> seqno {};
   std::optional<std::string> data {};
   std::optional<size_t> payload_size {};
@@ -263,6 +364,24 @@ struct ExpectMessage : public Expectation<SenderAndOutput>
     return *this;
   }
 
+  ExpectMessage& with_sack_permitted( bool sack_permitted_ )
+  {
+    sack_permitted = sack_permitted_;
+    return *this;
+  }
+
+  ExpectMessage& with_window_scale( std::optional<uint8_t> window_scale_ )
+  {
+    window_scale = window_scale_;
+    return *this;
+  }
+
+  ExpectMessage& with_mss( uint16_t mss_ )
+  {
+    mss = mss_;
+    return *this;
+  }
+
   ExpectMessage& with_seqno( Wrap32 seqno_ )
   {
     seqno = seqno_;
@@ -283,6 +402,11 @@ struct ExpectMessage : public Expectation<SenderAndOutput>
     return *this;
   }
 
+  static std::string scale_string( std::optional<uint8_t> scale )
+  {
+    return scale.has_value() ? std::to_string( scale.value() ) : "none";
+  }
+
   std::string message_description() const
   {
     std::ostringstream o;
@@ -292,6 +416,15 @@ struct ExpectMessage : public Expectation<SenderAndOutput>
     if ( syn.has_value() ) {
       o << ( syn.value() ? " +SYN" : " (no SYN)" );
     }
+    if ( sack_permitted.has_value() ) {
+      o << ( sack_permitted.value() ? " +SACK-permitted" : " (no SACK-permitted)" );
+    }
+    if ( window_scale.has_value() ) {
+      o << " window_scale=" << scale_string( window_scale.value() );
+    }
+    if ( mss.has_value() ) {
+      o << " mss=" << mss.value();
+    }
     if ( payload_size.has_value() ) {
       if ( payload_size.value() ) {
         o << " payload_len=" << payload_size.value();
@@ -328,6 +461,19 @@ struct ExpectMessage : public Expectation<SenderAndOutput>
     if ( syn.has_value() and seg.SYN != syn.value() ) {
       throw ExpectationViolation( "SYN flag", syn.value(), seg.SYN );
     }
+    if ( sack_permitted.has_value() and seg.SACK_permitted != sack_permitted.value() ) {
+      throw ExpectationViolation( "SACK-permitted flag", sack_permitted.value(), seg.SACK_permitted );
+    }
+    if ( window_scale.has_value() and seg.window_scale != window_scale.value() ) {
+      throw ExpectationViolation( "The object should have had window_scale = "
+                                  + scale_string( window_scale.value() ) + ", but instead it was "
+                                  + scale_string( seg.window_scale ) + "." );
+    }
+    if ( mss.has_value() and seg.mss != mss ) {
+      throw ExpectationViolation( "The object should have had mss = " + std::to_string( mss.value() )
+                                  + ", but instead it was "
+                                  + ( seg.mss.has_value() ? std::to_string( seg.mss.value() ) : "none" ) + "." );
+    }
     if ( fin.has_value() and seg.FIN != fin.value() ) {
       throw ExpectationViolation( "FIN flag", fin.value(), seg.FIN );
     }
@@ -340,7 +486,7 @@ struct ExpectMessage : public Expectation<SenderAndOutput>
     if ( payload_size.has_value() and seg.payload.size() != payload_size.value() ) {
       throw ExpectationViolation( "payload_size", payload_size.value(), seg.payload.size() );
     }
-    if ( seg.payload.size() > TCPConfig::MAX_PAYLOAD_SIZE ) {
+    if ( seg.payload.size() > ss.max_payload_size ) {
       throw ExpectationViolation( "payload has length (" + std::to_string( seg.payload.size() )
                                   + ") greater than the maximum" );
     }
@@ -358,7 +504,38 @@ class TCPSenderTestHarness : public TestHarness<SenderAndOutput>
 public:
   TCPSenderTestHarness( std::string name, TCPConfig config )
     : TestHarness( move( name ),
-                   "initial_RTO_ms=" + to_string( config.rt_timeout ),
-                   { TCPSender { ByteStream { config.send_capacity }, config.isn, config.rt_timeout } } )
+                   describe( config ),
+                   { TCPSender { ByteStream { config.send_capacity, config.stream_storage }, config },
+                     {},
+                     config.mss } )
   {}
+
+private:
+  static std::string describe( const TCPConfig& config )
+  {
+    std::string desc = "initial_RTO_ms=" + to_string( config.rt_timeout );
+    if ( config.adaptive_RTO ) {
+      desc += " (adaptive)";
+    }
+    if ( config.sack ) {
+      desc += ", SACK";
+    }
+    if ( config.mss != TCPConfig::MAX_PAYLOAD_SIZE ) {
+      desc += ", mss=" + to_string( config.mss );
+    }
+    if ( config.path_mtu_discovery ) {
+      desc += ", path MTU discovery";
+    }
+    if ( config.nagle ) {
+      desc += ", Nagle";
+    }
+    if ( config.stream_storage == ByteStream::Storage::Ring ) {
+      desc += ", ring storage";
+    }
+    if ( config.congestion_control != CongestionControl::Algorithm::None ) {
+      const auto congestion_control = CongestionControl::make( config.congestion_control, 1 );
+      desc += ", congestion_control=" + std::string { congestion_control->name() };
+    }
+    return desc;
+  }
 };
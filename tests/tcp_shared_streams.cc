@@ -0,0 +1,207 @@
+#include "exception.hh"
+#include "parser.hh"
+#include "random.hh"
+#include "tcp_minnow_socket_impl.hh"
+
+#include <array>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <thread>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+//! Carries each IPv4 datagram as one message on a SOCK_DGRAM socketpair, instead of through a TUN device
+class TCPOverIPv4OverSocketPairAdapter : public TCPOverIPv4Adapter
+{
+  FileDescriptor fd_;
+  DatagramOutput output_ {};
+
+public:
+  explicit TCPOverIPv4OverSocketPairAdapter( FileDescriptor&& fd ) : fd_( move( fd ) ) {}
+
+  optional<TCPMessage> read()
+  {
+    string datagram;
+    fd_.read( datagram );
+    return read( datagram );
+  }
+
+  optional<TCPMessage> read( string_view datagram )
+  {
+    Parser parser { Buffer { string { datagram } } };
+    IPv4Header header;
+    header.parse( parser );
+    if ( parser.has_error() ) {
+      return {};
+    }
+    return unwrap_tcp_in_ip( header, parser );
+  }
+
+  void write( const TCPMessage& seg )
+  {
+    auto buffers = serialize( wrap_tcp_in_ip( seg ) );
+    if ( output_ ) {
+      output_( move( buffers ) );
+    } else {
+      fd_.write( buffers );
+    }
+  }
+
+  void set_output( DatagramOutput output ) { output_ = move( output ); }
+  FileDescriptor& fd() { return fd_; }
+};
+
+using SharedStreamSocket = TCPMinnowSocket<TCPOverIPv4OverSocketPairAdapter>;
+
+const Address server_address { "10.144.0.1", 4000 };
+const Address client_address { "10.144.0.2", 5000 };
+
+pair<FileDescriptor, FileDescriptor> make_link()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, fds.data() ) );
+  return { FileDescriptor { fds[0] }, FileDescriptor { fds[1] } };
+}
+
+TCPConfig tcp_config()
+{
+  TCPConfig config;
+  config.rt_timeout = 10; // (so the connections don't linger long)
+  return config;
+}
+
+// Connect a client to a server, both using shared streams of `capacity`
+void connect( SharedStreamSocket& server, SharedStreamSocket& client, uint64_t capacity )
+{
+  server.use_shared_streams( capacity );
+  client.use_shared_streams( capacity );
+
+  FdAdapterConfig server_config;
+  server_config.source = server_address;
+  thread listener { [&] { server.listen_and_accept( tcp_config(), server_config ); } };
+
+  FdAdapterConfig client_config;
+  client_config.source = client_address;
+  client_config.destination = server_address;
+  client.connect( tcp_config(), client_config );
+  listener.join();
+}
+
+// Write all of `data` to `out`, through reserve()/commit(), then close it
+void send_all( SPSCWriter& out, string_view data )
+{
+  while ( not data.empty() ) {
+    out.wait();
+    uint64_t written = 0;
+    for ( const auto region : out.reserve( data.size() ) ) {
+      written += data.copy( region.data(), region.size(), written );
+    }
+    out.commit( written );
+    data.remove_prefix( written );
+  }
+  out.close();
+}
+
+string receive_all( SPSCReader& in )
+{
+  string received;
+  while ( not in.is_finished() ) {
+    in.wait();
+    while ( in.bytes_buffered() ) {
+      received += in.pop_buffer();
+    }
+  }
+  return received;
+}
+
+// Bytes go both ways through the shared streams, each many times their capacity
+void transfer()
+{
+  auto [server_end, client_end] = make_link();
+  SharedStreamSocket server { TCPOverIPv4OverSocketPairAdapter { move( server_end ) } };
+  SharedStreamSocket client { TCPOverIPv4OverSocketPairAdapter { move( client_end ) } };
+  connect( server, client, 4096 );
+
+  auto rd = get_random_engine();
+  string request( 300000, '\0' );
+  string reply( 100000, '\0' );
+  for ( auto& c : request ) {
+    c = static_cast<char>( rd() );
+  }
+  for ( auto& c : reply ) {
+    c = static_cast<char>( rd() );
+  }
+
+  bool server_received_request = false;
+  thread server_side { [&] {
+    server_received_request = receive_all( server.inbound() ) == request;
+    send_all( server.outbound(), reply );
+    server.wait_until_closed();
+  } };
+  send_all( client.outbound(), request );
+  const string received = receive_all( client.inbound() );
+  client.wait_until_closed();
+  server_side.join();
+
+  if ( not server_received_request ) {
+    throw runtime_error( "the server received something other than what the client sent" );
+  }
+  if ( received != reply ) {
+    throw runtime_error( "the client received something other than what the server sent" );
+  }
+}
+
+// If the connection dies, an owner waiting for room in outbound() gets an error (instead of waiting forever)
+void reset_while_full()
+{
+  auto [server_end, client_end] = make_link();
+  FileDescriptor to_client = server_end.duplicate();
+  SharedStreamSocket server { TCPOverIPv4OverSocketPairAdapter { move( server_end ) } };
+  SharedStreamSocket client { TCPOverIPv4OverSocketPairAdapter { move( client_end ) } };
+  connect( server, client, 4096 );
+
+  // The server's owner reads nothing, so the client's buffers (and outbound()) fill up
+  const string chunk( 1000, 'x' );
+  while ( client.outbound().push( chunk ) ) {}
+
+  // ...until the server resets the connection
+  TCPOverIPv4OverSocketPairAdapter forger { move( to_client ) };
+  forger.config_mut().source = server_address;
+  forger.config_mut().destination = client_address;
+  TCPMessage reset;
+  reset.sender.RST = true;
+  reset.receiver.RST = true;
+  forger.write( reset );
+
+  for ( size_t i = 0; i < 50 and not client.outbound().has_error(); ++i ) {
+    client.outbound().wait( 100 );
+    client.outbound().push( chunk );
+  }
+  if ( not client.outbound().has_error() ) {
+    throw runtime_error( "outbound() did not get an error after the connection was reset" );
+  }
+  client.wait_until_closed();
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    transfer();
+    reset_while_full();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,116 @@
+#include "random.hh"
+#include "timer_wheel.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Add, remove and advance at random, and check the wheel against a plain map of expiries at every step
+static void differential_test( uint64_t horizon, size_t steps, default_random_engine& rd )
+{
+  TimerWheel wheel { rd() % 100000 };
+  map<uint64_t, uint64_t> expiries; // by id (or the tick added, for those that had expired already)
+  uint64_t now = wheel.now();
+
+  for ( size_t i = 0; i < steps; ++i ) {
+    const uint64_t id = rd() % 64;
+    switch ( rd() % 4 ) {
+      case 0:
+      case 1: {
+        // now and then, one that has expired already
+        const uint64_t expiry = rd() % 8 == 0 ? now - min<uint64_t>( now, rd() % 3 ) : now + rd() % horizon;
+        wheel.add( id, expiry );
+        expiries[id] = max( expiry, now );
+        break;
+      }
+      case 2:
+        if ( wheel.remove( id ) != ( expiries.erase( id ) == 1 ) ) {
+          throw runtime_error( "remove(" + to_string( id ) + ") disagrees" );
+        }
+        break;
+      default: {
+        now += rd() % ( horizon / 4 + 1 );
+        vector<uint64_t> expected;
+        for ( const auto& [timer, expiry] : expiries ) {
+          if ( expiry <= now ) {
+            expected.push_back( timer );
+          }
+        }
+
+        const auto expired = wheel.advance( now );
+        for ( size_t j = 1; j < expired.size(); ++j ) {
+          if ( expiries.at( expired.at( j - 1 ) ) > expiries.at( expired.at( j ) ) ) {
+            throw runtime_error( "timers expired out of order at tick " + to_string( now ) );
+          }
+        }
+        auto sorted = expired;
+        ranges::sort( sorted );
+        if ( sorted != expected ) {
+          throw runtime_error( "advance(" + to_string( now ) + ") expired " + to_string( expired.size() )
+                               + " timers, not " + to_string( expected.size() ) );
+        }
+        for ( const auto timer : expired ) {
+          expiries.erase( timer );
+        }
+      }
+    }
+
+    if ( wheel.size() != expiries.size() ) {
+      throw runtime_error( "size mismatch: " + to_string( wheel.size() ) + " vs " + to_string( expiries.size() ) );
+    }
+
+    // the next wakeup is never past the earliest expiry (nor before now, unless one has expired)
+    const auto wakeup = wheel.next_wakeup();
+    if ( wakeup.has_value() != not expiries.empty() ) {
+      throw runtime_error( "next_wakeup() with " + to_string( expiries.size() ) + " timers" );
+    }
+    if ( wakeup.has_value() ) {
+      const uint64_t earliest
+        = ranges::min_element( expiries, {}, []( const auto& timer ) { return timer.second; } )->second;
+      const bool ok = earliest <= now ? wakeup.value() == now : wakeup.value() > now and wakeup.value() <= earliest;
+      if ( not ok ) {
+        throw runtime_error( "next_wakeup() is " + to_string( wakeup.value() ) + " at tick " + to_string( now )
+                             + ", with the earliest expiry at " + to_string( earliest ) );
+      }
+    }
+  }
+}
+
+int main()
+{
+  try {
+    auto rd = get_random_engine();
+
+    // A timer far beyond the top level cascades again, and expires on time
+    {
+      TimerWheel wheel;
+      const uint64_t far = uint64_t { 1 } << 30;
+      wheel.add( 1, far );
+      wheel.add( 2, 5 );
+      if ( wheel.advance( 5 ) != vector<uint64_t> { 2 } or not wheel.advance( far - 1 ).empty()
+           or wheel.advance( far ) != vector<uint64_t> { 1 } or not wheel.empty() ) {
+        throw runtime_error( "far timer" );
+      }
+    }
+
+    // Within one level, across a few, and beyond the top
+    for ( const uint64_t horizon : { 64, 5000, 300000, 1 << 26 } ) {
+      for ( size_t i = 0; i < 20; ++i ) {
+        differential_test( horizon, 2000, rd );
+      }
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// An immutable, reference-counted slice of a string. Copies share the underlying storage,
+// and trimming or splitting a Buffer only adjusts its offsets, never the bytes themselves.
+class Buffer
+{
+  std::shared_ptr<std::string> storage_ {};
+  size_t offset_ {};
+  size_t length_ {};
+
+public:
+  Buffer() = default;
+
+  // Take ownership of `str` (without copying its bytes)
+  Buffer( std::string str ) : length_( str.size() ) // NOLINT(*-explicit-*)
+  {
+    if ( length_ ) {
+      storage_ = std::make_shared<std::string>( std::move( str ) );
+    }
+  }
+
+  std::string_view view() const
+  {
+    return storage_ ? std::string_view { *storage_ }.substr( offset_, length_ ) : std::string_view {};
+  }
+  operator std::string_view() const { return view(); } // NOLINT(*-explicit-*)
+  explicit operator std::string() const { return std::string { view() }; }
+
+  const char* data() const { return view().data(); }
+  size_t size() const { return length_; }
+  bool empty() const { return length_ == 0; }
+
+  // Drop bytes from either end of this slice
+  void remove_prefix( size_t n )
+  {
+    n = std::min( n, length_ );
+    offset_ += n;
+    length_ -= n;
+  }
+  void remove_suffix( size_t n ) { length_ -= std::min( n, length_ ); }
+
+  // Grow this slice over `next`, if `next` is the bytes that directly follow it in the same storage
+  bool extend( const Buffer& next )
+  {
+    if ( not storage_ or storage_ != next.storage_ or offset_ + length_ != next.offset_ ) {
+      return false;
+    }
+    length_ += next.length_;
+    return true;
+  }
+
+  // A slice of this Buffer that shares its storage
+  Buffer substr( size_t pos, size_t len = std::string::npos ) const
+  {
+    Buffer ret { *this };
+    ret.remove_prefix( pos );
+    ret.length_ = std::min( len, ret.length_ );
+    return ret;
+  }
+
+  // Move the bytes out as a std::string, leaving this Buffer empty.
+  // Only copies if the storage is shared or the slice doesn't cover all of it.
+  std::string release()
+  {
+    std::string ret;
+    if ( storage_ and storage_.use_count() == 1 and offset_ == 0 and length_ == storage_->size() ) {
+      ret = std::move( *storage_ );
+    } else {
+      ret = view();
+    }
+    *this = {};
+    return ret;
+  }
+};
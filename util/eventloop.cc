@@ -2,9 +2,12 @@
 #include "exception.hh"
 #include "socket.hh"
 
+#include <algorithm>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <span>
+#include <sys/timerfd.h>
 
 using namespace std;
 
@@ -13,6 +16,67 @@ unsigned int EventLoop::FDRule::service_count() const
   return direction == Direction::In ? fd.read_count() : fd.write_count();
 }
 
+EventLoop::EventLoop( const Backend backend, const Dispatch dispatch, const unsigned budget )
+  : _backend( backend ), _dispatch( dispatch ), _budget( max( budget, 1U ) )
+{
+  _rule_categories.reserve( 64 );
+
+  if ( _backend == Backend::IoUring ) {
+    try {
+      _ring.emplace( RING_ENTRIES );
+      if ( not _ring->supports( IoUring::OP_READ_MULTISHOT ) ) {
+        throw runtime_error( "io_uring without multishot reads" );
+      }
+      _ring->provide_buffers( 0, READ_BUFFERS, READ_BUFFER_SIZE );
+    } catch ( const exception& ) {
+      _ring.reset(); // an older kernel, or io_uring disabled
+      _backend = Backend::Epoll;
+    }
+  }
+
+  // The io_uring waits for the fd rules by polling an epoll instance
+  if ( _backend != Backend::Poll ) {
+    const int epoll_fd = ::epoll_create1( EPOLL_CLOEXEC );
+    if ( epoll_fd < 0 ) {
+      _ring.reset();
+      _backend = Backend::Poll; // e.g. forbidden by a sandbox
+    } else {
+      _epoll.emplace( epoll_fd );
+    }
+  }
+}
+
+EventLoop::~EventLoop()
+{
+  if ( not _ring.has_value() ) {
+    return;
+  }
+
+  // The kernel may still be reading into the ring's buffers, and writing from those of _writes
+  try {
+    for ( auto& [id, rule] : _read_rules ) {
+      rule->cancel_requested = true;
+    }
+    update_read_rules();
+    for ( unsigned i = 0; i < 100 and not( _read_rules.empty() and _writes.empty() ); ++i ) {
+      _ring->enter( true, 10 );
+      for ( const auto& cqe : _ring->completions() ) {
+        const uint64_t id = cqe.user_data >> 2U;
+        const auto op = static_cast<RingOp>( cqe.user_data & 3U );
+        if ( op == RingOp::Read and _read_rules.contains( id ) ) {
+          const auto rule = _read_rules.at( id );
+          complete_read( *rule, cqe );
+          finish_reads( *rule );
+        } else if ( op == RingOp::Write ) {
+          _writes.erase( id );
+        }
+      }
+    }
+  } catch ( const exception& e ) {
+    cerr << "EventLoop: error stopping the io_uring: " << e.what() << "\n";
+  }
+}
+
 size_t EventLoop::add_category( const string& name )
 {
   if ( _rule_categories.size() >= _rule_categories.capacity() ) {
@@ -53,10 +117,342 @@ EventLoop::RuleHandle EventLoop::add_rule( size_t category_id,
 
   _fd_rules.emplace_back( make_shared<FDRule>(
     BasicRule { category_id, interest, callback }, fd.duplicate(), direction, cancel, error ) );
+  _fd_rules.back()->order = _next_rule_order++;
 
   return RuleHandle { _fd_rules.back() };
 }
 
+EventLoop::ReadRule::ReadRule( BasicRule&& base,
+                               FileDescriptor&& s_fd,
+                               ReadCallbackT s_read_callback,
+                               CallbackT s_cancel,
+                               uint64_t s_id )
+  : BasicRule( base )
+  , fd( move( s_fd ) )
+  , read_callback( move( s_read_callback ) )
+  , cancel( move( s_cancel ) )
+  , id( s_id )
+{}
+
+EventLoop::RuleHandle EventLoop::add_read_rule( const size_t category_id,
+                                                FileDescriptor& fd,
+                                                const ReadCallbackT& callback,
+                                                const InterestT& interest,
+                                                const CallbackT& cancel )
+{
+  if ( category_id >= _rule_categories.size() ) {
+    throw out_of_range( "bad category_id" );
+  }
+
+  if ( not _ring.has_value() ) {
+    auto handle = add_rule( category_id, fd, Direction::In, {}, interest, cancel );
+    _fd_rules.back()->callback = [this, &rule_fd = _fd_rules.back()->fd, callback] {
+      _read_views.clear();
+      while ( _read_views.size() < READ_BUFFERS ) {
+        if ( _read_buffers.size() == _read_views.size() ) {
+          _read_buffers.emplace_back();
+        }
+        auto& buffer = _read_buffers.at( _read_views.size() );
+        buffer.clear(); // keeping its capacity
+        rule_fd.read( buffer );
+        if ( buffer.empty() ) {
+          break; // nothing more (or EOF)
+        }
+        _read_views.emplace_back( buffer );
+        if ( rule_fd.blocking() ) {
+          break; // the next read might block
+        }
+      }
+      if ( not _read_views.empty() ) {
+        callback( _read_views );
+      }
+    };
+    return handle;
+  }
+
+  const uint64_t id = _next_ring_id++;
+  auto rule
+    = make_shared<ReadRule>( BasicRule { category_id, interest, {} }, fd.duplicate(), callback, cancel, id );
+  _read_rules.emplace( id, rule );
+  return RuleHandle { rule };
+}
+
+namespace {
+uint64_t ring_data( const uint64_t id, const auto op )
+{
+  return id << 2U | static_cast<uint64_t>( op );
+}
+} // namespace
+
+// NOLINTBEGIN(*-signed-bitwise)
+void EventLoop::write( FileDescriptor& fd, vector<string>&& buffers, const RuleHandle& owner )
+{
+  if ( not _ring.has_value() ) {
+    try {
+      fd.write( buffers ); // (a non-blocking fd with no room writes nothing)
+    } catch ( const unix_error& e ) {
+      write_failed( owner.rule_weak_ptr_, e.error_code() );
+    }
+    return;
+  }
+
+  const uint64_t id = _next_ring_id++;
+  auto& pending = _writes[id];
+  pending.buffers = move( buffers );
+  pending.owner = owner.rule_weak_ptr_;
+  for ( auto& buffer : pending.buffers ) {
+    pending.iovecs.push_back( { buffer.data(), buffer.size() } );
+  }
+
+  auto& sqe = _ring->next_sqe();
+  sqe.opcode = IORING_OP_WRITEV;
+  sqe.fd = fd.fd_num();
+  sqe.addr = reinterpret_cast<uint64_t>( pending.iovecs.data() ); // NOLINT(*-reinterpret-cast)
+  sqe.len = pending.iovecs.size();
+  sqe.off = -1; // at the file's position, as write(2) does
+  sqe.user_data = ring_data( id, RingOp::Write );
+}
+
+bool EventLoop::update_read_rules()
+{
+  bool any_interested = false;
+  for ( auto it = _read_rules.begin(); it != _read_rules.end(); ) {
+    auto& rule = *it->second;
+    if ( rule.fd.closed() and not rule.cancel_requested ) {
+      rule.cancel();
+      rule.cancel_requested = true;
+    }
+
+    // The kernel finishes a read's work in the thread that armed it, so a loop moved to another thread rearms
+    const bool interested = not rule.cancel_requested and rule.interested();
+    const bool moved = rule.armed and rule.reader != this_thread::get_id();
+    if ( interested and not rule.armed ) {
+      auto& sqe = _ring->next_sqe();
+      sqe.opcode = IoUring::OP_READ_MULTISHOT;
+      sqe.flags = IOSQE_BUFFER_SELECT;
+      sqe.buf_group = 0;
+      sqe.fd = rule.fd.fd_num();
+      sqe.off = -1;
+      sqe.user_data = ring_data( rule.id, RingOp::Read );
+      rule.armed = true;
+      rule.reader = this_thread::get_id();
+    } else if ( ( not interested or moved ) and rule.armed and not rule.cancelling ) {
+      // the read's last completion (with -ECANCELED, unless it had finished anyway) says when it has stopped
+      auto& sqe = _ring->next_sqe();
+      sqe.opcode = IORING_OP_ASYNC_CANCEL;
+      sqe.addr = ring_data( rule.id, RingOp::Read );
+      sqe.user_data = ring_data( rule.id, RingOp::Cancel );
+      rule.cancelling = true;
+    }
+
+    if ( rule.cancel_requested and not rule.armed ) {
+      it = _read_rules.erase( it );
+      continue;
+    }
+    any_interested |= interested;
+    ++it;
+  }
+  return any_interested;
+}
+
+void EventLoop::complete_read( ReadRule& rule, const io_uring_cqe& cqe )
+{
+  if ( cqe.flags & IORING_CQE_F_BUFFER ) {
+    const auto buffer_id = static_cast<uint16_t>( cqe.flags >> IORING_CQE_BUFFER_SHIFT );
+    rule.buffer_ids.push_back( buffer_id );
+    if ( cqe.res > 0 ) {
+      rule.batch.push_back( _ring->buffer( buffer_id, cqe.res ) );
+    }
+  }
+
+  if ( not( cqe.flags & IORING_CQE_F_MORE ) ) {
+    rule.stopped = cqe.res;
+  }
+}
+
+void EventLoop::write_failed( const weak_ptr<BasicRule>& owner, const int err )
+{
+  if ( err == EAGAIN or err == ENOBUFS ) {
+    return; // the datagram is dropped
+  }
+
+  const auto rule = owner.lock();
+  if ( not rule or rule->cancel_requested ) {
+    return;
+  }
+  cerr << "error writing for rule \"" << _rule_categories.at( rule->category_id ).name << "\": " << strerror( err )
+       << "\n";
+  if ( const auto fd_rule = dynamic_pointer_cast<FDRule>( rule ) ) {
+    fd_rule->error();
+    fd_rule->cancel();
+  } else if ( const auto read_rule = dynamic_pointer_cast<ReadRule>( rule ) ) {
+    read_rule->cancel();
+  }
+  rule->cancel_requested = true;
+}
+
+void EventLoop::finish_reads( ReadRule& rule )
+{
+  // data that was read is delivered, even if the rule has lost interest since
+  if ( not rule.batch.empty() and not rule.cancel_requested ) {
+    rule.read_callback( rule.batch );
+  }
+  for ( const auto buffer_id : rule.buffer_ids ) {
+    _ring->recycle( buffer_id );
+  }
+  rule.batch.clear();
+  rule.buffer_ids.clear();
+
+  if ( not rule.stopped.has_value() ) {
+    return;
+  }
+
+  // The read has stopped. Out of buffers (or stopped on purpose), it is rearmed when next interested
+  const int res = rule.stopped.value();
+  rule.stopped.reset();
+  rule.armed = false;
+  rule.cancelling = false;
+  if ( res < 0 and res != -ENOBUFS and res != -ECANCELED ) {
+    cerr << "error reading for rule \"" << _rule_categories.at( rule.category_id ).name
+         << "\": " << strerror( -res ) << "\n";
+  }
+  if ( ( res == 0 or ( res < 0 and res != -ENOBUFS and res != -ECANCELED ) ) and not rule.cancel_requested ) {
+    rule.cancel(); // EOF, or an error
+    rule.cancel_requested = true;
+  }
+  if ( rule.cancel_requested ) {
+    _read_rules.erase( rule.id );
+  }
+}
+// NOLINTEND(*-signed-bitwise)
+
+EventLoop::TimerRule::TimerRule( BasicRule&& base, uint64_t s_id, Clock::duration s_period )
+  : BasicRule( base ), id( s_id ), period( s_period )
+{}
+
+EventLoop::RuleHandle EventLoop::add_timer( const size_t category_id,
+                                            const optional<Clock::duration> delay,
+                                            const CallbackT& callback,
+                                            const Clock::duration period )
+{
+  if ( category_id >= _rule_categories.size() ) {
+    throw out_of_range( "bad category_id" );
+  }
+
+  // The first timer brings the timerfd, and the rule that watches it
+  if ( not _timer_fd.has_value() ) {
+    _timer_fd.emplace(
+      CheckSystemCall( "timerfd_create", ::timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC ) ) );
+    _timer_origin = Clock::now();
+    add_rule(
+      "timers",
+      *_timer_fd,
+      Direction::In,
+      [this] {
+        string expirations( sizeof( uint64_t ), '\0' );
+        _timer_fd->read( expirations );
+        _timer_fd_wakeup.reset(); // it went off, so it is no longer set
+        expire_timers();
+      },
+      [this] { return not _timer_wheel.empty(); } );
+  }
+
+  auto timer = make_shared<TimerRule>( BasicRule { category_id, {}, callback }, _next_timer_id++, period );
+  _timers.emplace( timer->id, timer );
+  if ( delay.has_value() ) {
+    schedule_timer( *timer, Clock::now() + delay.value() );
+  }
+
+  return RuleHandle { timer };
+}
+
+void EventLoop::set_timer( const RuleHandle& timer, const optional<Clock::duration> delay )
+{
+  const auto timer_rule = dynamic_pointer_cast<TimerRule>( timer.rule_weak_ptr_.lock() );
+  if ( not timer_rule ) {
+    if ( not timer.rule_weak_ptr_.expired() ) {
+      throw runtime_error( "set_timer: not a timer" );
+    }
+    return;
+  }
+
+  if ( timer_rule->cancel_requested ) {
+    schedule_timer( *timer_rule, nullopt );
+    _timers.erase( timer_rule->id );
+    return;
+  }
+
+  schedule_timer( *timer_rule, delay.has_value() ? optional { Clock::now() + delay.value() } : nullopt );
+}
+
+void EventLoop::schedule_timer( TimerRule& timer, const optional<Clock::time_point> deadline )
+{
+  timer.deadline = deadline;
+  if ( not deadline.has_value() ) {
+    _timer_wheel.remove( timer.id );
+    return;
+  }
+
+  // round up to a whole tick, so the timer doesn't go off early
+  const auto since_origin = max( deadline.value() - _timer_origin, Clock::duration {} );
+  const auto ticks = ( since_origin + TIMER_TICK - Clock::duration { 1 } ) / TIMER_TICK;
+  _timer_wheel.add( timer.id, static_cast<uint64_t>( ticks ) );
+}
+
+void EventLoop::expire_timers()
+{
+  const auto now = Clock::now();
+  for ( const auto id : _timer_wheel.advance( static_cast<uint64_t>( ( now - _timer_origin ) / TIMER_TICK ) ) ) {
+    const auto it = _timers.find( id );
+    if ( it == _timers.end() ) {
+      continue;
+    }
+    const auto timer = it->second; // a callback may drop it from _timers
+
+    // an earlier callback may have rearmed or disarmed it
+    if ( _timer_wheel.contains( id ) or not timer->deadline.has_value() ) {
+      continue;
+    }
+
+    if ( timer->cancel_requested ) {
+      _timers.erase( it );
+      continue;
+    }
+
+    if ( timer->period > Clock::duration {} ) {
+      // keep to the schedule, skipping any periods that have been missed
+      const auto deadline = timer->deadline.value();
+      const auto missed = max( now - deadline, Clock::duration {} ) / timer->period;
+      schedule_timer( *timer, deadline + ( missed + 1 ) * timer->period );
+    } else {
+      timer->deadline.reset();
+    }
+
+    if ( timer->enabled ) {
+      timer->callback();
+    }
+  }
+}
+
+void EventLoop::set_timer_fd()
+{
+  const auto wakeup = _timer_wheel.next_wakeup();
+  if ( wakeup == _timer_fd_wakeup ) {
+    return;
+  }
+
+  itimerspec spec {}; // all zero disarms it
+  if ( wakeup.has_value() ) {
+    const auto when = ( _timer_origin + TIMER_TICK * static_cast<int64_t>( wakeup.value() ) ).time_since_epoch();
+    const auto seconds = chrono::duration_cast<chrono::seconds>( when );
+    spec.it_value.tv_sec = seconds.count();
+    spec.it_value.tv_nsec = chrono::duration_cast<chrono::nanoseconds>( when - seconds ).count();
+  }
+  CheckSystemCall( "timerfd_settime",
+                   ::timerfd_settime( _timer_fd->fd_num(), TFD_TIMER_ABSTIME, &spec, nullptr ) );
+  _timer_fd_wakeup = wakeup;
+}
+
 EventLoop::RuleHandle EventLoop::add_rule( const size_t category_id,
                                            const CallbackT& callback,
                                            const InterestT& interest )
@@ -78,47 +474,301 @@ void EventLoop::RuleHandle::cancel()
   }
 }
 
-// NOLINTBEGIN(*-cognitive-complexity)
+void EventLoop::RuleHandle::enable()
+{
+  const shared_ptr<BasicRule> rule_shared_ptr = rule_weak_ptr_.lock();
+  if ( rule_shared_ptr ) {
+    rule_shared_ptr->enabled = true;
+  }
+}
+
+void EventLoop::RuleHandle::disable()
+{
+  const shared_ptr<BasicRule> rule_shared_ptr = rule_weak_ptr_.lock();
+  if ( rule_shared_ptr ) {
+    rule_shared_ptr->enabled = false;
+  }
+}
+
+void EventLoop::update_interest( const FDRuleList::iterator it )
+{
+  auto& rule = **it;
+  const bool interested = rule.interested();
+  if ( rule.registered and interested == rule.wants_events ) {
+    return;
+  }
+  rule.wants_events = interested;
+
+  if ( _epoll.has_value() ) {
+    auto& entry = _epoll_entries[rule.fd.fd_num()];
+    if ( not rule.registered ) {
+      entry.rules.push_back( it );
+    }
+    epoll_update( rule.fd.fd_num(), entry );
+  }
+  rule.registered = true;
+}
+
+EventLoop::FDRuleList::iterator EventLoop::erase_rule( const FDRuleList::iterator it )
+{
+  auto& rule = **it;
+  const auto entry_it = _epoll_entries.find( rule.fd.fd_num() );
+  if ( rule.registered and entry_it != _epoll_entries.end() ) {
+    auto& entry = entry_it->second;
+    erase( entry.rules, it );
+    if ( entry.rules.empty() ) {
+      if ( not entry.always_ready and not rule.fd.closed() ) {
+        ::epoll_ctl( _epoll->fd_num(), EPOLL_CTL_DEL, entry_it->first, nullptr ); // gone already if closed
+      }
+      _epoll_entries.erase( entry_it );
+    } else {
+      epoll_update( entry_it->first, entry );
+    }
+  }
+  return _fd_rules.erase( it );
+}
+
 // NOLINTBEGIN(*-signed-bitwise)
-EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
+void EventLoop::epoll_update( const int fd_num, EpollEntry& entry )
 {
-  // first, handle the non-file-descriptor-related rules
-  {
-    for ( auto it = _non_fd_rules.begin(); it != _non_fd_rules.end(); ) {
-      auto& this_rule = **it;
-      bool rule_fired = false;
-
-      if ( this_rule.cancel_requested ) {
-        it = _non_fd_rules.erase( it );
-        continue;
+  uint32_t events = 0;
+  for ( const auto& rule_it : entry.rules ) {
+    if ( ( *rule_it )->wants_events ) {
+      events |= static_cast<uint32_t>( ( *rule_it )->direction ); // EPOLLIN and EPOLLOUT match POLLIN and POLLOUT
+    }
+  }
+
+  const bool added = entry.rules.size() == 1 and not ( *entry.rules.front() )->registered;
+  if ( entry.always_ready or ( events == entry.events and not added ) ) {
+    return;
+  }
+
+  epoll_event event {};
+  event.events = events;
+  event.data.fd = fd_num;
+  // The kernel forgets an fd when its file is closed, and another file may have reused the number since
+  int ret = ::epoll_ctl( _epoll->fd_num(), added ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd_num, &event );
+  if ( ret < 0 and errno == ( added ? EEXIST : ENOENT ) ) {
+    ret = ::epoll_ctl( _epoll->fd_num(), added ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd_num, &event );
+  }
+  if ( ret < 0 and errno == EPERM ) {
+    entry.always_ready = true; // a regular file, say: poll would report it ready at once
+  } else {
+    CheckSystemCall( "epoll_ctl", ret );
+  }
+  entry.events = events;
+}
+
+vector<EventLoop::FDRuleList::iterator> EventLoop::poll_ready( const int timeout_ms )
+{
+  vector<pollfd> pollfds {};
+  pollfds.reserve( _fd_rules.size() );
+  for ( const auto& rule : _fd_rules ) {
+    // if uninterested, a placeholder --- we still want errors
+    const auto events = rule->wants_events ? static_cast<int16_t>( rule->direction ) : int16_t { 0 };
+    pollfds.push_back( { rule->fd.fd_num(), events, 0 } );
+  }
+
+  vector<FDRuleList::iterator> ready {};
+  if ( 0 == CheckSystemCall( "poll", ::poll( pollfds.data(), pollfds.size(), timeout_ms ) ) ) {
+    return ready;
+  }
+
+  for ( auto [it, idx] = make_pair( _fd_rules.begin(), static_cast<size_t>( 0 ) ); it != _fd_rules.end();
+        ++it, ++idx ) {
+    ( *it )->revents = pollfds.at( idx ).revents;
+    if ( ( *it )->revents ) {
+      ready.push_back( it );
+    }
+  }
+  return ready;
+}
+
+vector<EventLoop::FDRuleList::iterator> EventLoop::epoll_ready( const int timeout_ms )
+{
+  vector<FDRuleList::iterator> ready {};
+  auto report = [&]( const EpollEntry& entry, const uint32_t events ) {
+    for ( const auto& rule_it : entry.rules ) {
+      auto& rule = **rule_it;
+      const auto wanted = ( rule.wants_events ? static_cast<uint32_t>( rule.direction ) : 0 ) | POLLERR | POLLHUP;
+      rule.revents = static_cast<int16_t>( events & wanted );
+      if ( rule.revents ) {
+        ready.push_back( rule_it );
       }
+    }
+  };
+
+  // Files that epoll refused are always ready, as far as poll is concerned
+  for ( const auto& [fd_num, entry] : _epoll_entries ) {
+    if ( entry.always_ready ) {
+      report( entry, POLLIN | POLLOUT );
+    }
+  }
+
+  // epoll_wait isn't restarted after a signal (nor after an io_uring runs its work in this thread): then, it
+  // reports nothing
+  _epoll_events.resize( max<size_t>( _epoll_entries.size(), 1 ) );
+  int count = ::epoll_wait( _epoll->fd_num(),
+                            _epoll_events.data(),
+                            static_cast<int>( _epoll_events.size() ),
+                            ready.empty() ? timeout_ms : 0 );
+  if ( count < 0 and errno == EINTR ) {
+    count = 0;
+  }
+  CheckSystemCall( "epoll_wait", count );
+  for ( const auto& event : span( _epoll_events ).first( count ) ) {
+    const auto entry_it = _epoll_entries.find( event.data.fd );
+    if ( entry_it != _epoll_entries.end() ) {
+      report( entry_it->second, event.events );
+    }
+  }
 
-      uint8_t iterations = 0;
-      while ( this_rule.interest() ) {
-        if ( iterations++ >= 128 ) {
-          throw runtime_error( "EventLoop: busy wait detected: rule \""
-                               + _rule_categories.at( this_rule.category_id ).name + "\" is still interested after "
-                               + to_string( iterations ) + " iterations" );
+  ranges::sort( ready, {}, []( const FDRuleList::iterator& it ) { return ( *it )->order; } );
+  return ready;
+}
+
+vector<EventLoop::FDRuleList::iterator> EventLoop::ring_ready( const int timeout_ms, bool& served_reads )
+{
+  // Unless its poll is in flight (and so it hasn't been ready since), look at the epoll instance first
+  vector<FDRuleList::iterator> ready {};
+  const bool always_ready = ranges::any_of( _epoll_entries, []( const auto& entry ) {
+    return entry.second.always_ready;
+  } );
+  if ( not _epoll_polled or always_ready ) {
+    ready = epoll_ready( 0 );
+  }
+  if ( ready.empty() and not _epoll_polled and not _epoll_entries.empty() ) {
+    auto& sqe = _ring->next_sqe();
+    sqe.opcode = IORING_OP_POLL_ADD;
+    sqe.fd = _epoll->fd_num();
+    sqe.poll32_events = POLLIN;
+    sqe.user_data = ring_data( 0, RingOp::Epoll );
+    _epoll_polled = true;
+  }
+
+  // Submit everything queued, and (with nothing ready yet) wait for a completion
+  _ring->enter( ready.empty(), timeout_ms );
+
+  bool epoll_fired = false;
+  vector<shared_ptr<ReadRule>> reads; // the read rules with completions, each once
+  for ( const auto& cqe : _ring->completions() ) {
+    const uint64_t id = cqe.user_data >> 2U;
+    switch ( static_cast<RingOp>( cqe.user_data & 3U ) ) {
+      case RingOp::Epoll:
+        _epoll_polled = false;
+        epoll_fired = true;
+        break;
+      case RingOp::Read:
+        if ( const auto it = _read_rules.find( id ); it != _read_rules.end() ) {
+          if ( it->second->buffer_ids.empty() and not it->second->stopped.has_value() ) {
+            reads.push_back( it->second );
+          }
+          complete_read( *it->second, cqe );
+        }
+        break;
+      case RingOp::Write:
+        if ( const auto it = _writes.find( id ); it != _writes.end() ) {
+          if ( cqe.res < 0 ) {
+            write_failed( it->second.owner, -cqe.res );
+          }
+          _writes.erase( it );
         }
+        break;
+      case RingOp::Cancel:
+        break;
+    }
+  }
 
-        rule_fired = true;
-        this_rule.callback();
-      }
+  // Each read rule gets everything that arrived for it, together
+  for ( const auto& rule : reads ) {
+    finish_reads( *rule );
+    served_reads = true;
+  }
 
-      if ( rule_fired ) {
-        return Result::Success; /* only serve one rule on each iteration */
+  if ( epoll_fired and ready.empty() ) {
+    ready = epoll_ready( 0 );
+  }
+  return ready;
+}
+// NOLINTEND(*-signed-bitwise)
+
+bool EventLoop::serve_non_fd_rules()
+{
+  bool any_fired = false;
+  for ( auto it = _non_fd_rules.begin(); it != _non_fd_rules.end(); ) {
+    auto& this_rule = **it;
+    bool rule_fired = false;
+
+    if ( this_rule.cancel_requested ) {
+      it = _non_fd_rules.erase( it );
+      continue;
+    }
+
+    uint8_t iterations = 0;
+    while ( this_rule.interested() ) {
+      if ( _dispatch == Dispatch::All and iterations == _budget ) {
+        break; // the rest waits for the next iteration
+      }
+      if ( iterations++ >= 128 ) {
+        throw runtime_error( "EventLoop: busy wait detected: rule \""
+                             + _rule_categories.at( this_rule.category_id ).name + "\" is still interested after "
+                             + to_string( iterations ) + " iterations" );
       }
 
-      ++it;
+      rule_fired = true;
+      this_rule.callback();
+    }
+
+    if ( rule_fired and _dispatch == Dispatch::One ) {
+      return true; /* only serve one rule on each iteration */
     }
+    any_fired |= rule_fired;
+
+    ++it;
   }
+  return any_fired;
+}
 
-  // now the file-descriptor-related rules. poll any "interested" file descriptors
-  vector<pollfd> pollfds {};
-  pollfds.reserve( _fd_rules.size() );
+void EventLoop::serve_again( FDRule& rule )
+{
+  for ( unsigned calls = 1; calls < _budget; ++calls ) {
+    if ( rule.cancel_requested or rule.fd.closed() or not rule.interested()
+         or ( rule.direction == Direction::In and rule.fd.eof() ) ) {
+      return;
+    }
+
+    // still ready? (a blocking fd must not block, nor a non-blocking one fail)
+    pollfd pfd { rule.fd.fd_num(), static_cast<int16_t>( rule.direction ), 0 };
+    const int count = CheckSystemCall( "poll", ::poll( &pfd, 1, 0 ) );
+    if ( count == 0 or not( pfd.revents & pfd.events ) ) { // NOLINT(*-signed-bitwise)
+      return;
+    }
+
+    const auto count_before = rule.service_count();
+    rule.callback();
+    if ( count_before == rule.service_count() ) {
+      return; // no progress; wait for the next iteration to look again
+    }
+  }
+}
+
+// NOLINTBEGIN(*-cognitive-complexity)
+// NOLINTBEGIN(*-signed-bitwise)
+EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
+{
+  // first, handle the non-file-descriptor-related rules
+  const bool non_fd_fired = serve_non_fd_rules();
+  if ( non_fd_fired and _dispatch == Dispatch::One ) {
+    return Result::Success; /* only serve one rule on each iteration */
+  }
+
+  // now the file-descriptor-related rules. wait for any "interested" file descriptors (and the next timer)
   bool something_to_poll = false;
+  if ( _timer_fd.has_value() ) {
+    set_timer_fd();
+  }
 
-  // set up the pollfd for each rule
+  // note which rules are interested
   for ( auto it = _fd_rules.begin(); it != _fd_rules.end(); ) { // NOTE: it gets erased or incremented in loop body
     auto& this_rule = **it;
 
@@ -126,48 +776,76 @@ EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
       //      this_rule.cancel();
       //      if rule is cancelled externally, no need to call the cancellation callback
       //      this makes it easier to cancel rules and delete captured objects right away
-      it = _fd_rules.erase( it );
+      it = erase_rule( it );
       continue;
     }
 
     if ( this_rule.direction == Direction::In && this_rule.fd.eof() ) {
       // no more reading on this rule, it's reached eof
       this_rule.cancel();
-      it = _fd_rules.erase( it );
+      it = erase_rule( it );
       continue;
     }
 
     if ( this_rule.fd.closed() ) {
       this_rule.cancel();
-      it = _fd_rules.erase( it );
+      it = erase_rule( it );
       continue;
     }
 
-    if ( this_rule.interest() ) {
-      pollfds.push_back( { this_rule.fd.fd_num(), static_cast<int16_t>( this_rule.direction ), 0 } );
-      something_to_poll = true;
-    } else {
-      pollfds.push_back( { this_rule.fd.fd_num(), 0, 0 } ); // placeholder --- we still want errors
-    }
+    update_interest( it );
+    something_to_poll |= this_rule.wants_events;
     ++it;
   }
+  if ( _ring.has_value() ) {
+    something_to_poll |= update_read_rules();
+  }
 
-  // quit if there is nothing left to poll
+  // quit if there is nothing left to poll (but first, send off any writes still queued)
   if ( not something_to_poll ) {
-    return Result::Exit;
+    if ( _ring.has_value() ) {
+      _ring->enter( false );
+    }
+    return non_fd_fired ? Result::Success : Result::Exit;
   }
 
-  // call poll -- wait until one of the fds satisfies one of the rules (writeable/readable)
-  if ( 0 == CheckSystemCall( "poll", ::poll( pollfds.data(), pollfds.size(), timeout_ms ) ) ) {
-    return Result::Timeout;
+  // wait until one of the fds satisfies one of the rules (writeable/readable), unless there was work already
+  const int wait_ms = non_fd_fired ? 0 : timeout_ms;
+  bool served_reads = false;
+  vector<FDRuleList::iterator> ready;
+  switch ( _backend ) {
+    case Backend::Poll:
+      ready = poll_ready( wait_ms );
+      break;
+    case Backend::Epoll:
+      ready = epoll_ready( wait_ms );
+      break;
+    case Backend::IoUring:
+      ready = ring_ready( wait_ms, served_reads );
+      break;
+  }
+  if ( ready.empty() ) {
+    return non_fd_fired or served_reads ? Result::Success : Result::Timeout;
   }
 
-  // go through the poll results
-  for ( auto [it, idx] = make_pair( _fd_rules.begin(), static_cast<size_t>( 0 ) ); it != _fd_rules.end(); ++idx ) {
-    const auto& this_pollfd = pollfds.at( idx );
+  // go through the results, in rule order (taking turns to go first, when serving them all)
+  if ( _dispatch == Dispatch::All ) {
+    const auto first = ranges::find_if( ready, [&]( const auto& it ) { return ( *it )->order >= _first_order; } );
+    ranges::rotate( ready, first );
+  }
+  bool served_any = false;
+  for ( const auto it : ready ) {
     auto& this_rule = **it;
 
-    const auto poll_error = static_cast<bool>( this_pollfd.revents & ( POLLERR | POLLNVAL ) );
+    // an earlier callback on this iteration may have changed things
+    if ( served_any
+         and ( this_rule.cancel_requested or this_rule.fd.closed() or not this_rule.interested()
+               or ( this_rule.direction == Direction::In and this_rule.fd.eof() ) ) ) {
+      continue;
+    }
+    const auto events = this_rule.wants_events ? static_cast<int16_t>( this_rule.direction ) : 0;
+
+    const auto poll_error = static_cast<bool>( this_rule.revents & ( POLLERR | POLLNVAL ) );
     if ( poll_error ) {
       /* see if fd is a socket */
       int socket_error = 0;
@@ -187,19 +865,19 @@ EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
 
       this_rule.error();
       this_rule.cancel();
-      it = _fd_rules.erase( it );
+      erase_rule( it );
       continue;
     }
 
-    const auto poll_ready = static_cast<bool>( this_pollfd.revents & this_pollfd.events );
-    const auto poll_hup = static_cast<bool>( this_pollfd.revents & POLLHUP );
-    if ( poll_hup && ( ( this_pollfd.events && !poll_ready ) or ( this_rule.direction == Direction::Out ) ) ) {
+    const auto poll_ready = static_cast<bool>( this_rule.revents & events );
+    const auto poll_hup = static_cast<bool>( this_rule.revents & POLLHUP );
+    if ( poll_hup && ( ( events && !poll_ready ) or ( this_rule.direction == Direction::Out ) ) ) {
       // if we asked for the status, and the _only_ condition was a hangup, this FD is defunct:
       //   - if it was POLLIN and nothing is readable, no more will ever be readable
       //   - if it was POLLOUT, it will not be writable again
       // additionally, consider FD defunct if rule will only query for Direction::Out
       this_rule.cancel();
-      it = _fd_rules.erase( it );
+      erase_rule( it );
       continue;
     }
 
@@ -208,16 +886,23 @@ EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
       const auto count_before = this_rule.service_count();
       this_rule.callback();
 
-      if ( count_before == this_rule.service_count() and ( not this_rule.fd.closed() ) and this_rule.interest() ) {
+      if ( count_before == this_rule.service_count() and ( not this_rule.fd.closed() )
+           and this_rule.interested() ) {
         throw runtime_error( "EventLoop: busy wait detected: rule \""
                              + _rule_categories.at( this_rule.category_id ).name
                              + "\" did not read/write fd and is still interested" );
       }
 
-      return Result::Success; /* only serve one rule on each iteration */
-    }
+      if ( _dispatch == Dispatch::One ) {
+        return Result::Success; /* only serve one rule on each iteration */
+      }
 
-    ++it; // if we got here, it means we didn't call _fd_rules.erase()
+      if ( not served_any ) {
+        _first_order = this_rule.order + 1; // next time, the rule after this one goes first
+        served_any = true;
+      }
+      serve_again( this_rule );
+    }
   }
 
   return Result::Success;
@@ -1,13 +1,24 @@
 #pragma once
 
+#include <chrono>
 #include <functional>
 #include <list>
 #include <memory>
+#include <optional>
 #include <ostream>
 #include <poll.h>
+#include <span>
+#include <string>
 #include <string_view>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "file_descriptor.hh"
+#include "io_uring.hh"
+#include "timer_wheel.hh"
 
 //! Waits for events on file descriptors and executes corresponding callbacks.
 class EventLoop
@@ -20,9 +31,28 @@ public:
     Out = POLLOUT //!< Callback will be triggered when Rule::fd is writable.
   };
 
+  //! How the EventLoop waits for its file descriptors.
+  enum class Backend
+  {
+    Poll,   //!< Build a pollfd for every rule, and call [poll(2)](\ref man2::poll), on each iteration.
+    Epoll,  //!< Register each fd with [epoll(7)](\ref man7::epoll) once, and update it only when interest changes.
+    IoUring //!< Like Epoll, but wait in an io_uring, which also carries the reads of add_read_rule() and the
+            //!< writes of write(), many to each system call. Needs Linux 6.7 (for multishot reads).
+  };
+
+  //! How much each call to EventLoop::wait_next_event serves.
+  enum class Dispatch
+  {
+    One, //!< The first ready rule (in the order the rules were added), once.
+    All  //!< Every ready rule, each up to a budget of callbacks while it stays ready, taking turns to go first.
+  };
+
+  using Clock = std::chrono::steady_clock;
+
 private:
   using CallbackT = std::function<void( void )>;
   using InterestT = std::function<bool( void )>;
+  using ReadCallbackT = std::function<void( std::span<const std::string_view> )>;
 
   struct RuleCategory
   {
@@ -32,11 +62,17 @@ private:
   struct BasicRule
   {
     size_t category_id;
-    InterestT interest;
+    InterestT interest; //!< If empty, the rule is interested whenever it is enabled (without a call per iteration).
     CallbackT callback;
     bool cancel_requested {};
+    bool enabled { true }; //!< Set by RuleHandle::enable() and RuleHandle::disable().
 
     BasicRule( size_t s_category_id, InterestT s_interest, CallbackT s_callback );
+    virtual ~BasicRule() = default;
+    BasicRule( const BasicRule& ) = default;
+    BasicRule& operator=( const BasicRule& ) = default;
+
+    bool interested() const { return enabled and ( not interest or interest() ); }
   };
 
   struct FDRule : public BasicRule
@@ -51,14 +87,150 @@ private:
     //! Returns the number of times fd has been read or written, depending on the value of Rule::direction.
     //! \details This function is used internally by EventLoop; you will not need to call it
     unsigned int service_count() const;
+
+    uint64_t order {};    //!< Position among the fd rules, which are served in this order.
+    bool registered {};   //!< Has the backend seen this rule yet?
+    bool wants_events {}; //!< Was the rule interested at this iteration?
+    int16_t revents {};   //!< What the backend reported for fd (as for [poll(2)](\ref man2::poll)).
+  };
+
+  using FDRuleList = std::list<std::shared_ptr<FDRule>>;
+
+  struct TimerRule : public BasicRule
+  {
+    uint64_t id;                                  //!< The timer's key in the timing wheel.
+    Clock::duration period;                       //!< If nonzero, it goes off again this long after each time.
+    std::optional<Clock::time_point> deadline {}; //!< When the timer is armed to go off.
+
+    TimerRule( BasicRule&& base, uint64_t s_id, Clock::duration s_period );
+  };
+
+  //! With Backend::IoUring, a read rule keeps a multishot read in flight on its fd, into the ring's buffers.
+  struct ReadRule : public BasicRule
+  {
+    FileDescriptor fd;
+    ReadCallbackT read_callback; //!< Called with what each read on one wakeup returned (e.g. one datagram each).
+    CallbackT cancel;            //!< Called when the rule is cancelled by EOF or an error.
+    uint64_t id;
+    bool armed {};             //!< Is a read in flight?
+    bool cancelling {};        //!< Has the read in flight been asked to stop?
+    std::thread::id reader {}; //!< The thread that armed the read (which the kernel does its work in).
+
+    // The completions of this wakeup, not yet delivered
+    std::vector<std::string_view> batch {};
+    std::vector<uint16_t> buffer_ids {};
+    std::optional<int> stopped {}; //!< The read's last result, if it has stopped.
+
+    ReadRule( BasicRule&& base,
+              FileDescriptor&& s_fd,
+              ReadCallbackT s_read_callback,
+              CallbackT s_cancel,
+              uint64_t s_id );
   };
 
   std::vector<RuleCategory> _rule_categories {};
-  std::list<std::shared_ptr<FDRule>> _fd_rules {};
+  FDRuleList _fd_rules {};
   std::list<std::shared_ptr<BasicRule>> _non_fd_rules {};
+  uint64_t _next_rule_order {};
+
+  Backend _backend;
+  Dispatch _dispatch;
+  unsigned _budget;         //!< With Dispatch::All, the most callbacks for one rule in one iteration.
+  uint64_t _first_order {}; //!< With Dispatch::All, the fd rule to serve first next time (or the next after it).
+
+  //! The epoll instance, and what is registered with it: one entry per fd number, shared by its rules.
+  struct EpollEntry
+  {
+    uint32_t events {};   //!< The directions registered: those that any of the rules is interested in.
+    bool always_ready {}; //!< epoll refuses regular files (and the like), which poll considers always ready.
+    std::vector<FDRuleList::iterator> rules {};
+  };
+  std::optional<FileDescriptor> _epoll {};
+  std::unordered_map<int, EpollEntry> _epoll_entries {};
+  std::vector<epoll_event> _epoll_events {};
+
+  //! The io_uring, and what is in flight there: each request's user_data is an ID, with the RingOp in the low bits.
+  enum class RingOp : uint8_t
+  {
+    Epoll,  //!< A poll of the epoll instance, to wake up for the fd rules.
+    Read,   //!< A read rule's multishot read.
+    Write,  //!< A write().
+    Cancel, //!< Stopping a read rule's read.
+  };
+  struct RingWrite
+  {
+    std::vector<std::string> buffers {};
+    std::vector<iovec> iovecs {};
+    std::weak_ptr<BasicRule> owner {};
+  };
+  static constexpr unsigned RING_ENTRIES = 256;
+  static constexpr uint16_t READ_BUFFERS = 64;
+  static constexpr size_t READ_BUFFER_SIZE = 16384;
+  std::optional<IoUring> _ring {};
+  bool _epoll_polled {}; //!< Is a poll of the epoll instance in flight?
+  std::unordered_map<uint64_t, std::shared_ptr<ReadRule>> _read_rules {};
+  std::unordered_map<uint64_t, RingWrite> _writes {};
+  uint64_t _next_ring_id {};
+
+  //! Without the io_uring, read rules drain their fd into these buffers, which are kept for the next time.
+  std::vector<std::string> _read_buffers {};
+  std::vector<std::string_view> _read_views {};
+
+  //! Arm or stop the read rules' reads as their interest says, returning whether any is interested.
+  bool update_read_rules();
+  //! Add a read rule's completion to its batch.
+  void complete_read( ReadRule& rule, const io_uring_cqe& cqe );
+  //! Deliver a read rule's batch, give back its buffers, and handle its read having stopped (if it has).
+  void finish_reads( ReadRule& rule );
+  //! A write() failed with `err`: unless that was for want of room, cancel its owner, as an error on its fd would.
+  void write_failed( const std::weak_ptr<BasicRule>& owner, int err );
+
+  //! The timers, kept in a timing wheel (by ticks since _timer_origin). The next tick the wheel has work at is
+  //! set on a single timerfd, which an fd rule of its own watches.
+  static constexpr std::chrono::microseconds TIMER_TICK { 100 };
+  std::optional<FileDescriptor> _timer_fd {};
+  std::optional<uint64_t> _timer_fd_wakeup {}; //!< The tick the timerfd is set to go off at, if it is.
+  Clock::time_point _timer_origin {};
+  TimerWheel _timer_wheel {};
+  std::unordered_map<uint64_t, std::shared_ptr<TimerRule>> _timers {};
+  uint64_t _next_timer_id {};
+
+  //! Arm the timer to go off at `deadline` (or disarm it).
+  void schedule_timer( TimerRule& timer, std::optional<Clock::time_point> deadline );
+  //! Run the callbacks of the timers that have gone off.
+  void expire_timers();
+  //! Set the timerfd to go off at the wheel's next wakeup, if that has changed.
+  void set_timer_fd();
+
+  //! Note whether the rule is interested at this iteration, updating the backend's registration if that changed.
+  void update_interest( FDRuleList::iterator it );
+  //! Stop watching the rule's fd (if no other rule needs it), and remove the rule.
+  FDRuleList::iterator erase_rule( FDRuleList::iterator it );
+  void epoll_update( int fd_num, EpollEntry& entry );
+
+  //! Serve the non-fd rules, returning whether any fired.
+  bool serve_non_fd_rules();
+  //! With Dispatch::All, serve a ready rule again, while it is still ready, until its budget is spent.
+  void serve_again( FDRule& rule );
+
+  //! Wait for events, and return the rules with something to report (with FDRule::revents set), in order.
+  std::vector<FDRuleList::iterator> poll_ready( int timeout_ms );
+  std::vector<FDRuleList::iterator> epoll_ready( int timeout_ms );
+  //! With the io_uring, also handle the completions that arrive (which `served_reads` says if any were reads).
+  std::vector<FDRuleList::iterator> ring_ready( int timeout_ms, bool& served_reads );
 
 public:
-  EventLoop() { _rule_categories.reserve( 64 ); }
+  //! Use `backend` (or poll, if epoll isn't available), serving what `dispatch` says on each iteration.
+  explicit EventLoop( Backend backend = Backend::Epoll, Dispatch dispatch = Dispatch::One, unsigned budget = 1 );
+
+  //! Stops the reads in the io_uring, and waits for the writes there to finish.
+  ~EventLoop();
+  EventLoop( const EventLoop& other ) = delete;
+  EventLoop& operator=( const EventLoop& other ) = delete;
+  EventLoop( EventLoop&& other ) = delete;
+  EventLoop& operator=( EventLoop&& other ) = delete;
+
+  Backend backend() const { return _backend; }
 
   //! Returned by each call to EventLoop::wait_next_event.
   enum class Result
@@ -73,6 +245,7 @@ public:
 
   class RuleHandle
   {
+    friend class EventLoop;
     std::weak_ptr<BasicRule> rule_weak_ptr_;
 
   public:
@@ -81,23 +254,54 @@ public:
     {}
 
     void cancel();
+
+    //! Turn the rule's interest on or off (with no interest predicate, this is all that decides it).
+    void enable();
+    void disable();
   };
 
-  RuleHandle add_rule(
-    size_t category_id,
-    FileDescriptor& fd,
-    Direction direction,
-    const CallbackT& callback,
-    const InterestT& interest = [] { return true; },
-    const CallbackT& cancel = [] {},
-    const CallbackT& error = [] {} );
-
-  RuleHandle add_rule(
-    size_t category_id,
-    const CallbackT& callback,
-    const InterestT& interest = [] { return true; } );
-
-  //! Calls [poll(2)](\ref man2::poll) and then executes callback for each ready fd.
+  RuleHandle add_rule( size_t category_id,
+                       FileDescriptor& fd,
+                       Direction direction,
+                       const CallbackT& callback,
+                       const InterestT& interest = {},
+                       const CallbackT& cancel = [] {},
+                       const CallbackT& error = [] {} );
+
+  RuleHandle add_rule( size_t category_id, const CallbackT& callback, const InterestT& interest = {} );
+
+  //! \brief Add a rule that reads from `fd` while interested, and calls `callback` with what the reads on each
+  //! wakeup returned (each one's data: a datagram, or a chunk of a stream).
+  //! \details With Backend::IoUring, the reads are multishot reads into the ring's provided buffers: one request
+  //! reads each datagram as it arrives, and the callback gets all that have arrived. Otherwise, it is an fd rule
+  //! that reads into buffers of the loop's, until the fd has no more (if non-blocking) or the buffers run out.
+  RuleHandle add_read_rule( size_t category_id,
+                            FileDescriptor& fd,
+                            const ReadCallbackT& callback,
+                            const InterestT& interest = {},
+                            const CallbackT& cancel = [] {} );
+
+  //! \brief Write `buffers` to `fd`, as one writev, for the rule `owner` (e.g. the read rule on the same fd).
+  //! \details With Backend::IoUring, the write is queued, and submitted (with any others) when the loop next
+  //! waits; otherwise, it is written right away. Meant for datagrams: queued writes may finish out of order, and
+  //! one that finds no room (EAGAIN or ENOBUFS) is dropped, like a datagram lost on the way. Any other error is
+  //! the owner's: it is cancelled (after its error callback, if it has one), as when its fd has an error.
+  void write( FileDescriptor& fd, std::vector<std::string>&& buffers, const RuleHandle& owner );
+
+  //! \brief Add a timer, whose callback runs once `delay` has passed (if it isn't std::nullopt), and then every
+  //! `period` after that (if it is nonzero).
+  //! \details Timers have a resolution of EventLoop::TIMER_TICK, and never go off early. All the timers that have
+  //! gone off are served together, like one ready fd rule. A disabled timer skips its callback when it goes off,
+  //! and a cancelled one is dropped when it would have gone off.
+  RuleHandle add_timer( size_t category_id,
+                        std::optional<Clock::duration> delay,
+                        const CallbackT& callback,
+                        Clock::duration period = {} );
+
+  //! Arm a timer to go off once `delay` has passed (instead of when it was going to), or disarm it (std::nullopt).
+  void set_timer( const RuleHandle& timer, std::optional<Clock::duration> delay );
+
+  //! Waits for the fds (with the backend) and then executes callbacks for ready fds (as the Dispatch says).
   Result wait_next_event( int timeout_ms );
 
   // convenience function to add category and rule at the same time
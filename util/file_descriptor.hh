@@ -3,6 +3,9 @@
 #include <cstddef>
 #include <limits>
 #include <memory>
+#include <span>
+#include <string>
+#include <string_view>
 #include <vector>
 
 // A reference-counted handle to a file descriptor
@@ -65,6 +68,10 @@ public:
   void read( std::string& buffer );
   void read( std::vector<std::string>& buffers );
 
+  // Read into caller-owned storage (e.g. regions from Writer::reserve())
+  // returns number of bytes read
+  size_t read( const std::vector<std::span<char>>& buffers );
+
   // Attempt to write a buffer
   // returns number of bytes written
   size_t write( std::string_view buffer );
@@ -87,6 +94,7 @@ public:
   int fd_num() const { return internal_fd_->fd_; }                        // underlying descriptor number
   bool eof() const { return internal_fd_->eof_; }                         // EOF flag state
   bool closed() const { return internal_fd_->closed_; }                   // closed flag state
+  bool blocking() const { return not internal_fd_->non_blocking_; }       // blocking flag state
   unsigned int read_count() const { return internal_fd_->read_count_; }   // number of reads
   unsigned int write_count() const { return internal_fd_->write_count_; } // number of writes
 
@@ -0,0 +1,202 @@
+#include "io_uring.hh"
+#include "exception.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+// The ring's indices are shared with the kernel, which reads what we publish (and vice versa)
+uint32_t load_acquire( uint32_t* index )
+{
+  return atomic_ref { *index }.load( memory_order_acquire );
+}
+
+void store_release( uint32_t* index, const uint32_t value )
+{
+  atomic_ref { *index }.store( value, memory_order_release );
+}
+
+int setup( const unsigned entries, io_uring_params& params )
+{
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = entries * 4;
+  return CheckSystemCall( "io_uring_setup",
+                          static_cast<int>( ::syscall( __NR_io_uring_setup, entries, &params ) ) );
+}
+
+} // namespace
+
+IoUring::Mapping::Mapping( const size_t length, const int prot, const int flags, const int fd, const off_t offset )
+  : addr_( ::mmap( nullptr, length, prot, flags, fd, offset ) ), length_( length )
+{
+  if ( addr_ == MAP_FAILED ) { // NOLINT(*-cstyle-cast, *-int-to-ptr)
+    throw unix_error( "mmap" );
+  }
+}
+
+IoUring::Mapping::Mapping( Mapping&& other ) noexcept : addr_( other.addr_ ), length_( other.length_ )
+{
+  other.addr_ = nullptr;
+}
+
+IoUring::Mapping::~Mapping()
+{
+  if ( addr_ ) {
+    ::munmap( addr_, length_ );
+  }
+}
+
+IoUring::IoUring( const unsigned entries ) : IoUring( entries, io_uring_params {} ) {}
+
+// NOLINTBEGIN(*-signed-bitwise)
+IoUring::IoUring( const unsigned entries, io_uring_params&& params ) : fd_( setup( entries, params ) )
+{
+  mappings_.reserve( 4 );
+
+  // Map the two queues (in one mapping, on kernels that allow it), and the SQEs
+  const size_t sq_size = params.sq_off.array + params.sq_entries * sizeof( uint32_t );
+  const size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe );
+  const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+  const auto& sq = mappings_.emplace_back( single ? max( sq_size, cq_size ) : sq_size,
+                                           PROT_READ | PROT_WRITE,
+                                           MAP_SHARED | MAP_POPULATE,
+                                           fd_.fd_num(),
+                                           IORING_OFF_SQ_RING );
+  const auto& cq
+    = single ? sq
+             : mappings_.emplace_back(
+                 cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_.fd_num(), IORING_OFF_CQ_RING );
+  const auto& sqes = mappings_.emplace_back( params.sq_entries * sizeof( io_uring_sqe ),
+                                             PROT_READ | PROT_WRITE,
+                                             MAP_SHARED | MAP_POPULATE,
+                                             fd_.fd_num(),
+                                             IORING_OFF_SQES );
+
+  sq_head_ = sq.at<uint32_t>( params.sq_off.head );
+  sq_tail_ = sq.at<uint32_t>( params.sq_off.tail );
+  sq_array_ = sq.at<uint32_t>( params.sq_off.array );
+  sq_mask_ = *sq.at<uint32_t>( params.sq_off.ring_mask );
+  sq_entries_ = params.sq_entries;
+  sqes_ = sqes.at<io_uring_sqe>( 0 );
+  sq_queued_tail_ = *sq_tail_;
+
+  cq_head_ = cq.at<uint32_t>( params.cq_off.head );
+  cq_tail_ = cq.at<uint32_t>( params.cq_off.tail );
+  cq_mask_ = *cq.at<uint32_t>( params.cq_off.ring_mask );
+  cqes_ = cq.at<io_uring_cqe>( params.cq_off.cqes );
+
+  // Which operations does the kernel know?
+  constexpr size_t ops = 256;
+  vector<char> storage( sizeof( io_uring_probe ) + ops * sizeof( io_uring_probe_op ) );
+  auto* probe = reinterpret_cast<io_uring_probe*>( storage.data() ); // NOLINT(*-reinterpret-cast)
+  if ( ::syscall( __NR_io_uring_register, fd_.fd_num(), IORING_REGISTER_PROBE, probe, ops ) == 0 ) {
+    for ( unsigned op = 0; op <= probe->last_op and op < probe->ops_len; ++op ) {
+      supported_.set( op, probe->ops[op].flags & IO_URING_OP_SUPPORTED ); // NOLINT(*-pointer-arithmetic)
+    }
+  }
+}
+
+io_uring_sqe& IoUring::next_sqe()
+{
+  if ( sq_queued_tail_ - load_acquire( sq_head_ ) == sq_entries_ ) {
+    enter( false );
+  }
+
+  const uint32_t index = sq_queued_tail_++ & sq_mask_;
+  sq_array_[index] = index; // NOLINT(*-pointer-arithmetic)
+  auto& sqe = sqes_[index]; // NOLINT(*-pointer-arithmetic)
+  sqe = {};
+  return sqe;
+}
+
+void IoUring::enter( const bool wait, const int timeout_ms )
+{
+  store_release( sq_tail_, sq_queued_tail_ );
+  const uint32_t to_submit = sq_queued_tail_ - load_acquire( sq_head_ );
+  if ( to_submit == 0 and not wait ) {
+    return;
+  }
+
+  unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+  __kernel_timespec timeout {};
+  io_uring_getevents_arg arg {};
+  if ( wait and timeout_ms >= 0 ) {
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = static_cast<int64_t>( timeout_ms % 1000 ) * 1'000'000;
+    arg.ts = reinterpret_cast<uint64_t>( &timeout ); // NOLINT(*-reinterpret-cast)
+    flags |= IORING_ENTER_EXT_ARG;
+  }
+
+  const long ret = ::syscall( __NR_io_uring_enter,
+                              fd_.fd_num(),
+                              to_submit,
+                              wait ? 1 : 0,
+                              flags,
+                              flags & IORING_ENTER_EXT_ARG ? &arg : nullptr,
+                              flags & IORING_ENTER_EXT_ARG ? sizeof( arg ) : 0 );
+  // timing out, a signal, or completions to reap first are all just an early return
+  if ( ret < 0 and errno != ETIME and errno != EINTR and errno != EBUSY and errno != EAGAIN ) {
+    throw unix_error( "io_uring_enter" );
+  }
+}
+// NOLINTEND(*-signed-bitwise)
+
+span<const io_uring_cqe> IoUring::completions()
+{
+  completed_.clear();
+  uint32_t head = *cq_head_;
+  const uint32_t tail = load_acquire( cq_tail_ );
+  for ( ; head != tail; ++head ) {
+    completed_.push_back( cqes_[head & cq_mask_] ); // NOLINT(*-pointer-arithmetic)
+  }
+  store_release( cq_head_, head );
+  return completed_;
+}
+
+void IoUring::provide_buffers( const uint16_t group, const uint16_t count, const size_t size )
+{
+  buffers_.resize( count * size );
+  buf_size_ = size;
+  buf_mask_ = count - 1;
+
+  const auto& ring = mappings_.emplace_back(
+    count * sizeof( io_uring_buf ), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+  buf_ring_ = ring.at<io_uring_buf>( 0 );
+
+  io_uring_buf_reg reg {};
+  reg.ring_addr = reinterpret_cast<uint64_t>( buf_ring_ ); // NOLINT(*-reinterpret-cast)
+  reg.ring_entries = count;
+  reg.bgid = group;
+  CheckSystemCall( "io_uring_register",
+                   static_cast<int>(
+                     ::syscall( __NR_io_uring_register, fd_.fd_num(), IORING_REGISTER_PBUF_RING, &reg, 1 ) ) );
+
+  for ( uint16_t id = 0; id < count; ++id ) {
+    recycle( id );
+  }
+}
+
+string_view IoUring::buffer( const uint16_t id, const size_t length ) const
+{
+  return { buffers_.data() + id * buf_size_, min( length, buf_size_ ) };
+}
+
+void IoUring::recycle( const uint16_t id )
+{
+  auto& buf = buf_ring_[buf_tail_ & buf_mask_]; // NOLINT(*-pointer-arithmetic)
+  buf.addr = reinterpret_cast<uint64_t>( buffers_.data() + id * buf_size_ ); // NOLINT(*-reinterpret-cast)
+  buf.len = buf_size_;
+  buf.bid = id;
+
+  // the ring's tail overlays the first entry's (otherwise unused) last field
+  atomic_ref { buf_ring_->resv }.store( ++buf_tail_, memory_order_release );
+}
+
+IoUring::~IoUring() = default;
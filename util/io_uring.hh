@@ -0,0 +1,103 @@
+#pragma once
+
+#include "file_descriptor.hh"
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <span>
+#include <string_view>
+#include <vector>
+
+//! \brief An [io_uring](\ref man7::io_uring) instance, set up with the raw system calls.
+//! \details Requests are queued as submission queue entries (SQEs), and submitted all together by enter(),
+//! which can also wait for their completions (CQEs) in the same system call. The ring can also keep a ring of
+//! buffers that it provides to the kernel, for reads that select their buffer when data arrives
+//! (IOSQE_BUFFER_SELECT).
+class IoUring
+{
+public:
+  //! Set up a ring with room for `entries` queued submissions (and four times as many completions). Throws
+  //! unix_error if the kernel has no io_uring, or doesn't allow it.
+  explicit IoUring( unsigned entries );
+
+  //! IORING_OP_READ_MULTISHOT (Linux 6.7), which older kernel headers lack
+  static constexpr uint8_t OP_READ_MULTISHOT = 49;
+
+  //! Does the kernel support the operation?
+  bool supports( uint8_t opcode ) const { return opcode < supported_.size() and supported_.test( opcode ); }
+
+  //! A cleared SQE to fill in, which the next enter() submits (if the queue is full, this enters first).
+  io_uring_sqe& next_sqe();
+
+  //! Submit the queued SQEs, and if `wait`, wait up to `timeout_ms` (or forever, if negative) for a completion.
+  void enter( bool wait, int timeout_ms = -1 );
+
+  //! Take the completions so far (valid until the next call).
+  std::span<const io_uring_cqe> completions();
+
+  //! \brief Provide `count` buffers of `size` bytes each (count a power of two), as buffer group `group`.
+  //! \details A read that selects a buffer reports its ID in its CQE flags; recycle() gives it back afterwards.
+  void provide_buffers( uint16_t group, uint16_t count, size_t size );
+  std::string_view buffer( uint16_t id, size_t length ) const;
+  void recycle( uint16_t id );
+
+  ~IoUring();
+  IoUring( const IoUring& other ) = delete;
+  IoUring& operator=( const IoUring& other ) = delete;
+  IoUring( IoUring&& other ) = delete;
+  IoUring& operator=( IoUring&& other ) = delete;
+
+private:
+  IoUring( unsigned entries, io_uring_params&& params );
+
+  //! A memory mapping (of the ring's queues, or anonymous), unmapped on destruction
+  class Mapping
+  {
+    void* addr_;
+    size_t length_;
+
+  public:
+    Mapping( size_t length, int prot, int flags, int fd, off_t offset );
+    ~Mapping();
+    Mapping( const Mapping& other ) = delete;
+    Mapping& operator=( const Mapping& other ) = delete;
+    Mapping( Mapping&& other ) noexcept;
+    Mapping& operator=( Mapping&& other ) = delete;
+
+    template<typename T>
+    T* at( size_t offset ) const
+    {
+      return reinterpret_cast<T*>( static_cast<char*>( addr_ ) + offset ); // NOLINT(*-reinterpret-cast)
+    }
+  };
+
+  FileDescriptor fd_;
+  std::bitset<256> supported_ {};
+
+  std::vector<Mapping> mappings_ {};
+
+  // The submission queue: the kernel consumes entries from head to tail
+  uint32_t* sq_head_ {};
+  uint32_t* sq_tail_ {};
+  uint32_t* sq_array_ {};
+  uint32_t sq_mask_ {};
+  uint32_t sq_entries_ {};
+  io_uring_sqe* sqes_ {};
+  uint32_t sq_queued_tail_ {}; //!< The tail, with the SQEs queued since the last enter()
+
+  // The completion queue: the kernel produces entries at tail, and the ring consumes them from head
+  uint32_t* cq_head_ {};
+  uint32_t* cq_tail_ {};
+  uint32_t cq_mask_ {};
+  io_uring_cqe* cqes_ {};
+  std::vector<io_uring_cqe> completed_ {};
+
+  // The provided buffers, and the ring that hands them to the kernel
+  io_uring_buf* buf_ring_ {};
+  uint16_t buf_mask_ {};
+  uint16_t buf_tail_ {};
+  size_t buf_size_ {};
+  std::vector<char> buffers_ {};
+};
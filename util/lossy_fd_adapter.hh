@@ -7,6 +7,7 @@
 
 #include <optional>
 #include <random>
+#include <string_view>
 #include <utility>
 
 //! An adapter class that adds random dropping behavior to an FD adapter
@@ -49,6 +50,16 @@ public:
     return ret;
   }
 
+  //! \brief Parse a datagram that the caller has read from fd(), potentially dropping it
+  std::optional<TCPMessage> read( std::string_view datagram )
+  {
+    auto ret = _adapter.read( datagram );
+    if ( _should_drop( false ) ) {
+      return {};
+    }
+    return ret;
+  }
+
   //! \brief Write to the underlying AdapterT instance, potentially dropping the datagram to be written
   //! \param[in] seg is the packet to either write or drop
   void write( const TCPMessage& seg )
@@ -66,4 +77,5 @@ public:
   const FdAdapterConfig& config() const { return _adapter.config(); } //!< FdAdapterBase::config passthrough
   FdAdapterConfig& config_mut() { return _adapter.config_mut(); }     //!< FdAdapterBase::config_mut passthrough
   void tick( const size_t ms_since_last_tick ) { _adapter.tick( ms_since_last_tick ); }
+  void set_output( auto output ) { _adapter.set_output( std::move( output ) ); } //!< set_output passthrough
 };
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "buffer.hh"
+
 #include <algorithm>
 #include <concepts>
 #include <cstdint>
@@ -17,8 +19,7 @@ class Parser
   class BufferList
   {
     uint64_t size_ {};
-    std::deque<std::string> buffer_ {};
-    uint64_t skip_ {};
+    std::deque<Buffer> buffer_ {};
 
   public:
     explicit BufferList( const std::vector<std::string>& buffers )
@@ -28,6 +29,21 @@ class Parser
       }
     }
 
+    explicit BufferList( std::vector<std::string>&& buffers )
+    {
+      for ( auto& x : buffers ) {
+        append( std::move( x ) );
+      }
+    }
+
+    explicit BufferList( Buffer buffer )
+    {
+      size_ = buffer.size();
+      if ( size_ ) {
+        buffer_.push_back( std::move( buffer ) );
+      }
+    }
+
     uint64_t size() const { return size_; }
     uint64_t serialized_length() const { return size(); }
     bool empty() const { return size_ == 0; }
@@ -37,19 +53,18 @@ class Parser
       if ( buffer_.empty() ) {
         throw std::runtime_error( "peek on empty BufferList" );
       }
-      return std::string_view { buffer_.front() }.substr( skip_ );
+      return buffer_.front();
     }
 
     void remove_prefix( uint64_t len )
     {
       while ( len and not buffer_.empty() ) {
         const uint64_t to_pop_now = std::min( len, peek().size() );
-        skip_ += to_pop_now;
+        buffer_.front().remove_prefix( to_pop_now );
         len -= to_pop_now;
         size_ -= to_pop_now;
-        if ( skip_ == buffer_.front().size() ) {
+        if ( buffer_.front().empty() ) {
           buffer_.pop_front();
-          skip_ = 0;
         }
       }
     }
@@ -57,18 +72,11 @@ class Parser
     void dump_all( std::vector<std::string>& out )
     {
       out.clear();
-      if ( empty() ) {
-        return;
-      }
-      std::string first_str = std::move( buffer_.front() );
-      if ( skip_ ) {
-        first_str = first_str.substr( skip_ );
-      }
-      out.emplace_back( std::move( first_str ) );
-      buffer_.pop_front();
       for ( auto&& x : buffer_ ) {
-        out.emplace_back( std::move( x ) );
+        out.emplace_back( x.release() );
       }
+      buffer_.clear();
+      size_ = 0;
     }
 
     void dump_all( std::string& out )
@@ -86,6 +94,20 @@ class Parser
       }
     }
 
+    void dump_all( Buffer& out )
+    {
+      if ( buffer_.size() == 1 ) {
+        out = std::move( buffer_.front() ); // no copy: `out` shares the input's storage
+        buffer_.clear();
+        size_ = 0;
+        return;
+      }
+
+      std::string concat;
+      dump_all( concat );
+      out = std::move( concat );
+    }
+
     std::vector<std::string_view> buffer() const
     {
       if ( empty() ) {
@@ -93,18 +115,19 @@ class Parser
       }
       std::vector<std::string_view> ret;
       ret.reserve( buffer_.size() );
-      auto tmp_skip = skip_;
       for ( const auto& x : buffer_ ) {
-        ret.push_back( std::string_view { x }.substr( tmp_skip ) );
-        tmp_skip = 0;
+        ret.push_back( x );
       }
       return ret;
     }
 
     void append( std::string str )
     {
+      if ( str.empty() ) {
+        return;
+      }
       size_ += str.size();
-      buffer_.push_back( std::move( str ) );
+      buffer_.emplace_back( std::move( str ) );
     }
   };
 
@@ -120,6 +143,8 @@ class Parser
 
 public:
   explicit Parser( const std::vector<std::string>& input ) : input_( input ) {}
+  explicit Parser( std::vector<std::string>&& input ) : input_( std::move( input ) ) {}
+  explicit Parser( Buffer input ) : input_( std::move( input ) ) {}
 
   const BufferList& input() const { return input_; }
 
@@ -166,6 +191,7 @@ public:
 
   void all_remaining( std::vector<std::string>& out ) { input_.dump_all( out ); }
   void all_remaining( std::string& out ) { input_.dump_all( out ); }
+  void all_remaining( Buffer& out ) { input_.dump_all( out ); }
   std::vector<std::string_view> buffer() const { return input_.buffer(); }
 };
 
@@ -197,6 +223,8 @@ public:
     }
   }
 
+  void buffer( const Buffer& buf ) { buffer( std::string { buf.view() } ); }
+
   void buffer( const std::vector<std::string>& bufs )
   {
     for ( const auto& b : bufs ) {
@@ -236,3 +264,12 @@ bool parse( T& obj, const std::vector<std::string>& buffers, Targs&&... Fargs )
   obj.parse( p, std::forward<Targs>( Fargs )... );
   return not p.has_error();
 }
+
+// Same as above, but takes ownership of the buffers so the parsed object can keep slices of them without copying
+template<class T, typename... Targs>
+bool parse( T& obj, std::vector<std::string>&& buffers, Targs&&... Fargs )
+{
+  Parser p { std::move( buffers ) };
+  obj.parse( p, std::forward<Targs>( Fargs )... );
+  return not p.has_error();
+}
@@ -0,0 +1,222 @@
+#include "spsc_byte_stream.hh"
+
+#include "exception.hh"
+
+#include <algorithm>
+#include <array>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/eventfd.h>
+
+using namespace std;
+
+// The pushed/popped handoff uses the default (sequentially consistent) ordering on purpose: each side
+// stores its own counter and then loads the other's to decide whether to signal. With seq_cst, at least
+// one of the two loads observes the other side's store, so a waiting side can never miss its wakeup.
+
+SPSCByteStream::SPSCByteStream( uint64_t capacity )
+  : capacity_( capacity )
+  , ring_( capacity, '\0' )
+  , data_event_( CheckSystemCall( "eventfd", ::eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ) )
+  , space_event_( CheckSystemCall( "eventfd", ::eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ) )
+{
+  signal( space_event_ ); // an empty stream is writable
+}
+
+void SPSCByteStream::signal( FileDescriptor& event )
+{
+  const uint64_t one = 1;
+  event.write( string_view { reinterpret_cast<const char*>( &one ), sizeof( one ) } ); // NOLINT(*-reinterpret-cast)
+}
+
+void SPSCByteStream::clear( FileDescriptor& event )
+{
+  string counter( sizeof( uint64_t ), '\0' );
+  event.read( counter );
+}
+
+void SPSCByteStream::wait_for( FileDescriptor& event, int timeout_ms )
+{
+  pollfd pfd { event.fd_num(), POLLIN, 0 };
+  CheckSystemCall( "poll", ::poll( &pfd, 1, timeout_ms ) );
+}
+
+void SPSCByteStream::set_error()
+{
+  error_ = true;
+  signal( data_event_ );
+  signal( space_event_ );
+}
+
+bool SPSCByteStream::has_error() const
+{
+  return error_;
+}
+
+uint64_t SPSCWriter::push( string_view data )
+{
+  uint64_t written = 0;
+  for ( const auto region : reserve( data.size() ) ) {
+    written += data.copy( region.data(), region.size(), written );
+  }
+  commit( written );
+  return written;
+}
+
+vector<span<char>> SPSCWriter::reserve( uint64_t max_len )
+{
+  vector<span<char>> regions;
+  reserved_len_ = closed_.load( memory_order_relaxed ) ? 0 : min( max_len, available_capacity() );
+  if ( reserved_len_ == 0 ) {
+    return regions;
+  }
+
+  const uint64_t tail = pushed_.load( memory_order_relaxed ) % capacity_;
+  const uint64_t first_len = min( reserved_len_, capacity_ - tail );
+  regions.emplace_back( ring_.data() + tail, first_len );
+  if ( first_len < reserved_len_ ) {
+    regions.emplace_back( ring_.data(), reserved_len_ - first_len );
+  }
+  return regions;
+}
+
+void SPSCWriter::commit( uint64_t len )
+{
+  if ( len > reserved_len_ ) {
+    throw runtime_error( "SPSCWriter::commit() called with more bytes than were reserved" );
+  }
+  reserved_len_ = 0;
+  if ( len == 0 ) {
+    return;
+  }
+
+  const uint64_t pushed = pushed_.load( memory_order_relaxed );
+  pushed_ = pushed + len;
+  if ( popped_ == pushed ) {
+    signal( data_event_ ); // the stream was empty, so the reader may be waiting
+  }
+}
+
+void SPSCWriter::close()
+{
+  closed_ = true;
+  signal( data_event_ );
+}
+
+bool SPSCWriter::is_closed() const
+{
+  return closed_;
+}
+
+uint64_t SPSCWriter::available_capacity() const
+{
+  return capacity_ - ( pushed_.load( memory_order_relaxed ) - popped_ );
+}
+
+uint64_t SPSCWriter::bytes_pushed() const
+{
+  return pushed_.load( memory_order_relaxed );
+}
+
+void SPSCWriter::wait( int timeout_ms )
+{
+  clear( space_event_ );
+  if ( available_capacity() == 0 and not has_error() ) {
+    wait_for( space_event_, timeout_ms );
+  }
+}
+
+string_view SPSCReader::peek() const
+{
+  const uint64_t popped = popped_.load( memory_order_relaxed );
+  const uint64_t buffered = pushed_.load( memory_order_acquire ) - popped;
+  if ( buffered == 0 ) {
+    return {};
+  }
+  const uint64_t head = popped % capacity_;
+  return string_view { ring_ }.substr( head, min( buffered, capacity_ - head ) );
+}
+
+vector<string_view> SPSCReader::peek_all( uint64_t max_len ) const
+{
+  vector<string_view> views;
+  const uint64_t len = min( max_len, bytes_buffered() );
+  if ( len == 0 ) {
+    return views;
+  }
+  views.push_back( peek().substr( 0, len ) );
+  if ( views.back().size() < len ) {
+    views.push_back( string_view { ring_ }.substr( 0, len - views.back().size() ) );
+  }
+  return views;
+}
+
+void SPSCReader::pop( uint64_t len )
+{
+  const uint64_t popped = popped_.load( memory_order_relaxed );
+  len = min( len, pushed_.load( memory_order_acquire ) - popped );
+  if ( len == 0 ) {
+    return;
+  }
+
+  popped_ = popped + len;
+  if ( pushed_ - popped == capacity_ ) {
+    signal( space_event_ ); // the stream was full, so the writer may be waiting
+  }
+}
+
+Buffer SPSCReader::pop_buffer( uint64_t max_len )
+{
+  Buffer ret { string { peek().substr( 0, max_len ) } };
+  pop( ret.size() );
+  return ret;
+}
+
+bool SPSCReader::is_finished() const
+{
+  return closed_ and bytes_buffered() == 0;
+}
+
+uint64_t SPSCReader::bytes_buffered() const
+{
+  return pushed_.load( memory_order_acquire ) - popped_.load( memory_order_relaxed );
+}
+
+uint64_t SPSCReader::bytes_popped() const
+{
+  return popped_.load( memory_order_relaxed );
+}
+
+void SPSCReader::wait( int timeout_ms )
+{
+  clear( data_event_ );
+  if ( bytes_buffered() == 0 and not closed_ and not has_error() ) {
+    wait_for( data_event_, timeout_ms );
+  }
+}
+
+SPSCReader& SPSCByteStream::reader()
+{
+  static_assert( sizeof( SPSCReader ) == sizeof( SPSCByteStream ),
+                 "Please add member variables to the SPSCByteStream base, not the SPSCReader." );
+
+  return static_cast<SPSCReader&>( *this ); // NOLINT(*-downcast)
+}
+
+const SPSCReader& SPSCByteStream::reader() const
+{
+  return static_cast<const SPSCReader&>( *this ); // NOLINT(*-downcast)
+}
+
+SPSCWriter& SPSCByteStream::writer()
+{
+  static_assert( sizeof( SPSCWriter ) == sizeof( SPSCByteStream ),
+                 "Please add member variables to the SPSCByteStream base, not the SPSCWriter." );
+
+  return static_cast<SPSCWriter&>( *this ); // NOLINT(*-downcast)
+}
+
+const SPSCWriter& SPSCByteStream::writer() const
+{
+  return static_cast<const SPSCWriter&>( *this ); // NOLINT(*-downcast)
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "buffer.hh"
+#include "file_descriptor.hh"
+
+#include <atomic>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class SPSCReader;
+class SPSCWriter;
+
+//! \brief A ByteStream that one writer thread and one reader thread can share without locks.
+//! \details The bytes live in a ring preallocated to `capacity`. The two sides coordinate only through
+//! the atomic pushed/popped counters (plus the closed/error flags). Each side also owns an eventfd, and
+//! the other side signals it when the first may be waiting: the writer signals `data_event_` when it
+//! pushes into an empty stream, and the reader signals `space_event_` when it pops from a full one.
+//! Either eventfd can be added to an EventLoop rule, or a thread can block on it with wait().
+class SPSCByteStream
+{
+public:
+  explicit SPSCByteStream( uint64_t capacity );
+
+  SPSCReader& reader();
+  const SPSCReader& reader() const;
+  SPSCWriter& writer();
+  const SPSCWriter& writer() const;
+
+  void set_error();       //!< Signal that the stream suffered an error.
+  bool has_error() const; //!< Has the stream had an error?
+
+  //! Shared across threads, so neither copyable nor movable
+  SPSCByteStream( const SPSCByteStream& ) = delete;
+  SPSCByteStream& operator=( const SPSCByteStream& ) = delete;
+  SPSCByteStream( SPSCByteStream&& ) = delete;
+  SPSCByteStream& operator=( SPSCByteStream&& ) = delete;
+  ~SPSCByteStream() = default;
+
+protected:
+  uint64_t capacity_;
+  std::string ring_;
+
+  alignas( 64 ) std::atomic<uint64_t> pushed_ {}; // written only by the writer
+  alignas( 64 ) std::atomic<uint64_t> popped_ {}; // written only by the reader
+  std::atomic<bool> closed_ {};
+  std::atomic<bool> error_ {};
+
+  FileDescriptor data_event_;  //!< readable when the reader may have something to do
+  FileDescriptor space_event_; //!< readable when the writer may have something to do
+
+  uint64_t reserved_len_ {}; //!< size of the region handed out by the last SPSCWriter::reserve() (writer only)
+
+  static void signal( FileDescriptor& event );
+  static void clear( FileDescriptor& event );
+  static void wait_for( FileDescriptor& event, int timeout_ms );
+};
+
+class SPSCWriter : public SPSCByteStream
+{
+public:
+  uint64_t push( std::string_view data ); //!< Copy in as much of `data` as fits; returns bytes pushed
+  void close();                           //!< Signal that nothing more will be written.
+
+  //! Borrow writable room in the ring for up to `max_len` bytes (up to two regions, as with ByteStream's Ring
+  //! storage). Fill a prefix of it, then call commit() with the number of bytes written to make them readable.
+  std::vector<std::span<char>> reserve( uint64_t max_len = UINT64_MAX );
+  void commit( uint64_t len );
+
+  bool is_closed() const;
+  uint64_t available_capacity() const;
+  uint64_t bytes_pushed() const;
+
+  //! Block (up to `timeout_ms`, or forever if negative) until there is capacity or the stream has an error
+  void wait( int timeout_ms = -1 );
+
+  //! The eventfd to poll for writability; callbacks should call clear_event() before checking capacity
+  FileDescriptor& event_fd() { return space_event_; }
+  void clear_event() { clear( space_event_ ); }
+  void notify_self() { signal( space_event_ ); } //!< Re-arm event_fd(), e.g. when capacity is left over
+};
+
+class SPSCReader : public SPSCByteStream
+{
+public:
+  std::string_view peek() const; //!< Peek at the next bytes in the buffer (up to the wrap point)
+  std::vector<std::string_view> peek_all( uint64_t max_len = UINT64_MAX ) const; //!< All buffered bytes
+  void pop( uint64_t len );                                                      //!< Remove `len` bytes
+  //! Remove and return up to `max_len` of the next bytes (copied out, up to the wrap point)
+  Buffer pop_buffer( uint64_t max_len = UINT64_MAX );
+
+  bool is_finished() const;
+  uint64_t bytes_buffered() const;
+  uint64_t bytes_popped() const;
+
+  //! Block (up to `timeout_ms`, or forever if negative) until bytes are buffered or the stream is finished
+  void wait( int timeout_ms = -1 );
+
+  //! The eventfd to poll for readability; callbacks should call clear_event() before checking for bytes
+  FileDescriptor& event_fd() { return data_event_; }
+  void clear_event() { clear( data_event_ ); }
+  void notify_self() { signal( data_event_ ); } //!< Re-arm event_fd(), e.g. when bytes are left over
+};
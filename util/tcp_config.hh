@@ -1,6 +1,9 @@
 #pragma once
 
 #include "address.hh"
+#include "byte_stream.hh"
+#include "congestion_control.hh"
+#include "reassembler.hh"
 #include "wrapping_integers.hh"
 
 #include <cstddef>
@@ -17,9 +20,35 @@ public:
   static constexpr unsigned MAX_RETX_ATTEMPTS = 8;  //!< Maximum re-transmit attempts before giving up
 
   uint16_t rt_timeout = TIMEOUT_DFLT;      //!< Initial value of the retransmission timeout, in milliseconds
-  size_t recv_capacity = DEFAULT_CAPACITY; //!< Receive capacity, in bytes
+  size_t recv_capacity = DEFAULT_CAPACITY; //!< Receive capacity, in bytes (the ceiling, with recv_autotune)
   size_t send_capacity = DEFAULT_CAPACITY; //!< Sender capacity, in bytes
   Wrap32 isn { 137 };                      //!< Default initial sequence number
+
+  bool adaptive_RTO = false;   //!< Derive the RTO from measured round trips (RFC 6298), starting from rt_timeout?
+  uint64_t min_RTO_ms = 200;   //!< Lower bound on the adaptive RTO
+  uint64_t max_RTO_ms = 60000; //!< Upper bound on the adaptive RTO, including backoff
+
+  bool sack = false;        //!< Offer selective acknowledgments (RFC 2018), and resend only the holes they show?
+  uint8_t window_scale = 0; //!< Window-scale shift count to offer (RFC 7323), or 0 to keep windows within 64 KiB
+
+  uint16_t mss = MAX_PAYLOAD_SIZE; //!< Largest payload to send or receive in a segment (the advertised MSS)
+  bool path_mtu_discovery = false; //!< Start from MAX_PAYLOAD_SIZE and probe (RFC 4821) for the largest that fits?
+
+  bool nagle = false;               //!< Hold back a small segment while earlier data is unacknowledged (RFC 896)?
+  uint64_t flush_deadline_ms = 200; //!< The longest a small segment may be held back (by Nagle, or a cork)
+
+  bool delayed_ack = false;   //!< ACK every second segment, or after ack_delay_ms, instead of each (RFC 1122)?
+  uint64_t ack_delay_ms = 40; //!< The longest an ACK may be delayed
+
+  bool pacing = false; //!< Spread segments over each round trip at the congestion control's pacing rate?
+
+  bool recv_autotune = false;           //!< Grow the receive buffer from recv_initial_capacity as the flow needs?
+  size_t recv_initial_capacity = 16000; //!< Where an autotuned receive buffer starts (and returns when idle)
+  uint64_t recv_idle_ms = 1000;         //!< How long without data before an autotuned buffer shrinks back
+
+  ByteStream::Storage stream_storage = ByteStream::Storage::Chunked;                    //!< Stream storage
+  Reassembler::Engine reassembler_engine = Reassembler::Engine::Map;                    //!< Reassembly engine
+  CongestionControl::Algorithm congestion_control = CongestionControl::Algorithm::None; //!< Congestion control
 };
 
 //! Config for classes derived from FdAdapter
@@ -2,8 +2,10 @@
 
 #include "byte_stream.hh"
 #include "eventloop.hh"
+#include "exception.hh"
 #include "file_descriptor.hh"
 #include "socket.hh"
+#include "spsc_byte_stream.hh"
 #include "tcp_config.hh"
 #include "tcp_peer.hh"
 #include "tuntap_adapter.hh"
@@ -11,6 +13,7 @@
 #include <atomic>
 #include <cstdint>
 #include <optional>
+#include <sys/eventfd.h>
 #include <thread>
 #include <vector>
 
@@ -58,6 +61,15 @@ public:
   // Return peer address from underlying datagram adapter
   const Address& peer_address() const { return _datagram_adapter.config().destination; }
 
+  //! \brief Hand application data to the TCPPeer thread through lock-free SPSCByteStreams instead of the socketpair
+  //! \details Call before connect() or listen_and_accept(). Afterwards the owner reads from inbound() and
+  //! writes to outbound() (blocking with their wait() methods if needed) rather than calling read()/write(). If
+  //! the connection ends while outbound() still holds bytes, it gets an error (which ends any wait()).
+  void use_shared_streams( uint64_t capacity = TCPConfig::DEFAULT_CAPACITY );
+
+  SPSCReader& inbound() { return _shared_inbound.value().reader(); }   //!< Bytes received from the peer
+  SPSCWriter& outbound() { return _shared_outbound.value().writer(); } //!< Bytes to send to the peer
+
 protected:
   //! Adapter to underlying datagram socket (e.g., UDP or IP)
   AdaptT _datagram_adapter;
@@ -66,14 +78,47 @@ private:
   //! Stream socket for reads and writes between owner and TCP thread
   LocalStreamSocket _thread_data;
 
+  //! In-process alternative to _thread_data (see use_shared_streams())
+  std::optional<SPSCByteStream> _shared_inbound {};
+  std::optional<SPSCByteStream> _shared_outbound {};
+
+  //! Event loop rules that move bytes between TCPPeer and the owner through _thread_data
+  void _add_socket_pair_rules();
+
+  //! Event loop rules that move bytes between TCPPeer and the owner through the shared streams
+  void _add_shared_stream_rules();
+
+  //! When the TCPPeer thread is done, release an owner waiting on either shared stream (if used)
+  void _finish_shared_streams();
+
   //! Set up the TCPPeer and the event loop
   void _initialize_TCP( const TCPConfig& config );
 
   //! TCP state machine
   std::optional<TCPPeer> _tcp {};
 
-  //! eventloop that handles all the events (new inbound datagram, new outbound bytes, new inbound bytes)
-  EventLoop _eventloop {};
+  //! How many times the event loop may serve one rule on one wakeup
+  static constexpr unsigned EVENT_BUDGET = 8;
+
+  //! eventloop that handles all the events (new inbound datagram, new outbound bytes, new inbound bytes),
+  //! serving all that are ready on each wakeup (and each one a few times, e.g. to drain several datagrams).
+  //! With io_uring, datagrams are read and written many to a system call (or else, it falls back to epoll).
+  EventLoop _eventloop { EventLoop::Backend::IoUring, EventLoop::Dispatch::All, EVENT_BUDGET };
+
+  //! The segments received on one wakeup, which the TCPPeer takes in together (kept for the next wakeup)
+  std::vector<TCPMessage> _received {};
+
+  //! Timer that goes off when the TCPPeer next has something to do (a retransmission, a delayed ACK, ...)
+  std::optional<EventLoop::RuleHandle> _tcp_timer {};
+
+  //! When the TCPPeer's clock (which counts whole milliseconds) was last brought up to date
+  EventLoop::Clock::time_point _last_tick {};
+
+  //! Tell the TCPPeer how much time has passed
+  void _tick();
+
+  //! Arm _tcp_timer for the TCPPeer's next deadline, or disarm it if the TCPPeer has none
+  void _set_tcp_timer();
 
   //! Process events while specified condition is true
   void _tcp_loop( const std::function<bool()>& condition );
@@ -89,6 +134,9 @@ private:
 
   std::atomic_bool _abort { false }; //!< Flag used by the owner to force the TCPPeer thread to shut down
 
+  //! An eventfd that the owner signals to wake the TCPPeer thread (to see the _abort flag)
+  FileDescriptor _wakeup_event { CheckSystemCall( "eventfd", ::eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ) };
+
   bool _inbound_shutdown { false }; //!< Has TCPMinnowSocket shut down the incoming data to the owner?
 
   bool _outbound_shutdown { false }; //!< Has the owner shut down the outbound data to the TCP connection?
@@ -128,6 +176,10 @@ public:
   {
     TCPConfig tcp_config;
     tcp_config.rt_timeout = 100;
+    tcp_config.adaptive_RTO = true;
+    tcp_config.min_RTO_ms = 10;
+    tcp_config.sack = true;
+    tcp_config.stream_storage = ByteStream::Storage::Ring;
 
     FdAdapterConfig multiplexer_config;
     multiplexer_config.source = { "169.254.144.9", std::to_string( uint16_t( std::random_device()() ) ) };
@@ -4,6 +4,7 @@
 #include "parser.hh"
 #include "tun.hh"
 
+#include <algorithm>
 #include <cstddef>
 #include <exception>
 #include <iostream>
@@ -15,35 +16,45 @@
 #include <unistd.h>
 #include <utility>
 
-static constexpr size_t TCP_TICK_MS = 10;
-
-inline uint64_t timestamp_ms()
+template<TCPDatagramAdapter AdaptT>
+void TCPMinnowSocket<AdaptT>::_tick()
 {
-  static_assert( std::is_same<std::chrono::steady_clock::duration, std::chrono::nanoseconds>::value );
+  const auto now = EventLoop::Clock::now();
+  const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>( now - _last_tick );
+  _last_tick += elapsed; // the rest of a millisecond counts toward the next tick
+
+  if ( _tcp.value().active() ) {
+    _tcp.value().tick( elapsed.count(), [&]( auto x ) { _datagram_adapter.write( x ); } );
+    _datagram_adapter.tick( elapsed.count() );
+  }
+}
 
-  return std::chrono::steady_clock::now().time_since_epoch().count() / 1000000;
+template<TCPDatagramAdapter AdaptT>
+void TCPMinnowSocket<AdaptT>::_set_tcp_timer()
+{
+  std::optional<EventLoop::Clock::duration> delay;
+  if ( _tcp.value().active() ) {
+    if ( const auto deadline_ms = _tcp.value().ms_until_deadline() ) {
+      delay = _last_tick + std::chrono::milliseconds( deadline_ms.value() ) - EventLoop::Clock::now();
+    }
+  }
+  _eventloop.set_timer( _tcp_timer.value(), delay );
 }
 
 //! \param[in] condition is a function returning true if loop should continue
 template<TCPDatagramAdapter AdaptT>
 void TCPMinnowSocket<AdaptT>::_tcp_loop( const std::function<bool()>& condition )
 {
-  auto base_time = timestamp_ms();
   while ( condition() ) {
-    auto ret = _eventloop.wait_next_event( TCP_TICK_MS );
-    if ( ret == EventLoop::Result::Exit or _abort ) {
-      break;
-    }
-
     if ( not _tcp.has_value() ) {
       throw std::runtime_error( "_tcp_loop entered before TCPPeer initialized" );
     }
 
-    if ( _tcp.value().active() ) {
-      const auto next_time = timestamp_ms();
-      _tcp.value().tick( next_time - base_time, [&]( auto x ) { _datagram_adapter.write( x ); } );
-      _datagram_adapter.tick( next_time - base_time );
-      base_time = next_time;
+    // Sleep until an event, or until the TCPPeer next has something to do (with nothing to do, indefinitely)
+    _set_tcp_timer();
+    auto ret = _eventloop.wait_next_event( -1 );
+    if ( ret == EventLoop::Result::Exit or _abort ) {
+      break;
     }
   }
 }
@@ -59,12 +70,14 @@ TCPMinnowSocket<AdaptT>::TCPMinnowSocket( std::pair<FileDescriptor, FileDescript
 {
   _thread_data.set_blocking( false );
   set_blocking( false );
+  _datagram_adapter.fd().set_blocking( false ); // so the event loop can drain it
 }
 
 template<TCPDatagramAdapter AdaptT>
 void TCPMinnowSocket<AdaptT>::_initialize_TCP( const TCPConfig& config )
 {
   _tcp.emplace( config );
+  _last_tick = EventLoop::Clock::now();
 
   // Set up the event loop
 
@@ -79,36 +92,80 @@ void TCPMinnowSocket<AdaptT>::_initialize_TCP( const TCPConfig& config )
   // 3) Incoming bytes reassembled by the Reassembler
   //    (needs to be read from the inbound_stream and written
   //    to the local stream socket back to the application)
+  //
+  // With use_shared_streams(), rules 2 and 3 use the shared SPSCByteStreams instead of the local stream socket.
 
-  // rule 1: read from filtered packet stream and dump into TCPConnection
+  // Each rule brings the TCPPeer's clock up to date first. Between events, a timer goes off when the TCPPeer
+  // next has something to do, e.g. a retransmission or a delayed ACK. An idle TCPPeer costs nothing.
+  _tcp_timer.emplace( _eventloop.add_timer( _eventloop.add_category( "TCPPeer timer" ), std::nullopt, [&] {
+    _tick();
+  } ) );
+
+  // The owner can wake the TCPPeer thread whenever it needs to
   _eventloop.add_rule(
-    "receive TCP segment from the network",
-    _datagram_adapter.fd(),
+    "wake TCPPeer thread",
+    _wakeup_event,
     Direction::In,
     [&] {
-      if ( auto seg = _datagram_adapter.read() ) {
-        _tcp->receive( std::move( seg.value() ), [&]( auto x ) { _datagram_adapter.write( x ); } );
+      std::string counter( sizeof( uint64_t ), '\0' );
+      _wakeup_event.read( counter );
+    },
+    [&] { return _tcp->active(); } );
+
+  // rule 1: read from filtered packet stream and dump into TCPConnection
+  const auto datagram_rule = _eventloop.add_read_rule(
+    _eventloop.add_category( "receive TCP segment from the network" ),
+    _datagram_adapter.fd(),
+    [&]( std::span<const std::string_view> datagrams ) {
+      _tick();
+      _received.clear();
+      for ( const auto datagram : datagrams ) {
+        if ( auto seg = _datagram_adapter.read( datagram ) ) {
+          _received.push_back( std::move( seg.value() ) );
+        }
       }
+      _tcp->receive( _received, [&]( auto x ) { _datagram_adapter.write( x ); } );
 
       // debugging output:
-      if ( _thread_data.eof() and _tcp.value().sender().sequence_numbers_in_flight() == 0 and not _fully_acked ) {
+      if ( _outbound_shutdown and _tcp.value().sender().sequence_numbers_in_flight() == 0 and not _fully_acked ) {
         std::cerr << "DEBUG: minnow outbound stream to " << _datagram_adapter.config().destination.to_string()
                   << " has been fully acknowledged.\n";
         _fully_acked = true;
       }
     },
-    [&] { return _tcp->active(); } );
+    [&] { return _tcp->active(); },
+    [&] {
+      // the datagram fd failed (or a write to it did): the connection can't go on
+      if ( _tcp->active() ) {
+        _abort.store( true );
+      }
+    } );
+
+  // Datagrams go out through the event loop, which (with io_uring) submits them together when it next waits. A
+  // failed write cancels rule 1, as an error on the fd would.
+  _datagram_adapter.set_output( [&, datagram_rule]( std::vector<std::string>&& datagram ) {
+    _eventloop.write( _datagram_adapter.fd(), std::move( datagram ), datagram_rule );
+  } );
+
+  if ( _shared_outbound.has_value() ) {
+    _add_shared_stream_rules();
+  } else {
+    _add_socket_pair_rules();
+  }
+}
 
+template<TCPDatagramAdapter AdaptT>
+void TCPMinnowSocket<AdaptT>::_add_socket_pair_rules()
+{
   // rule 2: read from pipe into outbound buffer
   _eventloop.add_rule(
     "push bytes to TCPPeer",
     _thread_data,
     Direction::In,
     [&] {
-      std::string data;
-      data.resize( _tcp->outbound_writer().available_capacity() );
-      _thread_data.read( data );
-      _tcp->outbound_writer().push( move( data ) );
+      _tick();
+      Writer& outbound = _tcp->outbound_writer();
+      outbound.commit( _thread_data.read( outbound.reserve() ) );
 
       if ( _thread_data.eof() ) {
         _tcp->outbound_writer().close();
@@ -147,9 +204,9 @@ void TCPMinnowSocket<AdaptT>::_initialize_TCP( const TCPConfig& config )
       // the pipe, handling the possibility of a partial
       // write (i.e., only pop what was actually written).
       if ( inbound.bytes_buffered() ) {
-        const std::string_view buffer = inbound.peek();
-        const auto bytes_written = _thread_data.write( buffer );
+        const auto bytes_written = _thread_data.write( inbound.peek_all() );
         inbound.pop( bytes_written );
+        _tcp->update_window( [&]( auto x ) { _datagram_adapter.write( x ); } );
       }
 
       if ( inbound.is_finished() or inbound.has_error() ) {
@@ -173,6 +230,100 @@ void TCPMinnowSocket<AdaptT>::_initialize_TCP( const TCPConfig& config )
     } );
 }
 
+template<TCPDatagramAdapter AdaptT>
+void TCPMinnowSocket<AdaptT>::_add_shared_stream_rules()
+{
+  // rule 2: read from shared outbound stream into outbound buffer
+  _eventloop.add_rule(
+    "push bytes to TCPPeer",
+    outbound().reader().event_fd(),
+    Direction::In,
+    [&] {
+      _tick();
+      SPSCReader& shared = outbound().reader();
+      Writer& outbound_writer = _tcp->outbound_writer();
+      shared.clear_event();
+
+      uint64_t moved = 0;
+      for ( const auto region : outbound_writer.reserve( shared.bytes_buffered() ) ) {
+        uint64_t filled = 0;
+        for ( const auto view : shared.peek_all( region.size() ) ) {
+          filled += view.copy( region.data() + filled, view.size() );
+        }
+        shared.pop( filled );
+        moved += filled;
+      }
+      outbound_writer.commit( moved );
+
+      if ( shared.bytes_buffered() ) {
+        shared.notify_self(); // more to move once the outbound buffer has room
+      }
+
+      if ( shared.is_finished() or shared.has_error() ) {
+        if ( shared.has_error() ) {
+          std::cerr << "DEBUG: minnow outbound stream had error.\n";
+          outbound_writer.set_error();
+        }
+        outbound_writer.close();
+        _outbound_shutdown = true;
+      }
+
+      _tcp->push( [&]( auto x ) { _datagram_adapter.write( x ); } );
+    },
+    [&] {
+      return ( _tcp->active() ) and ( not _outbound_shutdown )
+             and ( _tcp->outbound_writer().available_capacity() > 0 );
+    } );
+
+  // rule 3: read from inbound buffer into shared inbound stream
+  _eventloop.add_rule(
+    "read bytes from inbound stream",
+    inbound().writer().event_fd(),
+    Direction::In,
+    [&] {
+      Reader& inbound_reader = _tcp->inbound_reader();
+      SPSCWriter& shared = inbound().writer();
+      shared.clear_event();
+
+      for ( const auto view : inbound_reader.peek_all( shared.available_capacity() ) ) {
+        inbound_reader.pop( shared.push( view ) );
+      }
+      _tcp->update_window( [&]( auto x ) { _datagram_adapter.write( x ); } );
+
+      if ( shared.available_capacity() ) {
+        shared.notify_self(); // room for more as soon as the Reassembler produces it
+      }
+
+      if ( inbound_reader.is_finished() or inbound_reader.has_error() ) {
+        if ( inbound_reader.has_error() ) {
+          shared.set_error();
+        }
+        shared.close();
+        _inbound_shutdown = true;
+
+        // debugging output:
+        std::cerr << "DEBUG: minnow inbound stream from " << _datagram_adapter.config().destination.to_string()
+                  << " finished " << ( inbound_reader.has_error() ? "uncleanly.\n" : "cleanly.\n" );
+      }
+    },
+    [&] {
+      return _tcp->inbound_reader().bytes_buffered()
+             or ( ( _tcp->inbound_reader().is_finished() or _tcp->inbound_reader().has_error() )
+                  and not _inbound_shutdown );
+    } );
+}
+
+template<TCPDatagramAdapter AdaptT>
+void TCPMinnowSocket<AdaptT>::use_shared_streams( uint64_t capacity )
+{
+  if ( _tcp ) {
+    throw std::runtime_error( "use_shared_streams() after TCPConnection already initialized" );
+  }
+
+  _shared_inbound.emplace( capacity );
+  _shared_outbound.emplace( capacity );
+}
+
 //! \brief Call [socketpair](\ref man2::socketpair) and return connected Unix-domain sockets of specified type
 //! \param[in] type is the type of AF_UNIX sockets to create (e.g., SOCK_SEQPACKET)
 //! \returns a std::pair of connected sockets
@@ -199,6 +350,9 @@ TCPMinnowSocket<AdaptT>::~TCPMinnowSocket()
       std::cerr << "Warning: unclean shutdown of TCPMinnowSocket\n";
       // force the other side to exit
       _abort.store( true );
+      const uint64_t one = 1;
+      _wakeup_event.write(
+        std::string_view { reinterpret_cast<const char*>( &one ), sizeof( one ) } ); // NOLINT(*-reinterpret-cast)
       _tcp_thread.join();
     }
   } catch ( const std::exception& e ) {
@@ -210,6 +364,9 @@ template<TCPDatagramAdapter AdaptT>
 void TCPMinnowSocket<AdaptT>::wait_until_closed()
 {
   shutdown( SHUT_RDWR );
+  if ( _shared_outbound.has_value() and not outbound().is_closed() ) {
+    outbound().close();
+  }
   if ( _tcp_thread.joinable() ) {
     std::cerr << "DEBUG: minnow waiting for clean shutdown... ";
     _tcp_thread.join();
@@ -282,6 +439,7 @@ void TCPMinnowSocket<AdaptT>::_tcp_main()
     }
     _tcp_loop( [] { return true; } );
     shutdown( SHUT_RDWR );
+    _finish_shared_streams();
     if ( not _tcp.value().active() ) {
       std::cerr << "DEBUG: minnow TCP connection finished "
                 << ( _tcp->inbound_reader().has_error() ? "uncleanly.\n" : "cleanly.\n" );
@@ -289,6 +447,23 @@ void TCPMinnowSocket<AdaptT>::_tcp_main()
     _tcp.reset();
   } catch ( const std::exception& e ) {
     std::cerr << "Exception in TCPConnection runner thread: " << e.what() << "\n";
+    _finish_shared_streams();
     throw e;
   }
 }
+
+template<TCPDatagramAdapter AdaptT>
+void TCPMinnowSocket<AdaptT>::_finish_shared_streams()
+{
+  if ( not _shared_outbound.has_value() ) {
+    return;
+  }
+
+  // Nothing will take the rest of the outbound bytes, so an owner waiting for room must not wait forever
+  if ( not _shared_outbound->reader().is_finished() ) {
+    _shared_outbound->set_error();
+  }
+  if ( not _shared_inbound->writer().is_closed() ) {
+    _shared_inbound->writer().close();
+  }
+}
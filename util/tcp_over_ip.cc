@@ -23,27 +23,34 @@ using namespace std;
 //! `_listen` flag and records the source and destination addresses and port numbers
 //! from the TCP header; it uses this information to filter future reads.
 //! \returns a std::optional<TCPSegment> that is empty if the segment was invalid or unrelated
-optional<TCPMessage> TCPOverIPv4Adapter::unwrap_tcp_in_ip( const InternetDatagram& ip_dgram )
+optional<TCPMessage> TCPOverIPv4Adapter::unwrap_tcp_in_ip( InternetDatagram ip_dgram )
+{
+  Parser payload { move( ip_dgram.payload ) };
+  return unwrap_tcp_in_ip( ip_dgram.header, payload );
+}
+
+optional<TCPMessage> TCPOverIPv4Adapter::unwrap_tcp_in_ip( const IPv4Header& header, Parser& payload )
 {
   // is the IPv4 datagram for us?
   // Note: it's valid to bind to address "0" (INADDR_ANY) and reply from actual address contacted
-  if ( not listening() and ( ip_dgram.header.dst != config().source.ipv4_numeric() ) ) {
+  if ( not listening() and ( header.dst != config().source.ipv4_numeric() ) ) {
     return {};
   }
 
   // is the IPv4 datagram from our peer?
-  if ( not listening() and ( ip_dgram.header.src != config().destination.ipv4_numeric() ) ) {
+  if ( not listening() and ( header.src != config().destination.ipv4_numeric() ) ) {
     return {};
   }
 
   // does the IPv4 datagram claim that its payload is a TCP segment?
-  if ( ip_dgram.header.proto != IPv4Header::PROTO_TCP ) {
+  if ( header.proto != IPv4Header::PROTO_TCP ) {
     return {};
   }
 
-  // is the payload a valid TCP segment?
-  TCPSegment tcp_seg;
-  if ( not parse( tcp_seg, ip_dgram.payload, ip_dgram.header.pseudo_checksum() ) ) {
+  // is the payload a valid TCP segment? (the TCP payload is a slice of the datagram's buffers, not a copy)
+  TCPSegment tcp_seg { .window_shift = peer_window_shift() };
+  tcp_seg.parse( payload, header.pseudo_checksum() );
+  if ( payload.has_error() ) {
     return {};
   }
 
@@ -55,9 +62,9 @@ optional<TCPMessage> TCPOverIPv4Adapter::unwrap_tcp_in_ip( const InternetDatagra
   // should we target this source addr/port (and use its destination addr as our source) in reply?
   if ( listening() ) {
     if ( tcp_seg.message.sender.SYN and not tcp_seg.message.sender.RST ) {
-      config_mutable().source = Address { inet_ntoa( { htobe32( ip_dgram.header.dst ) } ), config().source.port() };
+      config_mutable().source = Address { inet_ntoa( { htobe32( header.dst ) } ), config().source.port() };
       config_mutable().destination
-        = Address { inet_ntoa( { htobe32( ip_dgram.header.src ) } ), tcp_seg.udinfo.src_port };
+        = Address { inet_ntoa( { htobe32( header.src ) } ), tcp_seg.udinfo.src_port };
       set_listening( false );
     } else {
       return {};
@@ -69,6 +76,11 @@ optional<TCPMessage> TCPOverIPv4Adapter::unwrap_tcp_in_ip( const InternetDatagra
     return {};
   }
 
+  if ( tcp_seg.message.sender.SYN and not peer_syn_received_ ) {
+    peer_syn_received_ = true;
+    peer_window_scale_ = tcp_seg.message.sender.window_scale;
+  }
+
   return tcp_seg.message;
 }
 
@@ -77,6 +89,16 @@ optional<TCPMessage> TCPOverIPv4Adapter::unwrap_tcp_in_ip( const InternetDatagra
 InternetDatagram TCPOverIPv4Adapter::wrap_tcp_in_ip( const TCPMessage& msg )
 {
   TCPSegment seg { .message = msg };
+
+  // negotiate window scaling: a SYN may only offer it if the peer's SYN (if any yet) did too
+  if ( seg.message.sender.SYN ) {
+    if ( peer_syn_received_ and not peer_window_scale_.has_value() ) {
+      seg.message.sender.window_scale.reset();
+    }
+    local_window_scale_ = seg.message.sender.window_scale;
+  }
+  seg.window_shift = local_window_shift();
+
   // set the port numbers in the TCP segment
   seg.udinfo.src_port = config().source.port();
   seg.udinfo.dst_port = config().destination.port();
@@ -85,7 +107,7 @@ InternetDatagram TCPOverIPv4Adapter::wrap_tcp_in_ip( const TCPMessage& msg )
   InternetDatagram ip_dgram;
   ip_dgram.header.src = config().source.ipv4_numeric();
   ip_dgram.header.dst = config().destination.ipv4_numeric();
-  ip_dgram.header.len = ip_dgram.header.hlen * 4 + 20 /* tcp header len */ + seg.message.sender.payload.size();
+  ip_dgram.header.len = ip_dgram.header.hlen * 4 + seg.header_length() + seg.message.sender.payload.size();
 
   // set payload, calculating TCP checksum using information from IP header
   seg.compute_checksum( ip_dgram.header.pseudo_checksum() );
@@ -4,13 +4,26 @@
 #include "ipv4_datagram.hh"
 #include "tcp_segment.hh"
 
+#include <cstdint>
 #include <optional>
 
 //! \brief A converter from TCP segments to serialized IPv4 datagrams
 class TCPOverIPv4Adapter : public FdAdapterBase
 {
 public:
-  std::optional<TCPMessage> unwrap_tcp_in_ip( const InternetDatagram& ip_dgram );
+  std::optional<TCPMessage> unwrap_tcp_in_ip( InternetDatagram ip_dgram );
+
+  //! As above, with the datagram's header parsed already, and `payload` holding the rest of it
+  std::optional<TCPMessage> unwrap_tcp_in_ip( const IPv4Header& header, Parser& payload );
 
   InternetDatagram wrap_tcp_in_ip( const TCPMessage& msg );
+
+private:
+  // Window scaling (RFC 7323) takes effect once both SYNs have carried the option
+  std::optional<uint8_t> local_window_scale_ {}; // offered by our SYN
+  std::optional<uint8_t> peer_window_scale_ {};  // offered by the peer's SYN
+  bool peer_syn_received_ {};
+
+  uint8_t local_window_shift() const { return peer_window_scale_ ? local_window_scale_.value_or( 0 ) : 0; }
+  uint8_t peer_window_shift() const { return local_window_scale_ ? peer_window_scale_.value_or( 0 ) : 0; }
 };
@@ -7,8 +7,11 @@
 #include "tcp_sender.hh"
 #include "tcp_sender_message.hh"
 
+#include <algorithm>
 #include <functional>
 #include <optional>
+#include <span>
+#include <vector>
 
 class TCPPeer
 {
@@ -18,7 +21,12 @@ class TCPPeer
   }
 
 public:
-  explicit TCPPeer( const TCPConfig& cfg ) : cfg_( cfg ) {}
+  explicit TCPPeer( const TCPConfig& cfg ) : cfg_( cfg )
+  {
+    if ( cfg_.recv_autotune ) {
+      recv_tuner_.emplace( initial_recv_capacity(), cfg_.recv_capacity, cfg_.recv_idle_ms );
+    }
+  }
 
   Writer& outbound_writer() { return sender_.writer(); }
   Reader& inbound_reader() { return receiver_.reader(); }
@@ -32,6 +40,41 @@ public:
   {
     cumulative_time_ += t;
     sender_.tick( t, make_send( transmit ) );
+    if ( recv_tuner_.has_value() ) {
+      recv_tuner_->update( receiver_, cumulative_time_, false, advertised_edge_ );
+    }
+
+    // Send a delayed ACK once it has waited long enough (unless the sender just carried it)
+    if ( ack_deadline_.has_value() and cumulative_time_ >= ack_deadline_.value() ) {
+      send( sender_.make_empty_message(), transmit );
+    }
+  }
+
+  /* How long until tick() next has something to do (a retransmission, a paced or held-back segment, a delayed ACK,
+     or the end of lingering), if it has anything */
+  std::optional<uint64_t> ms_until_deadline() const
+  {
+    std::optional<uint64_t> next = sender_.ms_until_deadline();
+    const auto until = [&]( uint64_t deadline ) {
+      const uint64_t delay = deadline - std::min( cumulative_time_, deadline );
+      next = std::min( next.value_or( delay ), delay );
+    };
+    if ( ack_deadline_.has_value() ) {
+      until( ack_deadline_.value() );
+    }
+    const bool streams_finished = receiver_.writer().is_closed() and sender_.reader().is_finished()
+                                  and sender_.sequence_numbers_in_flight() == 0;
+    if ( linger_after_streams_finish_ and streams_finished ) {
+      until( time_of_last_receipt_ + 10UL * cfg_.rt_timeout );
+    }
+    return next;
+  }
+
+  void cork() { sender_.set_corked( true ); }
+  void uncork( const TransmitFunction& transmit )
+  {
+    sender_.set_corked( false );
+    push( transmit );
   }
   bool has_ackno() const { return receiver_.send().ackno.has_value(); }
 
@@ -52,51 +95,208 @@ public:
     if ( not active() ) {
       return;
     }
+    absorb( std::move( msg ) );
+    reply( transmit );
+  }
+
+  /* Receive messages that arrived together (e.g. on one wakeup). The sender pushes once, with whatever all their
+     ACKs allow, and data that arrived in order is ACKed once, after them all (as with GRO); a message that needs
+     an answer at once (out of order, a SYN or FIN, or a keep-alive) still gets it as it arrives. A run of
+     in-order data goes to the receiver as one batch. */
+  void receive( std::span<TCPMessage> msgs, const TransmitFunction& transmit )
+  {
+    bool absorbed = false;
+    for ( auto& msg : msgs ) {
+      if ( not active() ) {
+        break;
+      }
+      absorbed = true;
+      if ( joins_batch( msg.sender ) ) {
+        absorb_into_batch( std::move( msg ) );
+        continue;
+      }
+      deliver_batch();
+      if ( absorb( std::move( msg ) ) ) {
+        reply( transmit );
+      }
+    }
+    deliver_batch();
+    if ( absorbed ) {
+      reply( transmit );
+    }
+  }
+
+  /* After the application reads from the inbound stream: if the peer has little of the last window left, and the
+     window has now opened to at least twice that (and by an MSS, or half the buffer), tell the peer at once, rather
+     than leave its sender to probe (RFC 1122 4.2.3.3) */
+  void update_window( const TransmitFunction& transmit )
+  {
+    if ( not active() or not has_ackno() or receiver_.writer().is_closed() ) {
+      return;
+    }
+    const uint64_t pushed = receiver_.writer().bytes_pushed();
+    const uint64_t left = advertised_edge_ - std::min( pushed, advertised_edge_ );
+    const uint64_t window = receiver_.send().window_size;
+    if ( window >= 2 * left and window - left >= std::min<uint64_t>( cfg_.mss, receiver_.capacity() / 2 ) ) {
+      send( sender_.make_empty_message(), transmit );
+    }
+  }
+
+  // Testing interface
+  const TCPReceiver& receiver() const { return receiver_; }
+  const TCPSender& sender() const { return sender_; }
+
+private:
+  /* Take in a message, without sending anything yet. Returns whether it needs an answer at once. */
+  bool absorb( TCPMessage msg )
+  {
+    const bool in_order
+      = receiver_.send().ackno == msg.sender.seqno and receiver_.reassembler().bytes_pending() == 0;
+    const bool urgent = note_arrival( msg.sender, in_order );
+
+    // Segments to the peer must not exceed the MSS its SYN advertised.
+    if ( msg.sender.SYN and msg.sender.mss.has_value() ) {
+      sender_.limit_mss( msg.sender.mss.value() );
+    }
+
+    // Give incoming TCPSenderMessage to receiver (and let the buffer grow, before the ACK offers the window).
+    const bool occupies_sequence_space = msg.sender.sequence_length() > 0;
+    receiver_.receive( std::move( msg.sender ) );
+    if ( recv_tuner_.has_value() ) {
+      recv_tuner_->update( receiver_, cumulative_time_, occupies_sequence_space, advertised_edge_ );
+    }
+
+    // Give incoming TCPReceiverMessage to sender.
+    sender_.receive( msg.receiver );
+    return urgent;
+  }
+
+  /* Can this message wait in the batch? Only plain data (or a bare ACK) can: in order after the data already
+     waiting, and within the room the receiver had when the batch began. */
+  bool joins_batch( const TCPSenderMessage& msg ) const
+  {
+    if ( msg.SYN or msg.FIN or msg.RST ) {
+      return false;
+    }
+    if ( batch_.empty() ) {
+      return receiver_.send().ackno == msg.seqno and receiver_.reassembler().bytes_pending() == 0
+             and msg.payload.size() <= receiver_.writer().available_capacity();
+    }
+    return msg.seqno == batch_next_seqno_ and msg.payload.size() <= batch_room_;
+  }
+
+  /* Take in a message that joins_batch(): its receiver part now, its sender part with the rest of the batch. */
+  void absorb_into_batch( TCPMessage msg )
+  {
+    if ( batch_.empty() ) {
+      batch_room_ = receiver_.writer().available_capacity();
+    }
+    note_arrival( msg.sender, true );
+    batch_next_seqno_ = msg.sender.seqno + msg.sender.sequence_length();
+    batch_room_ -= msg.sender.payload.size();
+    batch_.push_back( std::move( msg.sender ) );
+    sender_.receive( msg.receiver );
+  }
+
+  /* Give the batch of in-order data to the receiver, all at once. */
+  void deliver_batch()
+  {
+    if ( batch_.empty() ) {
+      return;
+    }
+    const bool data_arrived
+      = std::ranges::any_of( batch_, []( const TCPSenderMessage& msg ) { return msg.sequence_length() > 0; } );
+    receiver_.receive_batch( batch_ );
+    batch_.clear();
+    if ( recv_tuner_.has_value() ) {
+      recv_tuner_->update( receiver_, cumulative_time_, data_arrived, advertised_edge_ );
+    }
+  }
 
+  /* Account for a message arriving (before the receiver sees it): whether and when to ACK, and whether to linger.
+     Returns whether it needs an answer at once. */
+  bool note_arrival( const TCPSenderMessage& msg, bool in_order )
+  {
     // Record time in case this peer has to linger after streams finish.
     time_of_last_receipt_ = cumulative_time_;
 
-    // If SenderMessage occupies a sequence number, make sure to reply.
-    need_send_ |= ( msg.sender.sequence_length() > 0 );
+    // If SenderMessage occupies a sequence number, make sure to reply. With delayed ACKs, only segments that
+    // arrive in order can wait; anything out of order (or filling a hole), and a SYN or FIN, is ACKed at once.
+    // So are the segments just after those, while the peer's sender is likely to have a small window.
+    const bool occupies_sequence_space = msg.sequence_length() > 0;
+    if ( occupies_sequence_space and ( msg.SYN or not in_order ) ) {
+      quick_acks_ = QUICK_ACK_SEGMENTS;
+    }
+    bool delay_ack = cfg_.delayed_ack and in_order and not msg.SYN and not msg.FIN;
+    if ( delay_ack and occupies_sequence_space and quick_acks_ > 0 ) {
+      quick_acks_--;
+      delay_ack = false;
+    }
+    need_send_ |= occupies_sequence_space and not delay_ack;
 
     // If SenderMessage is a "keep-alive" (with intentionally invalid seqno), make sure to reply.
     // (N.B. orthodox TCP rules require a reply on any unacceptable segment.)
     const auto our_ackno = receiver_.send().ackno;
-    need_send_ |= ( our_ackno.has_value() and msg.sender.seqno + 1 == our_ackno.value() );
+    const bool keep_alive = our_ackno.has_value() and msg.seqno + 1 == our_ackno.value();
+    need_send_ |= keep_alive;
 
     // Did the inbound stream finish before the outbound stream? If so, no need to linger after streams finish.
     if ( receiver_.writer().is_closed() and not sender_.reader().is_finished() ) {
       linger_after_streams_finish_ = false;
     }
 
-    // Give incoming TCPSenderMessage to receiver.
-    receiver_.receive( std::move( msg.sender ) );
+    // A delayed ACK waits for a second segment, or for the timer (RFC 5681 4.2)
+    if ( occupies_sequence_space and delay_ack ) {
+      need_send_ |= ++unacked_segments_ >= 2;
+      if ( not ack_deadline_.has_value() ) {
+        ack_deadline_ = cumulative_time_ + cfg_.ack_delay_ms;
+      }
+    }
 
-    // Give incoming TCPReceiverMessage to sender.
-    sender_.receive( msg.receiver );
+    return keep_alive or ( occupies_sequence_space and ( msg.SYN or msg.FIN or not in_order ) );
+  }
 
-    // Send reply if needed.
+  /* Send whatever the sender now allows (including fast retransmits), and a reply if needed. */
+  void reply( const TransmitFunction& transmit )
+  {
+    sender_.push( make_send( transmit ) );
     if ( need_send_ ) {
       send( sender_.make_empty_message(), transmit );
     }
   }
 
-  // Testing interface
-  const TCPReceiver& receiver() const { return receiver_; }
-  const TCPSender& sender() const { return sender_; }
-
-private:
   TCPConfig cfg_;
-  TCPSender sender_ { ByteStream { cfg_.send_capacity }, cfg_.isn, cfg_.rt_timeout };
-  TCPReceiver receiver_ { Reassembler { ByteStream { cfg_.recv_capacity } } };
+  TCPSender sender_ { ByteStream { cfg_.send_capacity, cfg_.stream_storage }, cfg_ };
+  TCPReceiver receiver_ {
+    Reassembler { ByteStream { initial_recv_capacity(), cfg_.stream_storage }, cfg_.reassembler_engine },
+    cfg_.window_scale };
+  std::optional<ReceiveBufferTuner> recv_tuner_ {};
+
+  std::vector<TCPSenderMessage> batch_ {}; // in-order data that arrived together, not yet given to the receiver
+  Wrap32 batch_next_seqno_ { 0 };          // the seqno just after the batch
+  uint64_t batch_room_ {};                 // how much more data the batch can take
+
+  // With autotuning, the receive buffer starts small, and grows toward cfg_.recv_capacity
+  size_t initial_recv_capacity() const
+  {
+    return cfg_.recv_autotune ? std::min( cfg_.recv_initial_capacity, cfg_.recv_capacity ) : cfg_.recv_capacity;
+  }
 
   bool need_send_ {};
+  static constexpr uint64_t QUICK_ACK_SEGMENTS = 16; // ACKed at once after the SYN, or a segment out of order
+  uint64_t quick_acks_ {};                           // how many more segments to ACK at once
+  uint64_t unacked_segments_ {};                     // in-order segments received since the last ACK was sent
+  std::optional<uint64_t> ack_deadline_ {}; // when a delayed ACK must be sent
+  uint64_t advertised_edge_ {};             // the stream index just past the window last offered to the peer
 
   void send( const TCPSenderMessage& sender_message, const TransmitFunction& transmit )
   {
     TCPMessage msg { sender_message, receiver_.send() };
+    advertised_edge_ = receiver_.writer().bytes_pushed() + msg.receiver.window_size;
     transmit( std::move( msg ) );
     need_send_ = false;
+    unacked_segments_ = 0;
+    ack_deadline_.reset();
   }
 
   bool linger_after_streams_finish_ { true }; // one peer may need to linger to make sure all closure conditions met
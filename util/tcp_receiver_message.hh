@@ -2,26 +2,43 @@
 
 #include "wrapping_integers.hh"
 
+#include <cstddef>
+#include <cstdint>
 #include <optional>
+#include <vector>
 
 /*
  * The TCPReceiverMessage structure contains the information sent from a TCP receiver to its sender.
  *
- * It contains three fields:
+ * It contains four fields:
  *
  * 1) The acknowledgment number (ackno): the *next* sequence number needed by the TCP Receiver.
  *    This is an optional field that is empty if the TCPReceiver hasn't yet received the Initial Sequence Number.
  *
  * 2) The window size. This is the number of sequence numbers that the TCP receiver is interested
  *    to receive, starting from the ackno if present. The maximum value is 65,535 (UINT16_MAX from
- *    the <cstdint> header).
+ *    the <cstdint> header), unless both sides negotiated window scaling (RFC 7323), which raises it
+ *    to 65,535 << the receiver's shift count (at most MAX_WINDOW_SCALE).
  *
  * 3) The RST (reset) flag. If set, the stream has suffered an error and the connection should be aborted.
+ *
+ * 4) Selective acknowledgment (SACK) blocks (RFC 2018), if the sender offered to accept them in its SYN.
+ *    Each block is a range of sequence numbers [left, right) beyond the ackno that the receiver already
+ *    holds. The block containing the most recently received segment comes first.
  */
 
 struct TCPReceiverMessage
 {
   std::optional<Wrap32> ackno {};
-  uint16_t window_size {};
+  uint32_t window_size {};
+  static constexpr uint8_t MAX_WINDOW_SCALE = 14; // RFC 7323: windows of up to about 1 GiB
   bool RST {};
+
+  struct SACKBlock
+  {
+    Wrap32 left { 0 };  // first sequence number held
+    Wrap32 right { 0 }; // one past the last sequence number held
+  };
+  static constexpr size_t MAX_SACK_BLOCKS = 4; // as many as fit in the 40 bytes of TCP options
+  std::vector<SACKBlock> sack_blocks {};
 };
@@ -2,9 +2,20 @@
 #include "checksum.hh"
 #include "wrapping_integers.hh"
 
+#include <algorithm>
 #include <cstddef>
 
 static constexpr uint32_t TCPHeaderMinLen = 5; // 32-bit words
+static constexpr size_t TCPOptionsMaxLen = 40;   // bytes: the most a 4-bit data offset leaves room for
+
+// TCP option kinds
+static constexpr uint8_t TCPOptionEnd = 0;           // end of option list
+static constexpr uint8_t TCPOptionNOP = 1;           // no-operation (padding)
+static constexpr uint8_t TCPOptionMSS = 2;           // RFC 9293, on SYN only
+static constexpr uint8_t TCPOptionWindowScale = 3;   // RFC 7323, on SYN only
+static constexpr uint8_t TCPOptionSACKPermitted = 4; // RFC 2018, on SYN only
+static constexpr uint8_t TCPOptionSACK = 5;          // RFC 2018
+static constexpr uint8_t SACKBlockLen = 8;           // two 32-bit sequence numbers
 
 using namespace std;
 
@@ -43,19 +54,101 @@ void TCPSegment::parse( Parser& parser, uint32_t datagram_layer_pseudo_checksum
   message.sender.SYN = octet & 0b0000'0010;
   message.sender.FIN = octet & 0b0000'0001;
 
-  parser.integer( message.receiver.window_size );
+  parser.integer( raw16 );
+  message.receiver.window_size = message.sender.SYN ? raw16 : uint32_t { raw16 } << window_shift;
   parser.integer( udinfo.cksum );
   parser.integer( raw16 ); // urgent pointer
 
-  // skip any options or anything extra in the header
   if ( data_offset < TCPHeaderMinLen ) {
     parser.set_error();
+    return;
   }
-  parser.remove_prefix( data_offset * 4 - TCPHeaderMinLen * 4 );
+  parse_options( parser, data_offset * 4 - TCPHeaderMinLen * 4 );
 
   parser.all_remaining( message.sender.payload );
 }
 
+void TCPSegment::parse_options( Parser& parser, size_t options_len )
+{
+  uint8_t kind {};
+  uint8_t len {};
+  uint8_t octet {};
+  uint16_t raw16 {};
+  uint32_t raw32 {};
+
+  while ( options_len > 0 and not parser.has_error() ) {
+    parser.integer( kind );
+    options_len--;
+    if ( kind == TCPOptionEnd ) {
+      parser.remove_prefix( options_len ); // the rest is padding
+      return;
+    }
+    if ( kind == TCPOptionNOP ) {
+      continue;
+    }
+
+    if ( options_len == 0 ) {
+      parser.set_error();
+      return;
+    }
+    parser.integer( len );
+    options_len--;
+    if ( len < 2 or len - 2U > options_len ) {
+      parser.set_error();
+      return;
+    }
+    const size_t value_len = len - 2U;
+    options_len -= value_len;
+
+    switch ( kind ) {
+      case TCPOptionMSS:
+        if ( value_len != 2 ) {
+          parser.set_error();
+          return;
+        }
+        parser.integer( raw16 );
+        message.sender.mss = raw16;
+        break;
+
+      case TCPOptionWindowScale:
+        if ( value_len != 1 ) {
+          parser.set_error();
+          return;
+        }
+        parser.integer( octet );
+        message.sender.window_scale = min( octet, TCPReceiverMessage::MAX_WINDOW_SCALE ); // RFC 7323 2.3
+        break;
+
+      case TCPOptionSACKPermitted:
+        if ( value_len != 0 ) {
+          parser.set_error();
+          return;
+        }
+        message.sender.SACK_permitted = true;
+        break;
+
+      case TCPOptionSACK:
+        if ( value_len % SACKBlockLen != 0 ) {
+          parser.set_error();
+          return;
+        }
+        for ( size_t i = 0; i < value_len / SACKBlockLen; i++ ) {
+          TCPReceiverMessage::SACKBlock block;
+          parser.integer( raw32 );
+          block.left = Wrap32 { raw32 };
+          parser.integer( raw32 );
+          block.right = Wrap32 { raw32 };
+          message.receiver.sack_blocks.push_back( block );
+        }
+        break;
+
+      default: // skip options we don't understand
+        parser.remove_prefix( value_len );
+        break;
+    }
+  }
+}
+
 class Wrap32Serializable : public Wrap32
 {
 public:
@@ -68,17 +161,90 @@ void TCPSegment::serialize( Serializer& serializer ) const
   serializer.integer( udinfo.dst_port );
   serializer.integer( Wrap32Serializable { message.sender.seqno }.raw_value() );
   serializer.integer( Wrap32Serializable { message.receiver.ackno.value_or( Wrap32 { 0 } ) }.raw_value() );
-  serializer.integer( uint8_t { TCPHeaderMinLen << 4 } ); // data offset
+  const auto data_offset = static_cast<uint8_t>( TCPHeaderMinLen + options_length() / 4 );
+  serializer.integer( static_cast<uint8_t>( data_offset << 4 ) );
   const bool reset = message.sender.RST or message.receiver.RST;
   const uint8_t flags = ( message.receiver.ackno.has_value() ? 0b0001'0000U : 0 ) | ( reset ? 0b0000'0100U : 0 )
                         | ( message.sender.SYN ? 0b0000'0010U : 0 ) | ( message.sender.FIN ? 0b0000'0001U : 0 );
   serializer.integer( flags );
-  serializer.integer( message.receiver.window_size );
+  const uint32_t window
+    = message.sender.SYN ? message.receiver.window_size : message.receiver.window_size >> window_shift;
+  serializer.integer( static_cast<uint16_t>( min<uint32_t>( window, UINT16_MAX ) ) );
   serializer.integer( udinfo.cksum );
   serializer.integer( uint16_t { 0 } ); // urgent pointer
+  serialize_options( serializer );
   serializer.buffer( message.sender.payload );
 }
 
+size_t TCPSegment::header_length() const
+{
+  return TCPHeaderMinLen * 4 + options_length();
+}
+
+size_t TCPSegment::options_length() const
+{
+  const size_t count = sack_block_count();
+  return syn_options_length() + ( count ? 4 + SACKBlockLen * count : 0 );
+}
+
+size_t TCPSegment::syn_options_length() const
+{
+  size_t len = 0;
+  if ( message.sender.SYN and message.sender.mss.has_value() ) {
+    len += 4;
+  }
+  if ( message.sender.SYN and message.sender.window_scale.has_value() ) {
+    len += 4;
+  }
+  if ( message.sender.SYN and message.sender.SACK_permitted ) {
+    len += 4;
+  }
+  return len;
+}
+
+// The first SACK blocks, as many as fit in the option space the SYN's options leave (e.g. three after all of them)
+size_t TCPSegment::sack_block_count() const
+{
+  const size_t room = ( TCPOptionsMaxLen - syn_options_length() - 4 ) / SACKBlockLen;
+  return min( { message.receiver.sack_blocks.size(), TCPReceiverMessage::MAX_SACK_BLOCKS, room } );
+}
+
+// Each option is preceded by enough NOPs to keep the following ones 32-bit aligned
+void TCPSegment::serialize_options( Serializer& serializer ) const
+{
+  if ( message.sender.SYN and message.sender.mss.has_value() ) {
+    serializer.integer( TCPOptionMSS );
+    serializer.integer( uint8_t { 4 } );
+    serializer.integer( message.sender.mss.value() );
+  }
+
+  if ( message.sender.SYN and message.sender.window_scale.has_value() ) {
+    serializer.integer( TCPOptionNOP );
+    serializer.integer( TCPOptionWindowScale );
+    serializer.integer( uint8_t { 3 } );
+    serializer.integer( message.sender.window_scale.value() );
+  }
+
+  if ( message.sender.SYN and message.sender.SACK_permitted ) {
+    serializer.integer( TCPOptionNOP );
+    serializer.integer( TCPOptionNOP );
+    serializer.integer( TCPOptionSACKPermitted );
+    serializer.integer( uint8_t { 2 } );
+  }
+
+  if ( const size_t count = sack_block_count(); count > 0 ) {
+    serializer.integer( TCPOptionNOP );
+    serializer.integer( TCPOptionNOP );
+    serializer.integer( TCPOptionSACK );
+    serializer.integer( static_cast<uint8_t>( 2 + SACKBlockLen * count ) );
+    for ( size_t i = 0; i < count; i++ ) {
+      const auto& block = message.receiver.sack_blocks[i];
+      serializer.integer( Wrap32Serializable { block.left }.raw_value() );
+      serializer.integer( Wrap32Serializable { block.right }.raw_value() );
+    }
+  }
+}
+
 void TCPSegment::compute_checksum( uint32_t datagram_layer_pseudo_checksum )
 {
   udinfo.cksum = 0;
@@ -5,6 +5,8 @@
 #include "tcp_sender_message.hh"
 #include "udinfo.hh"
 
+#include <cstddef>
+
 struct TCPMessage
 {
   TCPSenderMessage sender {};
@@ -16,8 +18,22 @@ struct TCPSegment
   TCPMessage message {};
   UserDatagramInfo udinfo {};
 
+  // The shift count of the 16-bit window field (RFC 7323), once both SYNs have negotiated scaling.
+  // Set it before parse() or serialize(); it never applies to the window of a SYN.
+  uint8_t window_shift {};
+
   void parse( Parser& parser, uint32_t datagram_layer_pseudo_checksum );
   void serialize( Serializer& serializer ) const;
 
   void compute_checksum( uint32_t datagram_layer_pseudo_checksum );
+
+  // Length of the serialized header in bytes, including options
+  size_t header_length() const;
+
+private:
+  void parse_options( Parser& parser, size_t options_len );
+  size_t options_length() const;     // bytes of options serialize() will write (a multiple of 4)
+  size_t syn_options_length() const; // bytes of them that are the SYN's own options
+  size_t sack_block_count() const;   // how many SACK blocks serialize() will write
+  void serialize_options( Serializer& serializer ) const;
 };
@@ -1,13 +1,16 @@
 #pragma once
 
+#include "buffer.hh"
 #include "wrapping_integers.hh"
 
+#include <cstdint>
+#include <optional>
 #include <string>
 
 /*
  * The TCPSenderMessage structure contains the information sent from a TCP sender to its receiver.
  *
- * It contains five fields:
+ * It contains eight fields:
  *
  * 1) The sequence number (seqno) of the beginning of the segment. If the SYN flag is set, this is the
  *    sequence number of the SYN flag. Otherwise, it's the sequence number of the beginning of the payload.
@@ -15,11 +18,21 @@
  * 2) The SYN flag. If set, this segment is the beginning of the byte stream, and the seqno field
  *    contains the Initial Sequence Number (ISN) -- the zero point.
  *
- * 3) The payload: a substring (possibly empty) of the byte stream.
+ * 3) The payload: a substring (possibly empty) of the byte stream. Held as a refcounted Buffer so the
+ *    receiving side can trim and split it without copying.
  *
  * 4) The FIN flag. If set, the payload represents the ending of the byte stream.
  *
  * 5) The RST (reset) flag. If set, the stream has suffered an error and the connection should be aborted.
+ *
+ * 6) The SACK-permitted flag (only meaningful with SYN). If set, the sender can make use of selective
+ *    acknowledgments, so the peer's receiver may include SACK blocks in what it sends back.
+ *
+ * 7) The window-scale option (only meaningful with SYN). If present, this side can handle scaled windows,
+ *    and will scale the windows it advertises by this shift count -- if the peer's SYN offers scaling too.
+ *
+ * 8) The maximum segment size option (only meaningful with SYN). If present, the largest payload this side
+ *    is willing to receive in one segment.
  */
 
 struct TCPSenderMessage
@@ -27,11 +40,15 @@ struct TCPSenderMessage
   Wrap32 seqno { 0 };
 
   bool SYN {};
-  std::string payload {};
+  Buffer payload {};
   bool FIN {};
 
   bool RST {};
 
+  bool SACK_permitted {};
+  std::optional<uint8_t> window_scale {};
+  std::optional<uint16_t> mss {};
+
   // How many sequence numbers does this segment use?
   size_t sequence_length() const { return SYN + payload.size() + FIN; }
 };
@@ -0,0 +1,132 @@
+#include "timer_wheel.hh"
+
+#include <algorithm>
+#include <bit>
+
+using namespace std;
+
+void TimerWheel::add( const uint64_t id, const uint64_t expiry )
+{
+  remove( id );
+  auto& timer = timers_.emplace( id, Timer { expiry, 0, 0, {} } ).first->second;
+  place( id, timer );
+}
+
+bool TimerWheel::remove( const uint64_t id )
+{
+  const auto it = timers_.find( id );
+  if ( it == timers_.end() ) {
+    return false;
+  }
+  unplace( it->second );
+  timers_.erase( it );
+  return true;
+}
+
+// The lowest level whose slots reach the expiry: there, it is 1 to 63 slots ahead of the current one
+void TimerWheel::place( const uint64_t id, Timer& timer )
+{
+  if ( timer.expiry <= now_ ) {
+    timer.level = LEVELS;
+    timer.position = overdue_.insert( overdue_.end(), id );
+    return;
+  }
+
+  for ( unsigned level = 0; level < LEVELS; ++level ) {
+    const unsigned shift = level * LEVEL_BITS;
+    const uint64_t distance = ( timer.expiry >> shift ) - ( now_ >> shift );
+    if ( distance < SLOTS or level == LEVELS - 1 ) {
+      timer.level = level;
+      timer.slot = ( ( now_ >> shift ) + min<uint64_t>( distance, SLOTS - 1 ) ) % SLOTS;
+      auto& slot = slots_.at( level ).at( timer.slot );
+      timer.position = slot.insert( slot.end(), id );
+      occupied_.at( level ) |= uint64_t { 1 } << timer.slot;
+      return;
+    }
+  }
+}
+
+void TimerWheel::unplace( const Timer& timer )
+{
+  if ( timer.level == LEVELS ) {
+    overdue_.erase( timer.position );
+    return;
+  }
+
+  auto& slot = slots_.at( timer.level ).at( timer.slot );
+  slot.erase( timer.position );
+  if ( slot.empty() ) {
+    occupied_.at( timer.level ) &= ~( uint64_t { 1 } << timer.slot );
+  }
+}
+
+optional<uint64_t> TimerWheel::next_wakeup() const
+{
+  if ( timers_.empty() ) {
+    return nullopt;
+  }
+  if ( not overdue_.empty() ) {
+    return now_;
+  }
+
+  optional<uint64_t> next;
+  for ( unsigned level = 0; level < LEVELS; ++level ) {
+    if ( occupied_.at( level ) == 0 ) {
+      continue;
+    }
+    // the first occupied slot after the current one
+    const unsigned shift = level * LEVEL_BITS;
+    const auto current = static_cast<int>( ( now_ >> shift ) % SLOTS );
+    const uint64_t distance = countr_zero( rotr( occupied_.at( level ), current + 1 ) ) + 1;
+    const uint64_t start = ( ( now_ >> shift ) + distance ) << shift;
+    next = min( next.value_or( start ), start );
+  }
+  return next;
+}
+
+void TimerWheel::expire( Slot& slot, vector<uint64_t>& expired )
+{
+  for ( const auto id : slot ) {
+    expired.push_back( id );
+    timers_.erase( id );
+  }
+  slot.clear();
+}
+
+vector<uint64_t> TimerWheel::advance( const uint64_t now )
+{
+  vector<uint64_t> expired;
+  expire( overdue_, expired );
+
+  // Jump from one tick with work to the next: nothing happens on the ticks between
+  while ( now_ < now ) {
+    const auto wakeup = next_wakeup();
+    if ( not wakeup.has_value() or wakeup.value() > now ) {
+      now_ = now;
+      break;
+    }
+    now_ = wakeup.value();
+
+    // Cascade the slots that begin now, from the top down (as a timer may fall through several levels)
+    for ( unsigned level = LEVELS - 1; level > 0; --level ) {
+      const unsigned shift = level * LEVEL_BITS;
+      if ( now_ % ( uint64_t { 1 } << shift ) != 0 ) {
+        continue;
+      }
+      const auto index = static_cast<unsigned>( ( now_ >> shift ) % SLOTS );
+      Slot cascading;
+      cascading.splice( cascading.end(), slots_.at( level ).at( index ) );
+      occupied_.at( level ) &= ~( uint64_t { 1 } << index );
+      for ( const auto id : cascading ) {
+        place( id, timers_.at( id ) );
+      }
+    }
+
+    const auto index = static_cast<unsigned>( now_ % SLOTS );
+    expire( slots_.front().at( index ), expired );
+    occupied_.front() &= ~( uint64_t { 1 } << index );
+    expire( overdue_, expired ); // cascaded straight to their expiry
+  }
+
+  return expired;
+}
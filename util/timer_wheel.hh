@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+//! \brief A hierarchical timing wheel (after Varghese and Lauck), which keeps timers by their expiry, in ticks.
+//! \details Level 0 has a slot for each of the next 64 ticks, and each level above has slots 64 times as wide
+//! (so covers 64 times as far ahead). A timer sits in the lowest level whose slots can tell its expiry apart
+//! from the current tick, and moves down (cascades) once the clock reaches the start of its slot. Adding and
+//! removing a timer take constant time, and so does finding the next tick to advance to, with a bitmap of the
+//! occupied slots on each level. Timers beyond the top level wait in its last slot, and cascade again.
+class TimerWheel
+{
+public:
+  static constexpr unsigned LEVEL_BITS = 6;
+  static constexpr unsigned SLOTS = 1U << LEVEL_BITS; //!< Slots on each level (one bit each in a uint64_t).
+  static constexpr unsigned LEVELS = 4;
+
+  //! Start the clock at tick `now`.
+  explicit TimerWheel( uint64_t now = 0 ) : now_( now ) {}
+
+  //! Schedule timer `id` to expire at tick `expiry` (instead of whenever it was to expire, if it was).
+  //! A timer whose expiry has passed expires on the next call to advance().
+  void add( uint64_t id, uint64_t expiry );
+
+  //! Unschedule timer `id`, returning whether it was scheduled.
+  bool remove( uint64_t id );
+
+  bool contains( uint64_t id ) const { return timers_.contains( id ); }
+  size_t size() const { return timers_.size(); }
+  bool empty() const { return timers_.empty(); }
+  uint64_t now() const { return now_; }
+
+  //! The next tick that advance() has work at: the earliest expiry, or before it, the start of a slot to
+  //! cascade. If a timer has expired already, this is the current tick.
+  std::optional<uint64_t> next_wakeup() const;
+
+  //! Move the clock forward to tick `now` (if that is later), and return the timers that have expired (which
+  //! are no longer scheduled), in order of expiry (after any that had expired already when they were added).
+  std::vector<uint64_t> advance( uint64_t now );
+
+private:
+  using Slot = std::list<uint64_t>;
+
+  struct Timer
+  {
+    uint64_t expiry;
+    unsigned level;          //!< LEVELS if it has expired already
+    unsigned slot;           //!< on its level
+    Slot::iterator position; //!< in the slot (or in overdue_)
+  };
+
+  uint64_t now_;
+  std::unordered_map<uint64_t, Timer> timers_ {};
+  std::array<std::array<Slot, SLOTS>, LEVELS> slots_ {};
+  std::array<uint64_t, LEVELS> occupied_ {}; //!< A bit for each slot that holds a timer.
+  Slot overdue_ {};                          //!< Timers that had expired already when added (or cascaded).
+
+  void place( uint64_t id, Timer& timer );
+  void unplace( const Timer& timer );
+  void expire( Slot& slot, std::vector<uint64_t>& expired );
+};
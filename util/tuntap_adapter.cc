@@ -10,12 +10,34 @@ optional<TCPMessage> TCPOverIPv4OverTunFdAdapter::read()
   _tun.read( strs );
 
   InternetDatagram ip_dgram;
-  const vector<string> buffers = { strs.at( 0 ), strs.at( 1 ) };
-  if ( parse( ip_dgram, buffers ) ) {
-    return unwrap_tcp_in_ip( ip_dgram );
+  if ( parse( ip_dgram, move( strs ) ) ) {
+    return unwrap_tcp_in_ip( move( ip_dgram ) );
   }
   return {};
 }
 
+optional<TCPMessage> TCPOverIPv4OverTunFdAdapter::read( string_view datagram )
+{
+  // The datagram's view is only good until the read rule reuses its buffer: take one copy of it, which the headers
+  // are parsed from and the TCP payload then shares
+  Parser parser { Buffer { string { datagram } } };
+  IPv4Header header;
+  header.parse( parser );
+  if ( parser.has_error() ) {
+    return {};
+  }
+  return unwrap_tcp_in_ip( header, parser );
+}
+
+void TCPOverIPv4OverTunFdAdapter::write( const TCPMessage& seg )
+{
+  auto buffers = serialize( wrap_tcp_in_ip( seg ) );
+  if ( _output ) {
+    _output( move( buffers ) );
+  } else {
+    _tun.write( buffers );
+  }
+}
+
 //! Specialize LossyFdAdapter to TCPOverIPv4OverTunFdAdapter
 template class LossyFdAdapter<TCPOverIPv4OverTunFdAdapter>;
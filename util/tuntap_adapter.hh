@@ -4,12 +4,19 @@
 #include "tcp_segment.hh"
 #include "tun.hh"
 
+#include <functional>
 #include <optional>
+#include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
+#include <vector>
+
+//! Where an adapter's write() sends the buffers of each datagram, instead of writing them to its fd itself
+using DatagramOutput = std::function<void( std::vector<std::string>&& )>;
 
 template<class T>
-concept TCPDatagramAdapter = requires( T a, TCPMessage seg ) {
+concept TCPDatagramAdapter = requires( T a, TCPMessage seg, std::string_view datagram, DatagramOutput output ) {
   {
     a.write( seg )
   } -> std::same_as<void>;
@@ -17,6 +24,14 @@ concept TCPDatagramAdapter = requires( T a, TCPMessage seg ) {
   {
     a.read()
   } -> std::same_as<std::optional<TCPMessage>>;
+
+  {
+    a.read( datagram )
+  } -> std::same_as<std::optional<TCPMessage>>;
+
+  {
+    a.set_output( output )
+  } -> std::same_as<void>;
 };
 
 //! \brief A FD adapter for IPv4 datagrams read from and written to a TUN device
@@ -24,6 +39,7 @@ class TCPOverIPv4OverTunFdAdapter : public TCPOverIPv4Adapter
 {
 private:
   TunFD _tun;
+  DatagramOutput _output {};
 
 public:
   //! Construct from a TunFD
@@ -32,8 +48,14 @@ public:
   //! Attempts to read and parse an IPv4 datagram containing a TCP segment related to the current connection
   std::optional<TCPMessage> read();
 
-  //! Creates an IPv4 datagram from a TCP segment and writes it to the TUN device
-  void write( const TCPMessage& seg ) { _tun.write( serialize( wrap_tcp_in_ip( seg ) ) ); }
+  //! Parses an IPv4 datagram that has been read already (e.g. by an EventLoop read rule), as read() does
+  std::optional<TCPMessage> read( std::string_view datagram );
+
+  //! Creates an IPv4 datagram from a TCP segment and writes it to the TUN device (or hands it to the output)
+  void write( const TCPMessage& seg );
+
+  //! Send datagrams to `output` (e.g. EventLoop::write), rather than writing them to the TUN device directly
+  void set_output( DatagramOutput output ) { _output = std::move( output ); }
 
   //! Access the underlying TUN device
   explicit operator TunFD&() { return _tun; }